@@ -0,0 +1,195 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <iterator>
+#include <mutex>
+#include <optional>
+#include <utility>
+#include "concurrency/cache_padded.hpp"
+#include "concurrency/spin_lock.hpp"
+#include "concurrency/thread_pool.hpp"
+
+namespace mpd {
+	namespace impl {
+		// With an automatic grain, each worker gets about this many chunks, so that a worker that's slow, or busy with
+		// other tasks, leaves the rest of its share to the others.
+		const std::size_t parallel_chunks_per_worker = 8;
+
+		inline std::size_t parallel_grain(std::size_t count, std::size_t grain, std::size_t worker_count) noexcept {
+			if (grain != 0) return std::min(grain, count);
+			return std::max<std::size_t>(1, count / (worker_count * parallel_chunks_per_worker));
+		}
+
+		/**
+		* Runs body(begin, end) over the chunks of [0, count). The job lives on the caller's stack, and the same job is
+		* scheduled once per helper, so nothing is allocated per chunk, or even per call. The caller and every helper take
+		* chunks from a shared counter until none are left. A helper that starts late finds nothing and returns at once.
+		* Helpers scheduled from a worker go on its own deque, where idle workers steal them.
+		**/
+		template<class Body>
+		class parallel_job final : public pool_task {
+			Body& body;
+			const std::size_t count;
+			const std::size_t grain;
+			alignas(hardware_destructive_interference_size) std::atomic<std::size_t> next{0};
+			alignas(hardware_destructive_interference_size) std::atomic<std::size_t> running_helpers{0};
+			std::atomic<bool> failed{false};
+			std::exception_ptr error;
+			completion_event helpers_done;
+
+			void work() noexcept {
+				while (!failed.load(std::memory_order_relaxed)) {
+					std::size_t begin = next.fetch_add(grain, std::memory_order_relaxed);
+					if (begin >= count) return;
+					try {
+						body(begin, count - begin < grain ? count : begin + grain);
+					} catch (...) {
+						// the first exception wins, and the remaining chunks are skipped
+						if (!failed.exchange(true, std::memory_order_relaxed))
+							error = std::current_exception();
+					}
+				}
+			}
+			void finish_helpers(std::size_t finished) noexcept {
+				if (running_helpers.fetch_sub(finished, std::memory_order_acq_rel) == finished)
+					helpers_done.set();
+			}
+		public:
+			parallel_job(Body& body_, std::size_t count_, std::size_t grain_) noexcept : body(body_), count(count_), grain(grain_) {}
+			parallel_job(const parallel_job&) = delete;
+			parallel_job& operator=(const parallel_job&) = delete;
+
+			void run() noexcept override {
+				work();
+				finish_helpers(1);
+			}
+			void execute(thread_pool& pool) {
+				std::size_t chunk_count = (count - 1) / grain + 1;
+				std::size_t helper_count = std::min(pool.size(), chunk_count - 1);
+				running_helpers.store(helper_count, std::memory_order_relaxed);
+				std::size_t scheduled = 0;
+				try {
+					for (; scheduled < helper_count; scheduled++)
+						thread_pool_access::schedule(pool, this);
+				} catch (...) {
+					// fewer helpers only means the caller does more of the work
+					if (scheduled < helper_count)
+						finish_helpers(helper_count - scheduled);
+				}
+				work();
+				if (helper_count != 0)
+					helpers_done.wait();
+				if (error) { [[unlikely]] std::rethrow_exception(error); }
+			}
+		};
+
+		template<class Body>
+		void run_parallel(thread_pool& pool, std::size_t count, std::size_t grain, Body& body) {
+			if (count == 0) return;
+			grain = parallel_grain(count, grain, pool.size());
+			// a single chunk isn't worth waking a worker
+			if (grain >= count) {
+				body(0, count);
+				return;
+			}
+			parallel_job<Body> job(body, count, grain);
+			job.execute(pool);
+		}
+
+		struct parallel_identity {
+			template<class T>
+			T&& operator()(T&& value) const noexcept { return std::forward<T>(value); }
+		};
+	}
+
+	/**
+	* Calls function(element) for every element of a random access range, such as a basic_front_buffer or std::vector,
+	* on the pool's workers and the calling thread. The range is split into chunks of grain elements, or if grain is 0,
+	* about 8 chunks per worker. Idle workers take the next chunk, so uneven chunks balance out.
+	* Nothing is allocated. Calls from a worker (nested parallel loops) run other tasks while waiting, rather than block.
+	* If function throws, the remaining chunks are skipped, and the first exception is rethrown once running chunks finish.
+	* ex:
+	* mpd::parallel_for(particles, 0, [](particle& p) { p.step(dt); });
+	**/
+	template<class Range, class F>
+	void parallel_for(thread_pool& pool, Range&& range, std::size_t grain, F&& function) {
+		auto first = std::begin(range);
+		auto body = [first, &function](std::size_t begin, std::size_t end) {
+			for (auto it = first + begin, last = first + end; it != last; ++it)
+				function(*it);
+		};
+		impl::run_parallel(pool, static_cast<std::size_t>(std::end(range) - first), grain, body);
+	}
+	template<class Range, class F>
+	void parallel_for(Range&& range, std::size_t grain, F&& function) {
+		parallel_for(default_thread_pool(), std::forward<Range>(range), grain, std::forward<F>(function));
+	}
+
+	/**
+	* Writes transform(element) for every element of a random access range to the random access dest, in parallel like
+	* parallel_for. Returns the end of the output.
+	* ex:
+	* std::vector<float> scores(features.size());
+	* mpd::parallel_transform(features, scores.begin(), [&](float x) { return weight * x + bias; });
+	**/
+	template<class Range, class OutputIt, class F>
+	OutputIt parallel_transform(thread_pool& pool, Range&& range, OutputIt dest, F&& transform, std::size_t grain = 0) {
+		auto first = std::begin(range);
+		std::size_t count = static_cast<std::size_t>(std::end(range) - first);
+		auto body = [first, dest, &transform](std::size_t begin, std::size_t end) {
+			OutputIt out = dest + begin;
+			for (auto it = first + begin, last = first + end; it != last; ++it, ++out)
+				*out = transform(*it);
+		};
+		impl::run_parallel(pool, count, grain, body);
+		return dest + count;
+	}
+	template<class Range, class OutputIt, class F>
+	OutputIt parallel_transform(Range&& range, OutputIt dest, F&& transform, std::size_t grain = 0) {
+		return parallel_transform(default_thread_pool(), std::forward<Range>(range), dest, std::forward<F>(transform), grain);
+	}
+
+	/**
+	* Combines transform(element) for every element of a random access range with reduce, starting from init, in parallel
+	* like parallel_for. Each chunk is reduced on its own, and the chunk results are combined in whatever order chunks
+	* finish, so reduce must be associative and commutative (float sums may differ in the last bits from run to run).
+	* ex:
+	* float total = mpd::parallel_transform_reduce(scores, 0.0f, std::plus<>(), [](float s) { return s * s; });
+	**/
+	template<class Range, class T, class ReduceOp, class TransformOp>
+	T parallel_transform_reduce(thread_pool& pool, Range&& range, T init, ReduceOp reduce, TransformOp transform, std::size_t grain = 0) {
+		auto first = std::begin(range);
+		std::optional<T> total;
+		adaptive_mutex<> total_lock;
+		auto body = [&](std::size_t begin, std::size_t end) {
+			auto it = first + begin;
+			auto last = first + end;
+			T partial = transform(*it);
+			for (++it; it != last; ++it)
+				partial = reduce(std::move(partial), transform(*it));
+			std::lock_guard<adaptive_mutex<>> guard(total_lock);
+			if (total)
+				total = reduce(std::move(*total), std::move(partial));
+			else
+				total.emplace(std::move(partial));
+		};
+		impl::run_parallel(pool, static_cast<std::size_t>(std::end(range) - first), grain, body);
+		return total ? reduce(std::move(init), std::move(*total)) : init;
+	}
+	template<class Range, class T, class ReduceOp, class TransformOp>
+	T parallel_transform_reduce(Range&& range, T init, ReduceOp reduce, TransformOp transform, std::size_t grain = 0) {
+		return parallel_transform_reduce(default_thread_pool(), std::forward<Range>(range), std::move(init), std::move(reduce), std::move(transform), grain);
+	}
+
+	// Combines the elements of a random access range with reduce, starting from init. See parallel_transform_reduce.
+	template<class Range, class T, class ReduceOp>
+	T parallel_reduce(thread_pool& pool, Range&& range, T init, ReduceOp reduce, std::size_t grain = 0) {
+		return parallel_transform_reduce(pool, std::forward<Range>(range), std::move(init), std::move(reduce), impl::parallel_identity(), grain);
+	}
+	template<class Range, class T, class ReduceOp>
+	T parallel_reduce(Range&& range, T init, ReduceOp reduce, std::size_t grain = 0) {
+		return parallel_transform_reduce(default_thread_pool(), std::forward<Range>(range), std::move(init), std::move(reduce), impl::parallel_identity(), grain);
+	}
+}
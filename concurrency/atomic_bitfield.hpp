@@ -0,0 +1,166 @@
+#pragma once
+#include <atomic>
+#include <type_traits>
+#include <utility>
+#include "concurrency/atomic_spin.hpp"
+#include "containers/bitfield.hpp"
+
+namespace mpd {
+	namespace impl {
+		template<class Field, class...Fields>
+		struct bitfield_is_one_of : std::disjunction<std::is_same<Field, Fields>...> {};
+		template<class BaseT, class...Fields>
+		constexpr bool bitfields_overlap() noexcept {
+			BaseT masks[] = {BaseT(0), Fields::field_mask...};
+			for (std::size_t i = 1; i < sizeof...(Fields) + 1; i++)
+				for (std::size_t j = i + 1; j < sizeof...(Fields) + 1; j++)
+					if (masks[i] & masks[j]) return true;
+			return false;
+		}
+	}
+
+	// A plain copy of the bits of an atomic_bitfield, with access to its fields.
+	template<class BaseT, class...Fields>
+	class bitfield_value {
+		BaseT bits;
+	public:
+		constexpr explicit bitfield_value(BaseT bits_ = 0) noexcept : bits(bits_) {}
+		// a bitfield_member that reads and writes this copy
+		template<class Field>
+		Field field() noexcept {
+			static_assert(impl::bitfield_is_one_of<Field, Fields...>::value, "Field is not a member of this bitfield");
+			return Field(bits);
+		}
+		template<class Field>
+		std::remove_const_t<typename Field::field_type> get() const noexcept {
+			static_assert(impl::bitfield_is_one_of<Field, Fields...>::value, "Field is not a member of this bitfield");
+			return typename Field::as_const(bits).get();
+		}
+		template<class Field>
+		void set(typename Field::field_type value) noexcept { field<Field>().set(value); }
+		constexpr BaseT raw() const noexcept { return bits; }
+
+		friend bool operator==(const bitfield_value& l, const bitfield_value& r) noexcept { return l.bits == r.bits; }
+		friend bool operator!=(const bitfield_value& l, const bitfield_value& r) noexcept { return l.bits != r.bits; }
+	};
+
+	/**
+	* Several bitfield_members packed into one atomic BaseT. Each field can be loaded, stored, exchanged, added to,
+	* or compare-exchanged on its own without disturbing the other fields, and update() changes any number of fields
+	* in a single compare-exchange.
+	*
+	* The Fields are bitfield_member types over BaseT, and must not overlap. Arithmetic must stay in the range of
+	* the field, just like with bitfield_member.
+	* ex:
+	* using state = mpd::bitfield_member<std::uint64_t, unsigned, 4, 0>;
+	* using refs = mpd::bitfield_member<std::uint64_t, unsigned, 28, 4>;
+	* using generation = mpd::bitfield_member<std::uint64_t, unsigned, 32, 32>;
+	* mpd::atomic_bitfield<std::uint64_t, state, refs, generation> connection;
+	* connection.fetch_add<refs>(1);
+	* connection.update([](auto& v) {
+	*	v.template set<state>(closed);
+	*	v.template set<generation>(v.template get<generation>() + 1);
+	*	return mpd::atomic_exchange_result::store;
+	* });
+	**/
+	template<class BaseT, class...Fields>
+	class atomic_bitfield {
+		static_assert(std::conjunction_v<std::is_same<typename Fields::base_type, BaseT>...>, "every field must be a bitfield_member of BaseT");
+		static_assert(!impl::bitfields_overlap<BaseT, Fields...>(), "bitfield members overlap");
+		std::atomic<BaseT> bits;
+	public:
+		using value_type = bitfield_value<BaseT, Fields...>;
+
+		constexpr atomic_bitfield() noexcept : bits(0) {}
+		constexpr explicit atomic_bitfield(value_type initial) noexcept : bits(initial.raw()) {}
+		atomic_bitfield(const atomic_bitfield&) = delete;
+		atomic_bitfield& operator=(const atomic_bitfield&) = delete;
+
+		value_type load(std::memory_order order = std::memory_order_seq_cst) const noexcept { return value_type(bits.load(order)); }
+		void store(value_type value, std::memory_order order = std::memory_order_seq_cst) noexcept { bits.store(value.raw(), order); }
+		bool compare_exchange(value_type& expected, value_type desired) noexcept {
+			BaseT raw = expected.raw();
+			bool exchanged = bits.compare_exchange_strong(raw, desired.raw());
+			expected = value_type(raw);
+			return exchanged;
+		}
+
+		/**
+		* Applies mutation to a bitfield_value copy, and stores it, as atomic_exchange_spin.
+		* Returns {did_the_update_complete, newest_value}.
+		**/
+		template<class Backoff = pause_backoff, class F>
+		std::pair<bool, value_type> update(F&& mutation) {
+			auto result = atomic_exchange_spin<Backoff>(bits, [&](BaseT& raw) {
+				value_type value(raw);
+				atomic_exchange_result step = mutation(value);
+				raw = value.raw();
+				return step;
+			});
+			return {result.first, value_type(result.second)};
+		}
+		template<class Backoff = pause_backoff, class F>
+		std::pair<bool, value_type> update(F&& mutation, atomic_spin_stats& stats) {
+			auto result = atomic_exchange_spin<Backoff>(bits, [&](BaseT& raw) {
+				value_type value(raw);
+				atomic_exchange_result step = mutation(value);
+				raw = value.raw();
+				return step;
+			}, stats);
+			return {result.first, value_type(result.second)};
+		}
+
+		template<class Field>
+		auto load(std::memory_order order = std::memory_order_seq_cst) const noexcept { return load(order).template get<Field>(); }
+		template<class Field>
+		void store(typename Field::field_type value) noexcept {
+			update([&](value_type& v) { v.template set<Field>(value); return atomic_exchange_result::store; });
+		}
+		// returns the previous value of the field
+		template<class Field>
+		auto exchange(typename Field::field_type value) noexcept {
+			std::remove_const_t<typename Field::field_type> previous;
+			update([&](value_type& v) {
+				previous = v.template get<Field>();
+				v.template set<Field>(value);
+				return atomic_exchange_result::store;
+			});
+			return previous;
+		}
+		// returns the previous value of the field
+		template<class Field>
+		auto fetch_add(typename Field::field_type delta) noexcept {
+			std::remove_const_t<typename Field::field_type> previous;
+			update([&](value_type& v) {
+				previous = v.template get<Field>();
+				v.template set<Field>(previous + delta);
+				return atomic_exchange_result::store;
+			});
+			return previous;
+		}
+		// returns the previous value of the field
+		template<class Field>
+		auto fetch_sub(typename Field::field_type delta) noexcept {
+			std::remove_const_t<typename Field::field_type> previous;
+			update([&](value_type& v) {
+				previous = v.template get<Field>();
+				v.template set<Field>(previous - delta);
+				return atomic_exchange_result::store;
+			});
+			return previous;
+		}
+		// Only compares the one field, changes in other fields don't cause a failure. On failure, expected is updated.
+		template<class Field>
+		bool compare_exchange(std::remove_const_t<typename Field::field_type>& expected, typename Field::field_type desired) noexcept {
+			return update([&](value_type& v) {
+				auto current = v.template get<Field>();
+				if (current != expected) {
+					expected = current;
+					return atomic_exchange_result::abort;
+				}
+				v.template set<Field>(desired);
+				return atomic_exchange_result::store;
+			}).first;
+		}
+	};
+}
@@ -0,0 +1,161 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <utility>
+#include "concurrency/atomic_spin.hpp"
+#if defined(_MSC_VER) && defined(_M_X64)
+#include <intrin.h>
+#pragma intrinsic(_InterlockedCompareExchange128)
+#endif
+
+#if (defined(__GNUC__) || defined(__clang__)) && defined(__x86_64__)
+#define MPD_DOUBLE_WORD_CAS 1
+#elif defined(_MSC_VER) && defined(_M_X64)
+#define MPD_DOUBLE_WORD_CAS 1
+#else
+#define MPD_DOUBLE_WORD_CAS 0
+#endif
+
+namespace mpd {
+	/**
+	* A pointer with a counter, for lock-free structures that are subject to ABA, such as free lists.
+	* Bump the tag on every update, so a compare-exchange against a pointer that was popped and pushed back fails.
+	* ex:
+	* mpd::atomic_pair<mpd::tagged_ptr<node>> head;
+	* mpd::tagged_ptr<node> old_head = head.load();
+	* while (!head.compare_exchange_weak(old_head, old_head.with(old_head.ptr->next))) {}
+	**/
+	template<class T>
+	struct tagged_ptr {
+		T* ptr;
+		std::uintptr_t tag;
+
+		// the next version of this pointer
+		tagged_ptr with(T* new_ptr) const noexcept { return {new_ptr, tag + 1}; }
+		friend bool operator==(const tagged_ptr& lhs, const tagged_ptr& rhs) noexcept { return lhs.ptr == rhs.ptr && lhs.tag == rhs.tag; }
+		friend bool operator!=(const tagged_ptr& lhs, const tagged_ptr& rhs) noexcept { return !(lhs == rhs); }
+	};
+
+	namespace impl {
+#if MPD_DOUBLE_WORD_CAS
+		// lock cmpxchg16b. On failure, expected receives the current value.
+		inline bool double_word_cas(std::uint64_t* target, std::uint64_t* expected, const std::uint64_t* desired) noexcept {
+#ifdef _MSC_VER
+			return _InterlockedCompareExchange128(reinterpret_cast<volatile long long*>(target),
+				static_cast<long long>(desired[1]), static_cast<long long>(desired[0]), reinterpret_cast<long long*>(expected)) != 0;
+#else
+			bool equal;
+			__asm__ __volatile__("lock cmpxchg16b %1"
+				: "=@ccz"(equal), "+m"(*reinterpret_cast<unsigned __int128*>(target)), "+a"(expected[0]), "+d"(expected[1])
+				: "b"(desired[0]), "c"(desired[1])
+				: "memory");
+			return equal;
+#endif
+		}
+#endif
+	}
+
+	/**
+	* An atomic two-word value, such as a tagged_ptr or a pair of counters, without the lock that std::atomic falls back
+	* to for 16-byte types unless the compiler is told the CPU has cmpxchg16b. On x86-64, every operation is a
+	* lock cmpxchg16b, so all are sequentially consistent. Elsewhere, it's a std::atomic<T>.
+	*
+	* T must be trivially copyable, two pointers in size, and have no padding, since compare-exchange compares bytes.
+	* atomic_exchange_spin accepts an atomic_pair as well as a std::atomic.
+	* is_always_lock_free reports at compile time whether the platform has a lock-free path:
+	* static_assert(mpd::atomic_pair<mpd::tagged_ptr<node>>::is_always_lock_free, "free list requires cmpxchg16b");
+	**/
+	template<class T>
+	class atomic_pair {
+		static_assert(std::is_trivially_copyable_v<T>, "atomic_pair<T> requires a trivially copyable T");
+		static_assert(sizeof(T) == 2 * sizeof(void*), "atomic_pair<T> requires a T two pointers in size");
+		static_assert(std::has_unique_object_representations_v<T>, "atomic_pair<T> requires a T without padding");
+#if MPD_DOUBLE_WORD_CAS
+		// read by a compare-exchange, which needs the memory to be writable even when the value doesn't change
+		alignas(16) mutable std::uint64_t words[2];
+
+		static void to_words(const T& value, std::uint64_t* out) noexcept { std::memcpy(out, &value, sizeof(T)); }
+		static T from_words(const std::uint64_t* in) noexcept {
+			T value;
+			std::memcpy(&value, in, sizeof(T));
+			return value;
+		}
+	public:
+		using value_type = T;
+		static constexpr bool is_always_lock_free = true;
+
+		atomic_pair() noexcept : words{0, 0} {}
+		atomic_pair(const T& value) noexcept { to_words(value, words); }
+		atomic_pair(const atomic_pair&) = delete;
+		atomic_pair& operator=(const atomic_pair&) = delete;
+
+		T load(std::memory_order = std::memory_order_seq_cst) const noexcept {
+			// a compare-exchange that either fails, returning the value, or succeeds in writing back the same value
+			std::uint64_t expected[2] = {0, 0};
+			impl::double_word_cas(words, expected, expected);
+			return from_words(expected);
+		}
+		void store(const T& desired, std::memory_order order = std::memory_order_seq_cst) noexcept { exchange(desired, order); }
+		T exchange(const T& desired, std::memory_order = std::memory_order_seq_cst) noexcept {
+			std::uint64_t expected[2] = {0, 0}; // a wrong guess costs one failed attempt, which reads the value
+			std::uint64_t desired_words[2];
+			to_words(desired, desired_words);
+			while (!impl::double_word_cas(words, expected, desired_words)) {}
+			return from_words(expected);
+		}
+		bool compare_exchange_strong(T& expected, const T& desired, std::memory_order = std::memory_order_seq_cst, std::memory_order = std::memory_order_seq_cst) noexcept {
+			std::uint64_t expected_words[2];
+			std::uint64_t desired_words[2];
+			to_words(expected, expected_words);
+			to_words(desired, desired_words);
+			if (impl::double_word_cas(words, expected_words, desired_words)) { [[likely]] return true; }
+			expected = from_words(expected_words);
+			return false;
+		}
+#else
+		std::atomic<T> value;
+	public:
+		using value_type = T;
+		static constexpr bool is_always_lock_free = std::atomic<T>::is_always_lock_free;
+
+		atomic_pair() noexcept : value(T{}) {}
+		atomic_pair(const T& initial) noexcept : value(initial) {}
+		atomic_pair(const atomic_pair&) = delete;
+		atomic_pair& operator=(const atomic_pair&) = delete;
+
+		T load(std::memory_order order = std::memory_order_seq_cst) const noexcept { return value.load(order); }
+		void store(const T& desired, std::memory_order order = std::memory_order_seq_cst) noexcept { value.store(desired, order); }
+		T exchange(const T& desired, std::memory_order order = std::memory_order_seq_cst) noexcept { return value.exchange(desired, order); }
+		bool compare_exchange_strong(T& expected, const T& desired, std::memory_order success = std::memory_order_seq_cst, std::memory_order failure = std::memory_order_seq_cst) noexcept {
+			return value.compare_exchange_strong(expected, desired, success, failure);
+		}
+#endif
+		// never fails spuriously, but is provided so that atomic_pair can stand in for std::atomic
+		bool compare_exchange_weak(T& expected, const T& desired, std::memory_order success = std::memory_order_seq_cst, std::memory_order failure = std::memory_order_seq_cst) noexcept {
+			return compare_exchange_strong(expected, desired, success, failure);
+		}
+		bool is_lock_free() const noexcept {
+#if MPD_DOUBLE_WORD_CAS
+			return true;
+#else
+			return value.is_lock_free();
+#endif
+		}
+		operator T() const noexcept { return load(); }
+	};
+	template<class T>
+	using atomic_tagged_ptr = atomic_pair<tagged_ptr<T>>;
+
+	// atomic_exchange_spin for an atomic_pair
+	template<class Backoff = pause_backoff, class T, class F>
+	std::pair<bool, T> atomic_exchange_spin(atomic_pair<T>& atomic, F&& mutation) {
+		impl::no_atomic_spin_stats stats;
+		return impl::atomic_exchange_spin<Backoff>(atomic, mutation, stats);
+	}
+	template<class Backoff = pause_backoff, class T, class F>
+	std::pair<bool, T> atomic_exchange_spin(atomic_pair<T>& atomic, F&& mutation, atomic_spin_stats& stats) {
+		return impl::atomic_exchange_spin<Backoff>(atomic, mutation, stats);
+	}
+}
@@ -1,8 +1,175 @@
+#pragma once
 #include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <type_traits>
 #include <utility>
-#include "../utilities/macros.hpp"
+#include <vector>
+#include "concurrency/cache_padded.hpp"
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+#include <intrin.h>
+#pragma intrinsic(_mm_pause)
+#endif
 
 namespace mpd {
+	// Tells the CPU that this is a spin-wait loop, which saves power, and yields the core to a hyperthread sibling.
+	inline void cpu_relax() noexcept {
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+		_mm_pause();
+#elif defined(_MSC_VER) && defined(_M_ARM64)
+		__yield();
+#elif defined(__i386__) || defined(__x86_64__)
+		__builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+		asm volatile("yield");
+#endif
+	}
+
+	/**
+	* Backoff policies for spin loops. A new policy object is created for each operation, and called after each
+	* failed attempt, so it can wait longer each time.
+	*
+	* - no_backoff: retry immediately. Fastest when there is no contention.
+	* - pause_backoff: a single cpu_relax between attempts.
+	* - exponential_backoff: doubles the number of cpu_relax calls after each failure, up to max_spins, with jitter,
+	*		so that threads that collided don't collide again in lockstep.
+	* - spin_then_yield_backoff: pauses for the first spin_limit failures, then yields the thread to the OS. Best when
+	*		there are more threads than cores.
+	**/
+	struct no_backoff {
+		void operator()() noexcept {}
+	};
+	struct pause_backoff {
+		void operator()() noexcept { cpu_relax(); }
+	};
+	template<unsigned max_spins = 1024>
+	class exponential_backoff {
+		static_assert(max_spins > 0 && (max_spins & (max_spins - 1)) == 0, "max_spins must be a power of two");
+		unsigned limit = 1;
+		static unsigned jitter() noexcept {
+			static thread_local std::uint32_t state = static_cast<std::uint32_t>(reinterpret_cast<std::uintptr_t>(&state)) | 1;
+			state ^= state << 13;
+			state ^= state >> 17;
+			state ^= state << 5;
+			return state;
+		}
+	public:
+		void operator()() noexcept {
+			// between limit/2 and limit spins
+			unsigned spins = limit / 2 + (jitter() & (limit - 1)) / 2 + 1;
+			for (unsigned i = 0; i < spins; i++)
+				cpu_relax();
+			if (limit < max_spins) limit *= 2;
+		}
+	};
+	template<unsigned spin_limit = 16>
+	class spin_then_yield_backoff {
+		unsigned failures = 0;
+	public:
+		void operator()() noexcept {
+			if (failures < spin_limit) {
+				++failures;
+				cpu_relax();
+			} else
+				std::this_thread::yield();
+		}
+	};
+
+	struct atomic_spin_site_stats {
+		const char* name;
+		// calls to atomic_exchange_spin
+		unsigned long long calls;
+		// compare-exchanges that failed because another thread changed the value
+		unsigned long long failures;
+		// times the mutation returned atomic_exchange_result::retry
+		unsigned long long retries;
+		// times the mutation returned atomic_exchange_result::abort
+		unsigned long long aborts;
+	};
+	namespace impl {
+		struct atomic_spin_counters {
+			std::atomic<unsigned long long> calls{0};
+			std::atomic<unsigned long long> failures{0};
+			std::atomic<unsigned long long> retries{0};
+			std::atomic<unsigned long long> aborts{0};
+		};
+		inline void add_relaxed(std::atomic<unsigned long long>& counter, unsigned long long value) noexcept {
+			if (value) counter.fetch_add(value, std::memory_order_relaxed);
+		}
+	}
+
+	/**
+	* Counters for a single atomic_exchange_spin call site, to find which atomics are contended.
+	* Each thread counts into its own cache line, so counting doesn't add contention of its own.
+	* Every live atomic_spin_stats is listed by atomic_spin_stats_report().
+	* ex:
+	* static mpd::atomic_spin_stats limiter_stats("rate_limiter");
+	* mpd::atomic_exchange_spin<mpd::exponential_backoff<>>(tokens, take_token, limiter_stats);
+	**/
+	class atomic_spin_stats {
+		const char* site_name;
+		per_thread<impl::atomic_spin_counters, 16> counters;
+		atomic_spin_stats* next;
+		atomic_spin_stats* prev;
+
+		struct registry {
+			std::mutex lock;
+			atomic_spin_stats* first = nullptr;
+		};
+		// never destroyed, since stats may be destroyed during static destruction
+		static registry& all() {
+			static registry* instance = new registry();
+			return *instance;
+		}
+		friend std::vector<atomic_spin_site_stats> atomic_spin_stats_report();
+	public:
+		explicit atomic_spin_stats(const char* name) : site_name(name), prev(nullptr) {
+			registry& r = all();
+			std::lock_guard<std::mutex> guard(r.lock);
+			next = r.first;
+			if (next) next->prev = this;
+			r.first = this;
+		}
+		atomic_spin_stats(const atomic_spin_stats&) = delete;
+		atomic_spin_stats& operator=(const atomic_spin_stats&) = delete;
+		~atomic_spin_stats() {
+			registry& r = all();
+			std::lock_guard<std::mutex> guard(r.lock);
+			if (prev) prev->next = next;
+			else r.first = next;
+			if (next) next->prev = prev;
+		}
+
+		void record(unsigned long long failures, unsigned long long retries, bool aborted) noexcept {
+			impl::atomic_spin_counters& local = counters.local();
+			local.calls.fetch_add(1, std::memory_order_relaxed);
+			impl::add_relaxed(local.failures, failures);
+			impl::add_relaxed(local.retries, retries);
+			impl::add_relaxed(local.aborts, aborted ? 1 : 0);
+		}
+		atomic_spin_site_stats get() const noexcept {
+			atomic_spin_site_stats stats = {site_name, 0, 0, 0, 0};
+			counters.for_each([&](const impl::atomic_spin_counters& c) {
+				stats.calls += c.calls.load(std::memory_order_relaxed);
+				stats.failures += c.failures.load(std::memory_order_relaxed);
+				stats.retries += c.retries.load(std::memory_order_relaxed);
+				stats.aborts += c.aborts.load(std::memory_order_relaxed);
+			});
+			return stats;
+		}
+		const char* name() const noexcept { return site_name; }
+	};
+	// the counters of every live atomic_spin_stats
+	inline std::vector<atomic_spin_site_stats> atomic_spin_stats_report() {
+		atomic_spin_stats::registry& r = atomic_spin_stats::all();
+		std::lock_guard<std::mutex> guard(r.lock);
+		std::vector<atomic_spin_site_stats> report;
+		for (atomic_spin_stats* s = r.first; s != nullptr; s = s->next)
+			report.push_back(s->get());
+		return report;
+	}
+
 	/**
 	* return values from atomic_exchange_spin mutation operations.
 	*
@@ -12,6 +179,43 @@ namespace mpd {
 	**/
 	enum class atomic_exchange_result { store, abort, retry };
 
+	namespace impl {
+		struct no_atomic_spin_stats {
+			void record(unsigned long long, unsigned long long, bool) noexcept {}
+		};
+		// Atomic is a std::atomic, or anything with the same value_type, load and compare_exchange_weak
+		template<class Backoff, class Atomic, class F, class Stats>
+		std::pair<bool, typename Atomic::value_type> atomic_exchange_spin(Atomic& atomic, F& mutation, Stats& stats) {
+			using T = typename Atomic::value_type;
+#if __cpp_lib_is_invocable
+			static_assert(std::is_invocable_r_v<atomic_exchange_result, F, T&>); //gives clearer error messages since C++20
+#endif
+			Backoff backoff;
+			unsigned long long failures = 0;
+			unsigned long long retries = 0;
+			T old_value = atomic.load(std::memory_order_acquire);
+			T store_value;
+			for (;;) {
+				store_value = old_value;
+				auto step = mutation(store_value);
+				if (step == atomic_exchange_result::abort) { [[unlikely]]
+					stats.record(failures, retries, true);
+					return {false, old_value};
+				} else if (step == atomic_exchange_result::retry) { [[unlikely]]
+					++retries;
+					backoff();
+					old_value = atomic.load(std::memory_order_acquire);
+				} else if (atomic.compare_exchange_weak(old_value, store_value)) { [[likely]]
+					stats.record(failures, retries, false);
+					return {true, store_value};
+				} else {
+					++failures;
+					backoff();
+				}
+			}
+		}
+	}
+
 	/**
 	* Update atomic variable with a non-atomic operation, via a spin/retry.
 	*
@@ -20,25 +224,21 @@ namespace mpd {
 	*
 	* atomic_exchange_spin calls the mutating operation with the current value of the atomic,
 	* and then stores the result in the atomic, and returns {true, newValue}.
-	* If the atomic's value was changed between read and write, atomic_exchange_spin retries.
+	* If the atomic's value was changed between read and write, atomic_exchange_spin waits according to
+	* the Backoff policy, and then retries.
 	*
-	* Takes an atomic by reference, and a mutating operation.
+	* Takes an atomic by reference, a mutating operation, and optionally an atomic_spin_stats for this call site.
 	* Returns a tuple of {did_the_update_complete, newestValue}.
+	* ex:
+	* mpd::atomic_exchange_spin<mpd::exponential_backoff<>>(counter, [](long& v) { ++v; return mpd::atomic_exchange_result::store; });
 	**/
-	template<class T, class F, class...Args>
+	template<class Backoff = pause_backoff, class T, class F>
 	std::pair<bool, T> atomic_exchange_spin(std::atomic<T>& atomic, F&& mutation) {
-#if __cpp_lib_is_invocable
-		static_assert(std::is_invocable_r_v<atomic_bitfield_mutate_step, F, T&>); //gives clearer error messages since C++20
-#endif
-		T old_value = atomic.load(std::memory_order_consume);
-		T store_value;
-		for (;;) {
-			store_value = old_value;
-			auto step = mutation(store_value);
-			if (step == atomic_exchange_result::abort) { [[unlikely]] return {false, old_value}; } 
-			else if (step == atomic_exchange_result::retry) { [[unlikely]] old_value = atomic.load(std::memory_order_consume); continue; } 
-			else if (atomic.compare_exchange_weak(old_value, store_value)) {[[likely]] return {true, store_value}; }
-		}
-		return {true, store_value};
+		impl::no_atomic_spin_stats stats;
+		return impl::atomic_exchange_spin<Backoff>(atomic, mutation, stats);
+	}
+	template<class Backoff = pause_backoff, class T, class F>
+	std::pair<bool, T> atomic_exchange_spin(std::atomic<T>& atomic, F&& mutation, atomic_spin_stats& stats) {
+		return impl::atomic_exchange_spin<Backoff>(atomic, mutation, stats);
 	}
-}
\ No newline at end of file
+}
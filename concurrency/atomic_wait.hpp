@@ -0,0 +1,64 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#if !__cpp_lib_atomic_wait
+#if defined(__linux__)
+#include <climits>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#elif defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#pragma comment(lib, "Synchronization.lib")
+#endif
+#endif
+
+namespace mpd {
+	/**
+	* Blocks the thread until the atomic is notified and no longer holds old_value, without spinning.
+	* Like C++20's std::atomic::wait, which is used where available. Otherwise this is a futex on Linux,
+	* WaitOnAddress on Windows, and a yield loop elsewhere.
+	* Spurious wakeups are possible, so callers should re-check their condition.
+	**/
+	inline void atomic_wait(const std::atomic<std::uint32_t>& atomic, std::uint32_t old_value) noexcept {
+#if __cpp_lib_atomic_wait
+		atomic.wait(old_value, std::memory_order_acquire);
+#elif defined(__linux__)
+		static_assert(sizeof(std::atomic<std::uint32_t>) == sizeof(std::uint32_t), "futex requires a plain 32 bit word");
+		while (atomic.load(std::memory_order_acquire) == old_value)
+			syscall(SYS_futex, reinterpret_cast<const std::uint32_t*>(&atomic), FUTEX_WAIT_PRIVATE, old_value, nullptr, nullptr, 0);
+#elif defined(_WIN32)
+		while (atomic.load(std::memory_order_acquire) == old_value)
+			WaitOnAddress(const_cast<std::atomic<std::uint32_t>*>(&atomic), &old_value, sizeof(old_value), INFINITE);
+#else
+		while (atomic.load(std::memory_order_acquire) == old_value)
+			std::this_thread::yield();
+#endif
+	}
+	inline void atomic_notify_one(std::atomic<std::uint32_t>& atomic) noexcept {
+#if __cpp_lib_atomic_wait
+		atomic.notify_one();
+#elif defined(__linux__)
+		syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&atomic), FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+#elif defined(_WIN32)
+		WakeByAddressSingle(&atomic);
+#else
+		(void)atomic;
+#endif
+	}
+	inline void atomic_notify_all(std::atomic<std::uint32_t>& atomic) noexcept {
+#if __cpp_lib_atomic_wait
+		atomic.notify_all();
+#elif defined(__linux__)
+		syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&atomic), FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+#elif defined(_WIN32)
+		WakeByAddressAll(&atomic);
+#else
+		(void)atomic;
+#endif
+	}
+}
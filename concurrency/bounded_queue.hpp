@@ -0,0 +1,397 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include "concurrency/atomic_spin.hpp"
+#include "concurrency/atomic_wait.hpp"
+#include "concurrency/cache_padded.hpp"
+
+namespace mpd {
+	namespace impl {
+		// Lets threads sleep until the other side of a queue makes progress, while costing the other side only a fence
+		// and a load when nobody is sleeping.
+		class queue_waiters {
+			std::atomic<std::uint32_t> epoch{0};
+			std::atomic<std::uint32_t> sleeping{0};
+		public:
+			void notify() noexcept {
+				// orders the caller's publish before the load of sleeping, pairing with the fetch_add in wait_until
+				std::atomic_thread_fence(std::memory_order_seq_cst);
+				if (sleeping.load(std::memory_order_relaxed) != 0) { [[unlikely]]
+					epoch.fetch_add(1, std::memory_order_release);
+					atomic_notify_all(epoch);
+				}
+			}
+			// Calls ready() until it returns true, sleeping between attempts.
+			template<class F>
+			void wait_until(F&& ready) {
+				spin_then_yield_backoff<64> backoff;
+				for (unsigned i = 0; i < 128; i++) {
+					if (ready()) return;
+					backoff();
+				}
+				for (;;) {
+					sleeping.fetch_add(1, std::memory_order_seq_cst);
+					std::uint32_t seen = epoch.load(std::memory_order_acquire);
+					if (ready()) {
+						sleeping.fetch_sub(1, std::memory_order_relaxed);
+						return;
+					}
+					atomic_wait(epoch, seen);
+					sleeping.fetch_sub(1, std::memory_order_relaxed);
+				}
+			}
+		};
+	}
+
+	/**
+	* A fixed capacity single-producer single-consumer queue, with inline storage.
+	*
+	* The producer and consumer each own an index on their own cache line, and keep a cached copy of the other's index,
+	* so they only touch the other's line when the queue looks full (or empty). try_push_n/try_pop_n move a whole batch
+	* with a single publish. push and pop block, parking the thread with atomic_wait once spinning doesn't pay off.
+	* capacity must be a power of two.
+	* ex:
+	* mpd::spsc_queue<message, 1024> queue;
+	* queue.push(make_message()); // producer thread
+	* message m = queue.pop(); // consumer thread
+	**/
+	template<class T, std::size_t capacity_>
+	class spsc_queue {
+		static_assert(capacity_ > 0 && (capacity_ & (capacity_ - 1)) == 0, "capacity must be a power of two");
+		static const std::size_t mask = capacity_ - 1;
+
+		struct alignas(hardware_destructive_interference_size) producer_side {
+			std::atomic<std::size_t> tail{0};
+			std::size_t cached_head = 0;
+			impl::queue_waiters waiters; // consumers waiting for items
+		} producer;
+		struct alignas(hardware_destructive_interference_size) consumer_side {
+			std::atomic<std::size_t> head{0};
+			std::size_t cached_tail = 0;
+			impl::queue_waiters waiters; // producers waiting for space
+		} consumer;
+		union data {
+			char no_construct;
+			alignas(hardware_destructive_interference_size) T buffer[capacity_];
+			data() {}
+			~data() {}
+		} d;
+
+		void release(std::size_t head, std::size_t count) noexcept {
+			if (count) {
+				consumer.head.store(head + count, std::memory_order_release);
+				consumer.waiters.notify();
+			}
+		}
+	public:
+		using value_type = T;
+		spsc_queue() noexcept {}
+		spsc_queue(const spsc_queue&) = delete;
+		spsc_queue& operator=(const spsc_queue&) = delete;
+		~spsc_queue() {
+			std::size_t tail = producer.tail.load(std::memory_order_acquire);
+			for (std::size_t i = consumer.head.load(std::memory_order_relaxed); i != tail; i++)
+				d.buffer[i & mask].~T();
+		}
+
+		// Producer only. Constructs up to count items from first, and returns how many fit.
+		// If constructing an item throws, none of them are pushed.
+		template<class InputIt>
+		std::size_t try_push_n(InputIt first, std::size_t count) {
+			std::size_t tail = producer.tail.load(std::memory_order_relaxed);
+			std::size_t space = capacity_ - (tail - producer.cached_head);
+			if (space < count) {
+				producer.cached_head = consumer.head.load(std::memory_order_acquire);
+				space = capacity_ - (tail - producer.cached_head);
+			}
+			count = (std::min)(count, space);
+			std::size_t i = 0;
+			try {
+				for (; i < count; i++, ++first)
+					::new(static_cast<void*>(d.buffer + ((tail + i) & mask))) T(*first);
+			} catch (...) {
+				while (i-- > 0)
+					d.buffer[(tail + i) & mask].~T();
+				throw;
+			}
+			if (count) {
+				producer.tail.store(tail + count, std::memory_order_release);
+				producer.waiters.notify();
+			}
+			return count;
+		}
+		template<class...Args>
+		bool try_emplace(Args&&...args) {
+			std::size_t tail = producer.tail.load(std::memory_order_relaxed);
+			if (tail - producer.cached_head == capacity_) {
+				producer.cached_head = consumer.head.load(std::memory_order_acquire);
+				if (tail - producer.cached_head == capacity_) return false;
+			}
+			::new(static_cast<void*>(d.buffer + (tail & mask))) T(std::forward<Args>(args)...);
+			producer.tail.store(tail + 1, std::memory_order_release);
+			producer.waiters.notify();
+			return true;
+		}
+		bool try_push(const T& value) { return try_emplace(value); }
+		bool try_push(T&& value) { return try_emplace(std::move(value)); }
+		template<class U>
+		void push(U&& value) {
+			if (try_push(std::forward<U>(value))) { [[likely]] return; }
+			consumer.waiters.wait_until([&]() { return try_push(std::forward<U>(value)); });
+		}
+
+		// Consumer only. Moves up to count items to out, and returns how many there were.
+		// If moving an item throws, that item and the ones after it stay in the queue.
+		template<class OutputIt>
+		std::size_t try_pop_n(OutputIt out, std::size_t count) {
+			std::size_t head = consumer.head.load(std::memory_order_relaxed);
+			std::size_t available = consumer.cached_tail - head;
+			if (available < count) {
+				consumer.cached_tail = producer.tail.load(std::memory_order_acquire);
+				available = consumer.cached_tail - head;
+			}
+			count = (std::min)(count, available);
+			std::size_t i = 0;
+			try {
+				for (; i < count; i++, ++out) {
+					T& item = d.buffer[(head + i) & mask];
+					*out = std::move(item);
+					item.~T();
+				}
+			} catch (...) {
+				release(head, i);
+				throw;
+			}
+			release(head, count);
+			return count;
+		}
+		bool try_pop(T& out) { return try_pop_n(&out, 1) == 1; }
+		T pop() {
+			std::size_t head = consumer.head.load(std::memory_order_relaxed);
+			if (consumer.cached_tail == head) {
+				producer.waiters.wait_until([&]() {
+					consumer.cached_tail = producer.tail.load(std::memory_order_acquire);
+					return consumer.cached_tail != head;
+				});
+			}
+			T& item = d.buffer[head & mask];
+			T result(std::move(item));
+			item.~T();
+			consumer.head.store(head + 1, std::memory_order_release);
+			consumer.waiters.notify();
+			return result;
+		}
+
+		// Only exact when called from the producer or consumer while the other is idle.
+		std::size_t size_approx() const noexcept {
+			return producer.tail.load(std::memory_order_acquire) - consumer.head.load(std::memory_order_acquire);
+		}
+		bool empty_approx() const noexcept { return size_approx() == 0; }
+		static constexpr std::size_t capacity() noexcept { return capacity_; }
+	};
+
+	/**
+	* A fixed capacity multi-producer multi-consumer queue, with inline storage (Dmitry Vyukov's bounded MPMC queue).
+	*
+	* Each cell has a sequence number that says whether it's ready to be written or read on the current lap, so
+	* producers and consumers only contend on the enqueue or dequeue index with a single compare-exchange, and never
+	* wait for each other unless the queue is full or empty. try_push_n/try_pop_n claim a run of cells with a single
+	* compare-exchange. push and pop block, parking the thread with atomic_wait once spinning doesn't pay off.
+	* capacity must be a power of two.
+	* A cell is claimed before its item is constructed or moved out, so if that throws, the cell is still released:
+	* a cell whose item couldn't be constructed is published empty, and consumers skip it.
+	**/
+	template<class T, std::size_t capacity_>
+	class mpmc_queue {
+		static_assert(capacity_ > 1 && (capacity_ & (capacity_ - 1)) == 0, "capacity must be a power of two greater than 1");
+		static const std::size_t mask = capacity_ - 1;
+
+		struct cell {
+			std::atomic<std::size_t> sequence;
+			// false if constructing the item threw. Written before the sequence is published.
+			bool has_value;
+			union data {
+				char no_construct;
+				T value;
+				data() {}
+				~data() {}
+			} d;
+		};
+		alignas(hardware_destructive_interference_size) std::atomic<std::size_t> enqueue_pos{0};
+		alignas(hardware_destructive_interference_size) std::atomic<std::size_t> dequeue_pos{0};
+		alignas(hardware_destructive_interference_size) impl::queue_waiters pushed; // consumers waiting for items
+		alignas(hardware_destructive_interference_size) impl::queue_waiters popped; // producers waiting for space
+		alignas(hardware_destructive_interference_size) cell cells[capacity_];
+
+		// claims up to count consecutive cells, where a cell is ready when its sequence is pos + offset.
+		std::size_t claim(std::atomic<std::size_t>& index, std::size_t offset, std::size_t count, std::size_t& first) noexcept {
+			// with nothing to claim, the loop below would never see a full (or empty) cell, and spin forever
+			if (count == 0) return 0;
+			std::size_t pos = index.load(std::memory_order_relaxed);
+			for (;;) {
+				std::size_t ready = 0;
+				for (; ready < count; ready++) {
+					std::size_t seq = cells[(pos + ready) & mask].sequence.load(std::memory_order_acquire);
+					if (seq != pos + ready + offset) break;
+				}
+				if (ready == 0) {
+					std::intptr_t diff = static_cast<std::intptr_t>(cells[pos & mask].sequence.load(std::memory_order_acquire) - (pos + offset));
+					if (diff < 0) return 0; // full (or empty), this cell hasn't been released from the last lap
+					pos = index.load(std::memory_order_relaxed); // another thread claimed it, try the next one
+					continue;
+				}
+				if (index.compare_exchange_weak(pos, pos + ready, std::memory_order_relaxed)) {
+					first = pos;
+					return ready;
+				}
+			}
+		}
+		// Constructs a claimed cell's item with construct(void*), and publishes it, even if construct throws.
+		template<class F>
+		void publish(std::size_t pos, F&& construct) {
+			cell& c = cells[pos & mask];
+			try {
+				construct(static_cast<void*>(&c.d.value));
+			} catch (...) {
+				publish_empty(pos);
+				throw;
+			}
+			c.has_value = true;
+			c.sequence.store(pos + 1, std::memory_order_release);
+		}
+		void publish_empty(std::size_t pos) noexcept {
+			cell& c = cells[pos & mask];
+			c.has_value = false;
+			c.sequence.store(pos + 1, std::memory_order_release);
+		}
+		// Destroys a claimed cell's item, if it has one, and makes the cell free for the next lap.
+		void release(std::size_t pos) noexcept {
+			cell& c = cells[pos & mask];
+			if (c.has_value)
+				c.d.value.~T();
+			c.sequence.store(pos + capacity_, std::memory_order_release);
+		}
+	public:
+		using value_type = T;
+		mpmc_queue() noexcept {
+			for (std::size_t i = 0; i < capacity_; i++) {
+				cells[i].sequence.store(i, std::memory_order_relaxed);
+				cells[i].has_value = false;
+			}
+		}
+		mpmc_queue(const mpmc_queue&) = delete;
+		mpmc_queue& operator=(const mpmc_queue&) = delete;
+		~mpmc_queue() {
+			std::size_t end = enqueue_pos.load(std::memory_order_acquire);
+			for (std::size_t i = dequeue_pos.load(std::memory_order_relaxed); i != end; i++) {
+				if (cells[i & mask].has_value)
+					cells[i & mask].d.value.~T();
+			}
+		}
+
+		// Constructs up to count items from first, and returns how many fit.
+		// If constructing an item throws, the items before it are pushed, and the rest of the claimed cells are skipped.
+		template<class InputIt>
+		std::size_t try_push_n(InputIt first, std::size_t count) {
+			std::size_t pos;
+			count = claim(enqueue_pos, 0, count, pos);
+			std::size_t i = 0;
+			try {
+				for (; i < count; i++, ++first)
+					publish(pos + i, [&](void* where) { ::new(where) T(*first); });
+			} catch (...) {
+				for (i++; i < count; i++)
+					publish_empty(pos + i);
+				pushed.notify();
+				throw;
+			}
+			if (count) pushed.notify();
+			return count;
+		}
+		template<class...Args>
+		bool try_emplace(Args&&...args) {
+			std::size_t pos;
+			if (claim(enqueue_pos, 0, 1, pos) == 0) return false;
+			publish(pos, [&](void* where) { ::new(where) T(std::forward<Args>(args)...); });
+			pushed.notify();
+			return true;
+		}
+		bool try_push(const T& value) { return try_emplace(value); }
+		bool try_push(T&& value) { return try_emplace(std::move(value)); }
+		template<class U>
+		void push(U&& value) {
+			if (try_push(std::forward<U>(value))) { [[likely]] return; }
+			popped.wait_until([&]() { return try_push(std::forward<U>(value)); });
+		}
+
+		// Moves up to count items to out, and returns how many there were.
+		// If moving an item throws, that item and the rest of the claimed items are destroyed.
+		template<class OutputIt>
+		std::size_t try_pop_n(OutputIt out, std::size_t count) {
+			std::size_t moved = 0;
+			for (;;) {
+				std::size_t pos;
+				std::size_t claimed = claim(dequeue_pos, 1, count - moved, pos);
+				if (claimed == 0) return moved;
+				std::size_t skipped = 0;
+				std::size_t i = 0;
+				try {
+					for (; i < claimed; i++) {
+						cell& c = cells[(pos + i) & mask];
+						if (c.has_value) { [[likely]]
+							*out = std::move(c.d.value);
+							++out;
+						} else
+							skipped++;
+						release(pos + i);
+					}
+				} catch (...) {
+					for (; i < claimed; i++)
+						release(pos + i);
+					popped.notify();
+					throw;
+				}
+				popped.notify();
+				moved += claimed - skipped;
+				// skipped cells don't count, so look for more items
+				if (skipped == 0 || moved == count) return moved;
+			}
+		}
+		bool try_pop(T& out) { return try_pop_n(&out, 1) == 1; }
+		T pop() {
+			for (;;) {
+				std::size_t pos;
+				if (claim(dequeue_pos, 1, 1, pos) == 0)
+					pushed.wait_until([&]() { return claim(dequeue_pos, 1, 1, pos) == 1; });
+				cell& c = cells[pos & mask];
+				if (!c.has_value) { [[unlikely]]
+					release(pos);
+					continue;
+				}
+				struct releaser {
+					mpmc_queue* queue;
+					std::size_t pos;
+					~releaser() {
+						queue->release(pos);
+						queue->popped.notify();
+					}
+				} release_after{this, pos};
+				return T(std::move(c.d.value));
+			}
+		}
+
+		std::size_t size_approx() const noexcept {
+			std::size_t end = enqueue_pos.load(std::memory_order_acquire);
+			std::size_t begin = dequeue_pos.load(std::memory_order_acquire);
+			return end > begin ? end - begin : 0;
+		}
+		bool empty_approx() const noexcept { return size_approx() == 0; }
+		static constexpr std::size_t capacity() noexcept { return capacity_; }
+	};
+}
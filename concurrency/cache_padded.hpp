@@ -0,0 +1,118 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <mutex>
+#include <utility>
+#include <vector>
+#include "memory/aligned_allocator.hpp"
+
+namespace mpd {
+	/**
+	* Holds a T alone in its own cache line(s), so that writes to neighbouring objects don't invalidate it (false sharing).
+	* ex:
+	* struct stats { mpd::cache_padded<std::atomic<long>> reads; mpd::cache_padded<std::atomic<long>> writes; };
+	**/
+	template<class T>
+	struct alignas(hardware_destructive_interference_size) cache_padded {
+		T value;
+
+		cache_padded() : value() {}
+		explicit cache_padded(const T& v) : value(v) {}
+		explicit cache_padded(T&& v) : value(std::move(v)) {}
+		template<class...Args>
+		explicit cache_padded(std::in_place_t, Args&&...args) : value(std::forward<Args>(args)...) {}
+
+		T& get() noexcept { return value; }
+		const T& get() const noexcept { return value; }
+		T& operator*() noexcept { return value; }
+		const T& operator*() const noexcept { return value; }
+		T* operator->() noexcept { return &value; }
+		const T* operator->() const noexcept { return &value; }
+	};
+
+	namespace impl {
+		// hands out the lowest unused index to each new thread, and takes it back when the thread exits.
+		class thread_index_registry {
+			std::mutex lock;
+			std::vector<unsigned> released;
+			unsigned next = 0;
+		public:
+			unsigned acquire() {
+				std::lock_guard<std::mutex> guard(lock);
+				if (released.empty()) return next++;
+				auto lowest = std::min_element(released.begin(), released.end());
+				unsigned index = *lowest;
+				released.erase(lowest);
+				return index;
+			}
+			void release(unsigned index) {
+				std::lock_guard<std::mutex> guard(lock);
+				released.push_back(index);
+			}
+		};
+		// never destroyed, since threads may exit during static destruction
+		inline thread_index_registry& thread_indexes() {
+			static thread_index_registry* registry = new thread_index_registry();
+			return *registry;
+		}
+		struct thread_index_holder {
+			unsigned index;
+			thread_index_holder() : index(thread_indexes().acquire()) {}
+			~thread_index_holder() { thread_indexes().release(index); }
+		};
+	}
+
+	// A small dense number for the calling thread. Numbers of exited threads are reused, so thread pools don't grow the numbers.
+	inline unsigned this_thread_index() {
+		static thread_local impl::thread_index_holder holder;
+		return holder.index;
+	}
+
+	/**
+	* A T for each thread, each in its own cache line, indexed by this_thread_index.
+	* Each thread updates its own slot without contention, and readers combine all of the slots.
+	*
+	* If more than slot_count threads use the object at the same time, then some threads share a slot, so T should either be
+	* atomic (relaxed increments on an uncontended line are nearly free), or slot_count must exceed the number of threads.
+	* Reading slots while other threads are writing them is only safe if T is atomic.
+	* ex:
+	* mpd::per_thread<std::atomic<long>> requests;
+	* requests.local().fetch_add(1, std::memory_order_relaxed);
+	* long total = requests.accumulate(0L, [](long sum, const std::atomic<long>& v) { return sum + v.load(std::memory_order_relaxed); });
+	**/
+	template<class T, std::size_t slot_count = 64>
+	class per_thread {
+		cache_padded<T> slots[slot_count];
+	public:
+		per_thread() = default;
+		explicit per_thread(const T& initial) {
+			for (cache_padded<T>& slot : slots)
+				slot.value = initial;
+		}
+		per_thread(const per_thread&) = delete;
+		per_thread& operator=(const per_thread&) = delete;
+
+		// the calling thread's slot
+		T& local() { return slots[this_thread_index() % slot_count].value; }
+		T& operator[](std::size_t slot) noexcept { return slots[slot].value; }
+		const T& operator[](std::size_t slot) const noexcept { return slots[slot].value; }
+		static constexpr std::size_t size() noexcept { return slot_count; }
+
+		template<class F>
+		void for_each(F&& f) {
+			for (cache_padded<T>& slot : slots)
+				f(slot.value);
+		}
+		template<class F>
+		void for_each(F&& f) const {
+			for (const cache_padded<T>& slot : slots)
+				f(slot.value);
+		}
+		template<class U, class F>
+		U accumulate(U init, F&& f) const {
+			for (const cache_padded<T>& slot : slots)
+				init = f(std::move(init), slot.value);
+			return init;
+		}
+	};
+}
@@ -0,0 +1,355 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <utility>
+#include "concurrency/cache_padded.hpp"
+#include "concurrency/reclamation.hpp"
+#include "concurrency/spin_lock.hpp"
+#include "utilities/macros.hpp"
+
+namespace mpd {
+	/**
+	* A hash map for many concurrent readers, such as a session table read from every core.
+	*
+	* Lookups take no locks and write nothing shared besides their own epoch_guard: they probe an open addressing table
+	* (linear probing) of pointers to immutable nodes. Writers for the same key are serialized by one of 64 striped
+	* locks, and claim slots with a compare-exchange, so writers of different keys rarely wait for each other.
+	* Updating a value replaces its node, and replaced and erased nodes are freed through the epoch_domain.
+	*
+	* When the table is 3/4 full, a bigger table is linked after it, and every write then moves a few slots across,
+	* so there's no stop-the-world rehash. Slots that have been moved are marked, and a lookup that doesn't find its
+	* key in a table goes on to the next one. Keys are hashed with Hash (std::hash, including for array_string), mixed with a multiplicative hash,
+	* so weak hashes of integers still spread over the table.
+	*
+	* Lookups return copies of values, or pass a reference to visit(), which is valid only during the call.
+	* ex:
+	* mpd::concurrent_hash_map<std::uint64_t, session_info> sessions;
+	* sessions.insert_or_assign(id, info); // writer
+	* if (std::optional<session_info> s = sessions.find(id)) handle(*s); // any number of readers
+	**/
+	template<class Key, class Value, class Hash = std::hash<Key>, class KeyEqual = std::equal_to<Key>>
+	class concurrent_hash_map {
+		struct node {
+			std::uint64_t hash;
+			Key key;
+			Value value;
+		};
+		struct table {
+			std::size_t capacity;
+			unsigned shift;
+			std::unique_ptr<std::atomic<node*>[]> slots;
+			std::atomic<table*> next{nullptr};
+			// slots that are not empty, including erased ones
+			std::atomic<std::size_t> used{0};
+			std::atomic<std::size_t> migrate_cursor{0};
+			std::atomic<std::size_t> migrated{0};
+
+			explicit table(std::size_t capacity_) : capacity(capacity_), shift(64), slots(new std::atomic<node*>[capacity_]) {
+				for (std::size_t c = capacity; c > 1; c /= 2)
+					--shift;
+				for (std::size_t i = 0; i < capacity; i++)
+					slots[i].store(nullptr, std::memory_order_relaxed);
+			}
+			std::size_t home(std::uint64_t hash) const noexcept { return static_cast<std::size_t>((hash * 0x9E3779B97F4A7C15ull) >> shift); }
+			std::size_t after(std::size_t i) const noexcept { return (i + 1) & (capacity - 1); }
+		};
+		// a node found by a writer, or where to put it
+		struct location {
+			table* t;
+			std::atomic<node*>* slot;
+			node* found;
+			std::atomic<node*>* free_slot;
+			node* free_value;
+		};
+
+		static const std::size_t stripe_count = 64;
+		static const std::size_t min_capacity = 16;
+		// slots moved to the next table by every write, while a resize is in progress
+		static const std::size_t migrate_chunk = 32;
+		static node* erased() noexcept { return reinterpret_cast<node*>(std::uintptr_t(1)); }
+		// A slot that was empty when it was moved, which ends a probe, like an empty slot.
+		static node* moved_empty() noexcept { return reinterpret_cast<node*>(std::uintptr_t(2)); }
+		// A slot that held a node, or was erased, when it was moved. Probes continue past it, since slots are moved in
+		// index order, and keys later in the same probe sequence may not have been moved yet.
+		static node* moved() noexcept { return reinterpret_cast<node*>(std::uintptr_t(3)); }
+		static bool is_moved(node* p) noexcept { return p == moved() || p == moved_empty(); }
+		static bool is_node(node* p) noexcept { return reinterpret_cast<std::uintptr_t>(p) > 3; }
+		static void delete_table(table* t) { delete t; }
+
+		Hash hasher;
+		KeyEqual key_equal;
+		epoch_domain* domain;
+		// lookups start from the oldest table that hasn't been fully moved, and writes go to the newest
+		alignas(hardware_destructive_interference_size) std::atomic<table*> oldest;
+		std::atomic<table*> newest;
+		alignas(hardware_destructive_interference_size) std::atomic<std::ptrdiff_t> count{0};
+		std::mutex resize_lock;
+		cache_padded<adaptive_mutex<>> stripes[stripe_count];
+
+		std::uint64_t hash_of(const Key& key) const { return static_cast<std::uint64_t>(hasher(key)); }
+		adaptive_mutex<>& stripe(std::uint64_t hash) noexcept { return stripes[(hash ^ (hash >> 32)) % stripe_count].value; }
+
+		const node* find_node(const Key& key, std::uint64_t hash) const {
+			table* t = oldest.load(std::memory_order_acquire);
+			while (t != nullptr) {
+				std::size_t i = t->home(hash);
+				for (std::size_t probes = 0; probes < t->capacity; probes++, i = t->after(i)) {
+					node* p = t->slots[i].load(std::memory_order_acquire);
+					if (p == nullptr || p == moved_empty()) break;
+					if (is_node(p) && p->hash == hash && key_equal(p->key, key)) return p;
+				}
+				// not in this table, but it may have been moved to, or inserted into, the next one
+				t = t->next.load(std::memory_order_acquire);
+			}
+			return nullptr;
+		}
+
+		// Puts a node that isn't in t into the first free slot. Must hold the node's stripe lock.
+		void place(table* t, node* p) {
+			std::size_t i = t->home(p->hash);
+			for (;;) {
+				node* current = t->slots[i].load(std::memory_order_acquire);
+				if (is_moved(current)) {
+					t = t->next.load(std::memory_order_acquire);
+					i = t->home(p->hash);
+				} else if (current == nullptr || current == erased()) {
+					if (t->slots[i].compare_exchange_strong(current, p, std::memory_order_acq_rel)) {
+						if (current == nullptr) t->used.fetch_add(1, std::memory_order_relaxed);
+						return;
+					}
+				} else
+					i = t->after(i);
+			}
+		}
+		// Must hold the stripe lock of p, which is in slot.
+		void move_node(table* t, std::atomic<node*>& slot, node* p) {
+			place(t->next.load(std::memory_order_acquire), p);
+			slot.store(moved(), std::memory_order_release);
+		}
+		void migrate_slot(table* t, std::atomic<node*>& slot) {
+			node* p = slot.load(std::memory_order_acquire);
+			while (!is_moved(p)) {
+				if (!is_node(p)) {
+					if (slot.compare_exchange_weak(p, p == nullptr ? moved_empty() : moved(), std::memory_order_acq_rel)) return;
+					continue;
+				}
+				std::lock_guard<adaptive_mutex<>> guard(stripe(p->hash));
+				if (slot.load(std::memory_order_acquire) == p) {
+					move_node(t, slot, p);
+					return;
+				}
+				p = slot.load(std::memory_order_acquire);
+			}
+		}
+		// Moves up to chunk slots of the oldest table to the next one. Must not hold any stripe lock.
+		void help_migrate(std::size_t chunk) {
+			table* t = oldest.load(std::memory_order_acquire);
+			if (t->next.load(std::memory_order_acquire) == nullptr) { [[likely]] return; }
+			std::size_t start = t->migrate_cursor.fetch_add(chunk, std::memory_order_relaxed);
+			if (start >= t->capacity) return;
+			std::size_t end = (std::min)(start + chunk, t->capacity);
+			for (std::size_t i = start; i < end; i++)
+				migrate_slot(t, t->slots[i]);
+			if (t->migrated.fetch_add(end - start, std::memory_order_acq_rel) + (end - start) == t->capacity) {
+				oldest.store(t->next.load(std::memory_order_relaxed), std::memory_order_release);
+				domain->retire(t, &delete_table);
+			}
+		}
+		// Links a bigger table after the newest one, if it's too full. Must not hold any stripe lock.
+		MPD_NOINLINE(void) resize(table* full) {
+			std::lock_guard<std::mutex> guard(resize_lock);
+			if (newest.load(std::memory_order_acquire) != full) return;
+			// only one resize at a time, so finish the last one first
+			while (oldest.load(std::memory_order_acquire) != full) {
+				help_migrate(migrate_chunk);
+				std::this_thread::yield();
+			}
+			std::size_t live = static_cast<std::size_t>((std::max)(count.load(std::memory_order_relaxed), std::ptrdiff_t(0)));
+			// if most of the used slots are erased, rehashing to the same size is enough
+			std::size_t capacity = live * 4 >= full->capacity ? full->capacity * 2 : full->capacity;
+			table* bigger = new table(capacity);
+			full->next.store(bigger, std::memory_order_release);
+			newest.store(bigger, std::memory_order_release);
+		}
+		void before_write() {
+			help_migrate(migrate_chunk);
+			table* t = newest.load(std::memory_order_acquire);
+			if (t->used.load(std::memory_order_relaxed) * 4 >= t->capacity * 3) { [[unlikely]] resize(t); }
+		}
+		// Finds key for a writer, moving it to the newest table first. Must hold the key's stripe lock.
+		location locate(const Key& key, std::uint64_t hash) {
+			table* t = oldest.load(std::memory_order_acquire);
+			for (;;) {
+				table* next = t->next.load(std::memory_order_acquire);
+				location loc = {t, nullptr, nullptr, nullptr, nullptr};
+				std::size_t i = t->home(hash);
+				bool hit_moved = false;
+				for (std::size_t probes = 0; probes < t->capacity; probes++, i = t->after(i)) {
+					node* p = t->slots[i].load(std::memory_order_acquire);
+					if (p == moved_empty()) {
+						hit_moved = true;
+						break;
+					}
+					if (p == moved()) {
+						hit_moved = true;
+						continue;
+					}
+					if (p == nullptr || p == erased()) {
+						if (loc.free_slot == nullptr) {
+							loc.free_slot = &t->slots[i];
+							loc.free_value = p;
+						}
+						if (p == nullptr) break;
+					} else if (p->hash == hash && key_equal(p->key, key)) {
+						if (next != nullptr) {
+							move_node(t, t->slots[i], p);
+							break;
+						}
+						loc.slot = &t->slots[i];
+						loc.found = p;
+						return loc;
+					}
+				}
+				// a resize may have started while probing, and moved slots past which the key could be
+				if (next == nullptr && !hit_moved) return loc;
+				t = t->next.load(std::memory_order_acquire);
+			}
+		}
+		// Puts a new node where locate found room. Returns false if the slot was taken meanwhile.
+		bool claim(const location& loc, node* p) {
+			node* expected = loc.free_value;
+			if (!loc.free_slot->compare_exchange_strong(expected, p, std::memory_order_acq_rel)) return false;
+			if (loc.free_value == nullptr) loc.t->used.fetch_add(1, std::memory_order_relaxed);
+			count.fetch_add(1, std::memory_order_relaxed);
+			return true;
+		}
+		// Calls f(location) with the key's stripe lock held, until it returns a result.
+		template<class F>
+		auto write(const Key& key, F&& f) {
+			std::uint64_t hash = hash_of(key);
+			epoch_guard guard(*domain);
+			for (;;) {
+				before_write();
+				std::unique_lock<adaptive_mutex<>> lock(stripe(hash));
+				location loc = locate(key, hash);
+				if (loc.found == nullptr && loc.free_slot == nullptr) { [[unlikely]]
+					// every slot is taken, so wait for the resize
+					lock.unlock();
+					resize(loc.t);
+					continue;
+				}
+				auto result = f(loc, hash);
+				if (result) return *result;
+			}
+		}
+	public:
+		using key_type = Key;
+		using mapped_type = Value;
+
+		explicit concurrent_hash_map(std::size_t initial_capacity = min_capacity, epoch_domain& domain_ = default_epoch_domain())
+			: domain(&domain_) {
+			std::size_t capacity = min_capacity;
+			while (capacity < initial_capacity)
+				capacity *= 2;
+			table* t = new table(capacity);
+			oldest.store(t, std::memory_order_relaxed);
+			newest.store(t, std::memory_order_relaxed);
+		}
+		concurrent_hash_map(const concurrent_hash_map&) = delete;
+		concurrent_hash_map& operator=(const concurrent_hash_map&) = delete;
+		// No other thread may be using the map.
+		~concurrent_hash_map() {
+			table* t = oldest.load(std::memory_order_acquire);
+			while (t != nullptr) {
+				for (std::size_t i = 0; i < t->capacity; i++) {
+					node* p = t->slots[i].load(std::memory_order_relaxed);
+					if (is_node(p)) delete p;
+				}
+				table* next = t->next.load(std::memory_order_relaxed);
+				delete t;
+				t = next;
+			}
+		}
+
+		std::optional<Value> find(const Key& key) const {
+			std::uint64_t hash = hash_of(key);
+			epoch_guard guard(*domain);
+			const node* p = find_node(key, hash);
+			if (p == nullptr) return std::nullopt;
+			return p->value;
+		}
+		bool contains(const Key& key) const {
+			std::uint64_t hash = hash_of(key);
+			epoch_guard guard(*domain);
+			return find_node(key, hash) != nullptr;
+		}
+		// Calls f(const Value&) if the key is present, without copying the value. Returns whether it was present.
+		template<class F>
+		bool visit(const Key& key, F&& f) const {
+			std::uint64_t hash = hash_of(key);
+			epoch_guard guard(*domain);
+			const node* p = find_node(key, hash);
+			if (p == nullptr) return false;
+			f(p->value);
+			return true;
+		}
+
+		// Returns false, and leaves the map unchanged, if the key was already present.
+		bool insert(const Key& key, const Value& value) {
+			return write(key, [&](const location& loc, std::uint64_t hash) -> std::optional<bool> {
+				if (loc.found != nullptr) return false;
+				std::unique_ptr<node> p(new node{hash, key, value});
+				if (!claim(loc, p.get())) return std::nullopt;
+				p.release();
+				return true;
+			});
+		}
+		// Returns true if the key was inserted, or false if an existing value was replaced.
+		bool insert_or_assign(const Key& key, const Value& value) {
+			return write(key, [&](const location& loc, std::uint64_t hash) -> std::optional<bool> {
+				std::unique_ptr<node> p(new node{hash, key, value});
+				if (loc.found != nullptr) {
+					loc.slot->store(p.release(), std::memory_order_release);
+					domain->retire(loc.found);
+					return false;
+				}
+				if (!claim(loc, p.get())) return std::nullopt;
+				p.release();
+				return true;
+			});
+		}
+		// Calls f(Value&) with a copy of the current value, and stores the result. Returns false if the key is absent.
+		template<class F>
+		bool update(const Key& key, F&& f) {
+			return write(key, [&](const location& loc, std::uint64_t hash) -> std::optional<bool> {
+				if (loc.found == nullptr) return false;
+				std::unique_ptr<node> p(new node{hash, key, loc.found->value});
+				f(p->value);
+				loc.slot->store(p.release(), std::memory_order_release);
+				domain->retire(loc.found);
+				return true;
+			});
+		}
+		bool erase(const Key& key) {
+			return write(key, [&](const location& loc, std::uint64_t) -> std::optional<bool> {
+				if (loc.found == nullptr) return false;
+				loc.slot->store(erased(), std::memory_order_release);
+				count.fetch_sub(1, std::memory_order_relaxed);
+				domain->retire(loc.found);
+				return true;
+			});
+		}
+
+		// Exact when no writes are in progress.
+		std::size_t size() const noexcept { return static_cast<std::size_t>((std::max)(count.load(std::memory_order_relaxed), std::ptrdiff_t(0))); }
+		bool empty() const noexcept { return size() == 0; }
+		// the capacity of the table that writes go to
+		std::size_t capacity() const noexcept { return newest.load(std::memory_order_acquire)->capacity; }
+	};
+}
@@ -0,0 +1,463 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "concurrency/cache_padded.hpp"
+
+namespace mpd {
+	namespace impl {
+		// A pointer waiting to be freed, and how to free it.
+		struct retired_ptr {
+			using erased_function = void(*)();
+			void* ptr;
+			void(*thunk)(void*, erased_function);
+			erased_function deleter;
+
+			template<class T>
+			static void delete_thunk(void* p, erased_function) { delete static_cast<T*>(p); }
+			template<class T>
+			static void deleter_thunk(void* p, erased_function f) { reinterpret_cast<void(*)(T*)>(f)(static_cast<T*>(p)); }
+			template<class T>
+			static retired_ptr make(T* p) noexcept { return {p, &delete_thunk<T>, nullptr}; }
+			template<class T>
+			static retired_ptr make(T* p, void(*deleter)(T*)) noexcept { return {p, &deleter_thunk<T>, reinterpret_cast<erased_function>(deleter)}; }
+			void reclaim() const { thunk(ptr, deleter); }
+		};
+
+		// Registry of live reclamation domains, so that exiting threads don't hand their records back to a dead domain.
+		struct reclamation_domains {
+			std::mutex lock;
+			std::vector<std::uint64_t> live;
+			std::uint64_t next_id = 1;
+		};
+		// never destroyed, since threads may exit during static destruction
+		inline reclamation_domains& live_reclamation_domains() {
+			static reclamation_domains* domains = new reclamation_domains();
+			return *domains;
+		}
+
+		/**
+		* The per-thread records of a domain. A thread claims a record on its first use of the domain, and releases it
+		* when the thread exits, for a later thread to reuse. Records are only freed with the domain.
+		**/
+		template<class Domain, class Record>
+		class thread_records {
+			std::atomic<Record*> head{nullptr};
+			std::atomic<std::size_t> record_count{0};
+			std::uint64_t id;
+
+			struct thread_cache {
+				struct entry { std::uint64_t id; Domain* domain; Record* record; };
+				std::vector<entry> entries;
+				~thread_cache() {
+					reclamation_domains& domains = live_reclamation_domains();
+					std::lock_guard<std::mutex> guard(domains.lock);
+					for (entry& e : entries)
+						if (std::find(domains.live.begin(), domains.live.end(), e.id) != domains.live.end())
+							e.domain->release_record(*e.record);
+				}
+			};
+			static thread_cache& this_thread_cache() {
+				static thread_local thread_cache cache;
+				return cache;
+			}
+		public:
+			thread_records() {
+				reclamation_domains& domains = live_reclamation_domains();
+				std::lock_guard<std::mutex> guard(domains.lock);
+				id = domains.next_id++;
+				domains.live.push_back(id);
+			}
+			thread_records(const thread_records&) = delete;
+			thread_records& operator=(const thread_records&) = delete;
+			~thread_records() {
+				{
+					reclamation_domains& domains = live_reclamation_domains();
+					std::lock_guard<std::mutex> guard(domains.lock);
+					domains.live.erase(std::find(domains.live.begin(), domains.live.end(), id));
+				}
+				Record* r = head.load(std::memory_order_acquire);
+				while (r) {
+					Record* next = r->next_record;
+					delete r;
+					r = next;
+				}
+			}
+
+			Record& local(Domain& domain) {
+				static thread_local std::uint64_t last_id = 0;
+				static thread_local Record* last_record = nullptr;
+				if (last_id == id) { [[likely]] return *last_record; }
+				thread_cache& cache = this_thread_cache();
+				for (typename thread_cache::entry& e : cache.entries) {
+					if (e.id == id) {
+						last_id = id;
+						last_record = e.record;
+						return *e.record;
+					}
+				}
+				Record* record = acquire();
+				cache.entries.push_back({id, &domain, record});
+				last_id = id;
+				last_record = record;
+				return *record;
+			}
+			Record* acquire() {
+				for (Record* r = head.load(std::memory_order_acquire); r != nullptr; r = r->next_record) {
+					bool expected = false;
+					if (!r->in_use.load(std::memory_order_relaxed) && r->in_use.compare_exchange_strong(expected, true, std::memory_order_acquire))
+						return r;
+				}
+				Record* r = new Record();
+				r->in_use.store(true, std::memory_order_relaxed);
+				record_count.fetch_add(1, std::memory_order_relaxed);
+				Record* old_head = head.load(std::memory_order_relaxed);
+				do {
+					r->next_record = old_head;
+				} while (!head.compare_exchange_weak(old_head, r, std::memory_order_release, std::memory_order_relaxed));
+				return r;
+			}
+			// the most threads that have used the domain at once
+			std::size_t size() const noexcept { return record_count.load(std::memory_order_relaxed); }
+			template<class F>
+			void for_each(F&& f) const {
+				for (Record* r = head.load(std::memory_order_acquire); r != nullptr; r = r->next_record)
+					f(*r);
+			}
+		};
+	}
+
+	/**
+	* Epoch based reclamation: a pointer that was unlinked from a lock-free structure is retired, rather than freed,
+	* and it's freed once every thread that could have been reading it has left its epoch_guard.
+	*
+	* Readers pay only a store and a fence to enter a guard, and nothing per pointer they read, unlike reference counting.
+	* Each thread keeps its retired pointers in three limbo lists, one per recent epoch. The global epoch advances once
+	* every thread inside a guard has seen the current epoch, and the limbo list from two epochs ago is then freed.
+	* A thread stuck inside a guard blocks all reclamation, so keep guards short. Worker loops should call quiescent()
+	* between tasks, which helps advance the epoch and frees the thread's old limbo lists.
+	* ex:
+	* mpd::epoch_domain& domain = mpd::default_epoch_domain();
+	* { // reader
+	*	mpd::epoch_guard guard(domain);
+	*	node* n = head.load(std::memory_order_acquire); // n can't be freed until the guard ends
+	* }
+	* { // writer
+	*	mpd::epoch_guard guard(domain);
+	*	node* old = head.exchange(replacement);
+	*	domain.retire(old);
+	* }
+	**/
+	class epoch_domain {
+		struct record {
+			record* next_record = nullptr;
+			std::atomic<bool> in_use{false};
+			// (epoch << 1) | active
+			cache_padded<std::atomic<std::uint64_t>> state;
+			unsigned nesting = 0;
+			unsigned retires_since_advance = 0;
+			std::vector<impl::retired_ptr> limbo[3];
+			std::uint64_t limbo_epoch[3] = {0, 0, 0};
+		};
+		friend class impl::thread_records<epoch_domain, record>;
+		friend class epoch_guard;
+
+		static const unsigned advance_interval = 64;
+		alignas(hardware_destructive_interference_size) std::atomic<std::uint64_t> global_epoch{2};
+		// what exited threads retired, tagged with the epoch it was retired in
+		std::mutex orphan_lock;
+		std::vector<std::pair<std::uint64_t, impl::retired_ptr>> orphans;
+		std::atomic<bool> has_orphans{false};
+		impl::thread_records<epoch_domain, record> records;
+
+		static void reclaim_list(std::vector<impl::retired_ptr>& list) {
+			std::vector<impl::retired_ptr> doomed;
+			doomed.swap(list); // deleters may retire more pointers
+			for (const impl::retired_ptr& r : doomed)
+				r.reclaim();
+		}
+		void reclaim_local(record& r, std::uint64_t epoch) {
+			for (unsigned i = 0; i < 3; i++) {
+				if (!r.limbo[i].empty() && r.limbo_epoch[i] + 2 <= epoch)
+					reclaim_list(r.limbo[i]);
+			}
+			if (has_orphans.load(std::memory_order_relaxed) && orphan_lock.try_lock()) {
+				std::vector<std::pair<std::uint64_t, impl::retired_ptr>> doomed;
+				{
+					std::lock_guard<std::mutex> guard(orphan_lock, std::adopt_lock);
+					auto safe = std::partition(orphans.begin(), orphans.end(), [&](const std::pair<std::uint64_t, impl::retired_ptr>& o) { return o.first + 2 > epoch; });
+					doomed.assign(safe, orphans.end());
+					orphans.erase(safe, orphans.end());
+					has_orphans.store(!orphans.empty(), std::memory_order_relaxed);
+				}
+				// outside the lock, since deleters may retire more pointers
+				for (const std::pair<std::uint64_t, impl::retired_ptr>& o : doomed)
+					o.second.reclaim();
+			}
+		}
+		void release_record(record& r) {
+			assert(r.nesting == 0);
+			{
+				std::lock_guard<std::mutex> guard(orphan_lock);
+				for (unsigned i = 0; i < 3; i++) {
+					for (const impl::retired_ptr& p : r.limbo[i])
+						orphans.emplace_back(r.limbo_epoch[i], p);
+					r.limbo[i].clear();
+				}
+				has_orphans.store(!orphans.empty(), std::memory_order_relaxed);
+			}
+			r.in_use.store(false, std::memory_order_release);
+		}
+		void enter(record& r) noexcept {
+			if (r.nesting++ == 0) {
+				r.state->store((global_epoch.load(std::memory_order_relaxed) << 1) | 1, std::memory_order_relaxed);
+				// the announcement must be visible before any loads of protected pointers
+				std::atomic_thread_fence(std::memory_order_seq_cst);
+			}
+		}
+		void exit(record& r) noexcept {
+			assert(r.nesting > 0);
+			if (--r.nesting == 0)
+				r.state->store(r.state->load(std::memory_order_relaxed) & ~std::uint64_t(1), std::memory_order_release);
+		}
+	public:
+		epoch_domain() = default;
+		epoch_domain(const epoch_domain&) = delete;
+		epoch_domain& operator=(const epoch_domain&) = delete;
+		// Frees everything that is still retired. No thread may be inside a guard.
+		~epoch_domain() {
+			records.for_each([&](record& r) {
+				assert(r.nesting == 0);
+				for (std::vector<impl::retired_ptr>& list : r.limbo)
+					reclaim_list(list);
+			});
+			for (const std::pair<std::uint64_t, impl::retired_ptr>& o : orphans)
+				o.second.reclaim();
+		}
+
+		// Advances the global epoch, if every thread inside a guard has seen the current one. Returns the new epoch.
+		std::uint64_t try_advance() noexcept {
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			std::uint64_t epoch = global_epoch.load(std::memory_order_seq_cst);
+			bool all_current = true;
+			records.for_each([&](record& r) {
+				std::uint64_t s = r.state->load(std::memory_order_acquire);
+				if ((s & 1) && (s >> 1) != epoch) all_current = false;
+			});
+			if (all_current && global_epoch.compare_exchange_strong(epoch, epoch + 1, std::memory_order_acq_rel))
+				return epoch + 1;
+			return epoch;
+		}
+		std::uint64_t epoch() const noexcept { return global_epoch.load(std::memory_order_acquire); }
+
+		// Frees ptr with delete (or deleter), once no thread can still be reading it.
+		template<class T>
+		void retire(T* ptr) { retire(impl::retired_ptr::make(ptr)); }
+		template<class T>
+		void retire(T* ptr, void(*deleter)(T*)) { retire(impl::retired_ptr::make(ptr, deleter)); }
+		void retire(impl::retired_ptr p) {
+			record& r = records.local(*this);
+			std::uint64_t epoch = global_epoch.load(std::memory_order_acquire);
+			unsigned slot = static_cast<unsigned>(epoch % 3);
+			if (r.limbo_epoch[slot] != epoch) {
+				// this slot holds pointers from three or more epochs ago, which are certainly safe
+				reclaim_list(r.limbo[slot]);
+				r.limbo_epoch[slot] = epoch;
+			}
+			r.limbo[slot].push_back(p);
+			if (++r.retires_since_advance >= advance_interval) {
+				r.retires_since_advance = 0;
+				if (r.nesting == 0) reclaim_local(r, try_advance());
+				else try_advance();
+			}
+		}
+
+		// Call from a thread that isn't inside a guard, such as between tasks of a worker loop. Helps to advance
+		// the epoch, and frees what this thread retired, if it's safe.
+		void quiescent() {
+			record& r = records.local(*this);
+			assert(r.nesting == 0);
+			reclaim_local(r, try_advance());
+		}
+		// Keeps advancing the epoch until everything this thread retired is freed.
+		// Blocks while any other thread is inside a guard.
+		void drain() {
+			record& r = records.local(*this);
+			assert(r.nesting == 0);
+			std::uint64_t target = global_epoch.load(std::memory_order_acquire) + 2;
+			while (try_advance() < target) {}
+			reclaim_local(r, target);
+		}
+	};
+
+	// While alive, pointers loaded from structures in the domain won't be freed. Guards may nest.
+	class epoch_guard {
+		epoch_domain* domain;
+		epoch_domain::record* r;
+	public:
+		explicit epoch_guard(epoch_domain& domain_) : domain(&domain_), r(&domain_.records.local(domain_)) { domain->enter(*r); }
+		epoch_guard(const epoch_guard&) = delete;
+		epoch_guard& operator=(const epoch_guard&) = delete;
+		~epoch_guard() { domain->exit(*r); }
+	};
+
+	inline epoch_domain& default_epoch_domain() {
+		static epoch_domain domain;
+		return domain;
+	}
+
+	template<unsigned slots_per_thread>
+	class hazard_pointer_of;
+
+	/**
+	* Hazard pointer reclamation: a reader publishes each pointer it's about to use in one of its hazard slots, and a
+	* retired pointer is only freed when no slot holds it. Costs a store and a fence per pointer read, unlike
+	* epoch_domain, but a stalled reader only keeps the few pointers it protects from being freed, rather than
+	* blocking all reclamation. retire() scans the slots once a thread has enough retired pointers.
+	* ex:
+	* mpd::hazard_pointer hp(domain);
+	* node* n = hp.protect(head); // n can't be freed until hp is reset or destroyed
+	**/
+	template<unsigned slots_per_thread = 4>
+	class hazard_domain {
+		struct record {
+			record* next_record = nullptr;
+			std::atomic<bool> in_use{false};
+			cache_padded<std::atomic<void*>> hazards[slots_per_thread];
+			unsigned used_slots = 0;
+			std::vector<impl::retired_ptr> retired;
+		};
+		friend class impl::thread_records<hazard_domain, record>;
+		template<unsigned> friend class hazard_pointer_of;
+
+		// what exited threads retired
+		std::mutex orphan_lock;
+		std::vector<impl::retired_ptr> orphans;
+		std::atomic<bool> has_orphans{false};
+		impl::thread_records<hazard_domain, record> records;
+
+		void scan(std::vector<impl::retired_ptr>& list) {
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			std::vector<void*> hazards;
+			records.for_each([&](record& r) {
+				for (cache_padded<std::atomic<void*>>& h : r.hazards) {
+					void* p = h->load(std::memory_order_acquire);
+					if (p) hazards.push_back(p);
+				}
+			});
+			std::sort(hazards.begin(), hazards.end());
+			auto safe = std::partition(list.begin(), list.end(), [&](const impl::retired_ptr& p) {
+				return std::binary_search(hazards.begin(), hazards.end(), p.ptr);
+			});
+			std::vector<impl::retired_ptr> doomed(safe, list.end());
+			list.erase(safe, list.end());
+			for (const impl::retired_ptr& p : doomed)
+				p.reclaim();
+		}
+		void scan_all(record& r) {
+			scan(r.retired);
+			if (has_orphans.load(std::memory_order_relaxed) && orphan_lock.try_lock()) {
+				std::vector<impl::retired_ptr> adopted;
+				{
+					std::lock_guard<std::mutex> guard(orphan_lock, std::adopt_lock);
+					adopted.swap(orphans);
+					has_orphans.store(false, std::memory_order_relaxed);
+				}
+				// outside the lock, since deleters may retire more pointers
+				scan(adopted);
+				r.retired.insert(r.retired.end(), adopted.begin(), adopted.end());
+			}
+		}
+		std::size_t scan_threshold() const noexcept {
+			return (std::max)(std::size_t(64), 2 * slots_per_thread * records.size());
+		}
+		record& local() {
+			return records.local(*this);
+		}
+		void release_record(record& r) {
+			assert(r.used_slots == 0);
+			{
+				std::lock_guard<std::mutex> guard(orphan_lock);
+				orphans.insert(orphans.end(), r.retired.begin(), r.retired.end());
+				r.retired.clear();
+				has_orphans.store(!orphans.empty(), std::memory_order_relaxed);
+			}
+			r.in_use.store(false, std::memory_order_release);
+		}
+	public:
+		hazard_domain() = default;
+		hazard_domain(const hazard_domain&) = delete;
+		hazard_domain& operator=(const hazard_domain&) = delete;
+		// Frees everything that is still retired. No thread may be holding a hazard pointer.
+		~hazard_domain() {
+			records.for_each([&](record& r) {
+				for (const impl::retired_ptr& p : r.retired)
+					p.reclaim();
+			});
+			for (const impl::retired_ptr& p : orphans)
+				p.reclaim();
+		}
+
+		template<class T>
+		void retire(T* ptr) { retire(impl::retired_ptr::make(ptr)); }
+		template<class T>
+		void retire(T* ptr, void(*deleter)(T*)) { retire(impl::retired_ptr::make(ptr, deleter)); }
+		void retire(impl::retired_ptr p) {
+			record& r = local();
+			r.retired.push_back(p);
+			if (r.retired.size() >= scan_threshold())
+				scan_all(r);
+		}
+		// Frees whatever this thread retired that isn't protected. Call between tasks of a worker loop.
+		void quiescent() { scan_all(local()); }
+		// the number of pointers this thread has retired, that haven't been freed yet
+		std::size_t retired_count() { return local().retired.size(); }
+	};
+
+	/**
+	* One hazard slot of the calling thread. protect() loads a pointer from an atomic, and publishes it in the slot,
+	* so that it won't be freed until the slot is reset, reused or destroyed.
+	* Only usable by the thread that created it.
+	**/
+	template<unsigned slots_per_thread = 4>
+	class hazard_pointer_of {
+		using domain_type = hazard_domain<slots_per_thread>;
+		typename domain_type::record* r;
+		std::atomic<void*>* slot;
+	public:
+		explicit hazard_pointer_of(domain_type& domain) : r(&domain.local()) {
+			assert(r->used_slots < slots_per_thread && "too many hazard pointers on this thread");
+			slot = &r->hazards[r->used_slots++].value;
+		}
+		hazard_pointer_of(const hazard_pointer_of&) = delete;
+		hazard_pointer_of& operator=(const hazard_pointer_of&) = delete;
+		// hazard pointers must be destroyed in the reverse order of creation
+		~hazard_pointer_of() {
+			slot->store(nullptr, std::memory_order_release);
+			--r->used_slots;
+			assert(slot == &r->hazards[r->used_slots].value);
+		}
+
+		template<class T>
+		T* protect(const std::atomic<T*>& source) noexcept {
+			T* p = source.load(std::memory_order_relaxed);
+			for (;;) {
+				slot->store(p, std::memory_order_seq_cst);
+				T* again = source.load(std::memory_order_acquire);
+				if (again == p) return p;
+				p = again;
+			}
+		}
+		// publishes a pointer that the caller knows is still reachable
+		template<class T>
+		void set(T* p) noexcept { slot->store(p, std::memory_order_seq_cst); }
+		void reset() noexcept { slot->store(nullptr, std::memory_order_release); }
+	};
+	using hazard_pointer = hazard_pointer_of<>;
+}
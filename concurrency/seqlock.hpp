@@ -0,0 +1,115 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include "concurrency/atomic_spin.hpp"
+#include "concurrency/cache_padded.hpp"
+
+namespace mpd {
+	/**
+	* A T that many threads read, and a few threads occasionally write, where readers never write to shared memory.
+	*
+	* Writers make the sequence number odd, write the value, and then make it even again. Readers copy the value
+	* optimistically, and retry if the sequence number was odd or changed while they were copying. So reads cost a copy
+	* of T plus two loads of the sequence, and any number of readers scale perfectly, but a reader can be delayed while
+	* writes are ongoing. Writers exclude each other by claiming the odd sequence number with a compare-exchange.
+	*
+	* T must be trivially copyable. It's stored as relaxed atomic words, so that a torn read is merely discarded,
+	* rather than a data race.
+	* ex:
+	* mpd::seqlock<routing_table> routes;
+	* routing_table current = routes.load(); // every request, on every core
+	* routes.update([&](routing_table& t) { t.add(entry); }); // a few times a minute
+	**/
+	template<class T>
+	class alignas(hardware_destructive_interference_size) seqlock {
+		static_assert(std::is_trivially_copyable_v<T>, "seqlock<T> requires a trivially copyable T");
+		using word = std::uintptr_t;
+		static const std::size_t word_count = (sizeof(T) + sizeof(word) - 1) / sizeof(word);
+
+		std::atomic<std::uint32_t> sequence{0};
+		std::atomic<word> words[word_count];
+
+		void read_words(word* out) const noexcept {
+			for (std::size_t i = 0; i < word_count; i++)
+				out[i] = words[i].load(std::memory_order_relaxed);
+		}
+		void write_words(const word* in) noexcept {
+			for (std::size_t i = 0; i < word_count; i++)
+				words[i].store(in[i], std::memory_order_relaxed);
+		}
+		std::uint32_t begin_write() noexcept {
+			pause_backoff backoff;
+			std::uint32_t seq = sequence.load(std::memory_order_relaxed);
+			for (;;) {
+				// acquire, so that this writer sees the previous writer's words, and its stores can't be reordered before them
+				if (seq % 2 == 0 && sequence.compare_exchange_weak(seq, seq + 1, std::memory_order_acquire, std::memory_order_relaxed)) { [[likely]] break; }
+				backoff();
+				seq = sequence.load(std::memory_order_relaxed);
+			}
+			// the odd sequence must be visible before any of the new words are
+			std::atomic_thread_fence(std::memory_order_release);
+			return seq + 1;
+		}
+		void end_write(std::uint32_t odd_seq) noexcept {
+			sequence.store(odd_seq + 1, std::memory_order_release);
+		}
+	public:
+		seqlock() noexcept(std::is_nothrow_default_constructible_v<T>) : seqlock(T()) {}
+		explicit seqlock(const T& initial) noexcept {
+			word buffer[word_count] = {};
+			std::memcpy(buffer, &initial, sizeof(T));
+			write_words(buffer);
+		}
+		seqlock(const seqlock&) = delete;
+		seqlock& operator=(const seqlock&) = delete;
+
+		// One attempt at a consistent read. Returns false if a write was in progress, and leaves out unchanged.
+		bool try_load(T& out) const noexcept {
+			word buffer[word_count];
+			std::uint32_t before = sequence.load(std::memory_order_acquire);
+			if (before % 2 != 0) { [[unlikely]] return false; }
+			read_words(buffer);
+			// the words must be read before the sequence is re-checked
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (sequence.load(std::memory_order_relaxed) != before) { [[unlikely]] return false; }
+			std::memcpy(&out, buffer, sizeof(T));
+			return true;
+		}
+		T load() const noexcept {
+			T result;
+			while (!try_load(result))
+				cpu_relax();
+			return result;
+		}
+		void store(const T& value) noexcept {
+			word buffer[word_count] = {};
+			std::memcpy(buffer, &value, sizeof(T));
+			std::uint32_t seq = begin_write();
+			write_words(buffer);
+			end_write(seq);
+		}
+		// Calls mutation with a copy of the current value, and stores the result, while excluding other writers.
+		// Readers are delayed until it returns, so keep it short.
+		template<class F>
+		void update(F&& mutation) {
+			word buffer[word_count];
+			std::uint32_t seq = begin_write();
+			read_words(buffer);
+			T value;
+			std::memcpy(&value, buffer, sizeof(T));
+			try {
+				mutation(value);
+			} catch (...) {
+				end_write(seq);
+				throw;
+			}
+			std::memcpy(buffer, &value, sizeof(T));
+			write_words(buffer);
+			end_write(seq);
+		}
+		// Even when no write is in progress. Changes after every write.
+		std::uint32_t version() const noexcept { return sequence.load(std::memory_order_acquire); }
+	};
+}
@@ -0,0 +1,162 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include "concurrency/cache_padded.hpp"
+#include "numerics/bit.hpp"
+#if defined(__linux__) && defined(__GLIBC__)
+#include <sched.h>
+#elif defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#endif
+
+namespace mpd {
+	namespace impl {
+		// The CPU the thread is running on, or if that's unknown, this_thread_index().
+		// glibc 2.35+ reads the CPU from the thread's rseq area, so it costs about as much as a load.
+		inline unsigned this_cpu_shard() noexcept {
+#if defined(__linux__) && defined(__GLIBC__)
+			int cpu = sched_getcpu();
+			if (cpu >= 0) { [[likely]] return static_cast<unsigned>(cpu); }
+			return this_thread_index();
+#elif defined(_WIN32)
+			return static_cast<unsigned>(GetCurrentProcessorNumber());
+#else
+			return this_thread_index();
+#endif
+		}
+	}
+
+	/**
+	* A counter for very frequent increments from many threads, such as request counts. Each CPU adds to its own
+	* cache line, so increments never move a line between cores, and reading the total scans every shard.
+	* Increments are still a relaxed atomic add, since a thread can migrate or be preempted between looking up its CPU
+	* and adding, but that add is to a line that's almost always already in the core's cache.
+	* Also works as a gauge, with sub(), since the total may go down.
+	* ex:
+	* static mpd::sharded_counter requests;
+	* requests.add(); // every request
+	* report(requests.load()); // every few seconds
+	**/
+	template<std::size_t shard_count = 64>
+	class sharded_counter {
+		cache_padded<std::atomic<std::int64_t>> shards[shard_count];
+
+		std::atomic<std::int64_t>& local() noexcept { return shards[impl::this_cpu_shard() % shard_count].value; }
+	public:
+		sharded_counter() noexcept {
+			for (cache_padded<std::atomic<std::int64_t>>& shard : shards)
+				shard->store(0, std::memory_order_relaxed);
+		}
+		sharded_counter(const sharded_counter&) = delete;
+		sharded_counter& operator=(const sharded_counter&) = delete;
+
+		void add(std::int64_t n = 1) noexcept { local().fetch_add(n, std::memory_order_relaxed); }
+		void sub(std::int64_t n = 1) noexcept { local().fetch_sub(n, std::memory_order_relaxed); }
+		sharded_counter& operator++() noexcept { add(); return *this; }
+		sharded_counter& operator--() noexcept { sub(); return *this; }
+		sharded_counter& operator+=(std::int64_t n) noexcept { add(n); return *this; }
+		sharded_counter& operator-=(std::int64_t n) noexcept { sub(n); return *this; }
+
+		// The sum of all shards. Concurrent adds may or may not be included.
+		std::int64_t load() const noexcept {
+			std::int64_t total = 0;
+			for (const cache_padded<std::atomic<std::int64_t>>& shard : shards)
+				total += shard->load(std::memory_order_relaxed);
+			return total;
+		}
+		operator std::int64_t() const noexcept { return load(); }
+		// Zeroes the counter, and returns what it held. No concurrent add is lost: each is either returned or kept.
+		std::int64_t reset() noexcept {
+			std::int64_t total = 0;
+			for (cache_padded<std::atomic<std::int64_t>>& shard : shards)
+				total += shard->exchange(0, std::memory_order_relaxed);
+			return total;
+		}
+	};
+
+	// A copy of a sharded_histogram's counts. Bucket 0 holds 0, and bucket i holds values in [2^(i-1), 2^i).
+	struct histogram_snapshot {
+		static const std::size_t bucket_count = 65;
+		std::uint64_t count = 0;
+		std::uint64_t sum = 0;
+		std::array<std::uint64_t, bucket_count> buckets = {};
+
+		static std::uint64_t bucket_upper_bound(std::size_t bucket) noexcept {
+			return bucket == 0 ? 0 : bucket >= 64 ? UINT64_MAX : (std::uint64_t(1) << bucket) - 1;
+		}
+		double mean() const noexcept { return count ? static_cast<double>(sum) / static_cast<double>(count) : 0.0; }
+		// An upper bound on the q quantile (0 to 1), such as 0.99 for the 99th percentile: the top of its bucket.
+		std::uint64_t percentile(double q) const noexcept {
+			if (count == 0) return 0;
+			std::uint64_t rank = static_cast<std::uint64_t>(q * static_cast<double>(count - 1)) + 1;
+			std::uint64_t seen = 0;
+			for (std::size_t i = 0; i < bucket_count; i++) {
+				seen += buckets[i];
+				if (seen >= rank) return bucket_upper_bound(i);
+			}
+			return UINT64_MAX;
+		}
+	};
+
+	/**
+	* A histogram of values such as latencies, with power of two buckets, recorded into per-CPU shards like
+	* sharded_counter, so that recording from every core doesn't contend. snapshot() sums the shards.
+	* ex:
+	* static mpd::sharded_histogram latency_us;
+	* latency_us.record(elapsed_us);
+	* std::uint64_t p99 = latency_us.snapshot().percentile(0.99);
+	**/
+	template<std::size_t shard_count = 32>
+	class sharded_histogram {
+		struct alignas(hardware_destructive_interference_size) shard {
+			std::atomic<std::uint64_t> buckets[histogram_snapshot::bucket_count];
+			std::atomic<std::uint64_t> sum;
+		};
+		shard shards[shard_count];
+	public:
+		sharded_histogram() noexcept {
+			for (shard& s : shards) {
+				for (std::atomic<std::uint64_t>& bucket : s.buckets)
+					bucket.store(0, std::memory_order_relaxed);
+				s.sum.store(0, std::memory_order_relaxed);
+			}
+		}
+		sharded_histogram(const sharded_histogram&) = delete;
+		sharded_histogram& operator=(const sharded_histogram&) = delete;
+
+		void record(std::uint64_t value) noexcept {
+			shard& s = shards[impl::this_cpu_shard() % shard_count];
+			s.buckets[bit_width(value)].fetch_add(1, std::memory_order_relaxed);
+			s.sum.fetch_add(value, std::memory_order_relaxed);
+		}
+		// Concurrent records may be partly included: counted in a bucket but not yet in the sum.
+		histogram_snapshot snapshot() const noexcept {
+			histogram_snapshot result;
+			for (const shard& s : shards) {
+				for (std::size_t i = 0; i < histogram_snapshot::bucket_count; i++)
+					result.buckets[i] += s.buckets[i].load(std::memory_order_relaxed);
+				result.sum += s.sum.load(std::memory_order_relaxed);
+			}
+			for (std::uint64_t bucket : result.buckets)
+				result.count += bucket;
+			return result;
+		}
+		// Zeroes the histogram, and returns what it held.
+		histogram_snapshot reset() noexcept {
+			histogram_snapshot result;
+			for (shard& s : shards) {
+				for (std::size_t i = 0; i < histogram_snapshot::bucket_count; i++)
+					result.buckets[i] += s.buckets[i].exchange(0, std::memory_order_relaxed);
+				result.sum += s.sum.exchange(0, std::memory_order_relaxed);
+			}
+			for (std::uint64_t bucket : result.buckets)
+				result.count += bucket;
+			return result;
+		}
+	};
+}
@@ -0,0 +1,219 @@
+#pragma once
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "concurrency/atomic_spin.hpp"
+#include "concurrency/atomic_wait.hpp"
+#include "concurrency/cache_padded.hpp"
+#include "utilities/macros.hpp"
+
+// All of the locks here satisfy Lockable, so they work with std::lock_guard, std::unique_lock, std::scoped_lock, etc.
+namespace mpd {
+	/**
+	* A test-and-test-and-set spinlock. Waiters spin on a plain load, which stays in their own cache,
+	* and only attempt the exchange once the lock looks free, backing off according to Backoff.
+	* Best for very short critical sections with few threads. Not fair.
+	**/
+	template<class Backoff = exponential_backoff<>>
+	class ttas_spinlock {
+		std::atomic<bool> locked{false};
+	public:
+		ttas_spinlock() noexcept = default;
+		ttas_spinlock(const ttas_spinlock&) = delete;
+		ttas_spinlock& operator=(const ttas_spinlock&) = delete;
+
+		void lock() noexcept {
+			Backoff backoff;
+			for (;;) {
+				if (!locked.exchange(true, std::memory_order_acquire)) { [[likely]] return; }
+				while (locked.load(std::memory_order_relaxed))
+					backoff();
+			}
+		}
+		bool try_lock() noexcept {
+			return !locked.load(std::memory_order_relaxed) && !locked.exchange(true, std::memory_order_acquire);
+		}
+		void unlock() noexcept { locked.store(false, std::memory_order_release); }
+	};
+
+	/**
+	* A fair spinlock: threads take a ticket, and are served in the order that they arrived.
+	* Waiters back off in proportion to the number of threads ahead of them.
+	**/
+	class ticket_lock {
+		std::atomic<std::uint32_t> next_ticket{0};
+		// on its own line, so that taking tickets doesn't disturb the waiters polling it
+		cache_padded<std::atomic<std::uint32_t>> now_serving;
+	public:
+		ticket_lock() noexcept = default;
+		ticket_lock(const ticket_lock&) = delete;
+		ticket_lock& operator=(const ticket_lock&) = delete;
+
+		void lock() noexcept {
+			std::uint32_t ticket = next_ticket.fetch_add(1, std::memory_order_relaxed);
+			for (;;) {
+				std::uint32_t serving = now_serving->load(std::memory_order_acquire);
+				if (serving == ticket) { [[likely]] return; }
+				for (std::uint32_t i = (ticket - serving) * 8; i > 0; i--)
+					cpu_relax();
+			}
+		}
+		bool try_lock() noexcept {
+			std::uint32_t serving = now_serving->load(std::memory_order_acquire);
+			std::uint32_t expected = serving;
+			return next_ticket.compare_exchange_strong(expected, serving + 1, std::memory_order_acquire, std::memory_order_relaxed);
+		}
+		void unlock() noexcept {
+			now_serving->store(now_serving->load(std::memory_order_relaxed) + 1, std::memory_order_release);
+		}
+	};
+
+	// A waiter's place in an mcs_lock queue.
+	struct alignas(hardware_destructive_interference_size) mcs_node {
+		std::atomic<mcs_node*> next{nullptr};
+		std::atomic<bool> waiting{false};
+	};
+
+	namespace impl {
+		// the mcs_nodes for a thread's lock() calls without an explicit node. Nodes are only freed when the thread exits.
+		class mcs_node_cache {
+			std::vector<std::unique_ptr<mcs_node>> nodes;
+			std::vector<mcs_node*> free_nodes;
+		public:
+			mcs_node* take() {
+				if (free_nodes.empty()) {
+					nodes.push_back(std::make_unique<mcs_node>());
+					return nodes.back().get();
+				}
+				mcs_node* node = free_nodes.back();
+				free_nodes.pop_back();
+				return node;
+			}
+			void give(mcs_node* node) { free_nodes.push_back(node); }
+		};
+		inline mcs_node_cache& this_thread_mcs_nodes() {
+			static thread_local mcs_node_cache cache;
+			return cache;
+		}
+	}
+
+	/**
+	* A fair queue lock: each waiter spins on a flag in its own mcs_node, so handing over the lock touches only
+	* the next waiter's cache line, no matter how many threads are waiting. Best under heavy contention.
+	*
+	* lock()/unlock() take a node from a thread local cache. For no overhead at all, pass an mcs_node that lives
+	* until the matching unlock, such as one on the stack.
+	* ex:
+	* mpd::mcs_node node;
+	* lock.lock(node);
+	* ...
+	* lock.unlock(node);
+	**/
+	class mcs_lock {
+		std::atomic<mcs_node*> tail{nullptr};
+		// only read and written by the thread holding the lock
+		mcs_node* holder = nullptr;
+	public:
+		mcs_lock() noexcept = default;
+		mcs_lock(const mcs_lock&) = delete;
+		mcs_lock& operator=(const mcs_lock&) = delete;
+
+		void lock(mcs_node& node) noexcept {
+			node.next.store(nullptr, std::memory_order_relaxed);
+			node.waiting.store(true, std::memory_order_relaxed);
+			mcs_node* prev = tail.exchange(&node, std::memory_order_acq_rel);
+			if (prev != nullptr) {
+				prev->next.store(&node, std::memory_order_release);
+				while (node.waiting.load(std::memory_order_acquire))
+					cpu_relax();
+			}
+		}
+		bool try_lock(mcs_node& node) noexcept {
+			node.next.store(nullptr, std::memory_order_relaxed);
+			mcs_node* expected = nullptr;
+			return tail.compare_exchange_strong(expected, &node, std::memory_order_acquire, std::memory_order_relaxed);
+		}
+		void unlock(mcs_node& node) noexcept {
+			mcs_node* next = node.next.load(std::memory_order_acquire);
+			if (next == nullptr) {
+				mcs_node* expected = &node;
+				if (tail.compare_exchange_strong(expected, nullptr, std::memory_order_release, std::memory_order_relaxed))
+					return;
+				// a new waiter swapped itself into the tail, but hasn't linked itself to this node yet
+				while ((next = node.next.load(std::memory_order_acquire)) == nullptr)
+					cpu_relax();
+			}
+			next->waiting.store(false, std::memory_order_release);
+		}
+
+		void lock() {
+			mcs_node* node = impl::this_thread_mcs_nodes().take();
+			lock(*node);
+			holder = node;
+		}
+		bool try_lock() {
+			mcs_node* node = impl::this_thread_mcs_nodes().take();
+			if (!try_lock(*node)) {
+				impl::this_thread_mcs_nodes().give(node);
+				return false;
+			}
+			holder = node;
+			return true;
+		}
+		void unlock() {
+			mcs_node* node = holder;
+			assert(node != nullptr);
+			holder = nullptr;
+			unlock(*node);
+			impl::this_thread_mcs_nodes().give(node);
+		}
+	};
+
+	/**
+	* A mutex that spins for a short while, and then parks the thread in the kernel (futex, WaitOnAddress, or
+	* std::atomic::wait) until it's woken by unlock. The uncontended lock and unlock are a single atomic operation each,
+	* with no syscall, and a thread that can't get the lock soon stops burning a core, so it holds up when there are
+	* more threads than cores.
+	**/
+	template<unsigned spin_count = 100>
+	class adaptive_mutex {
+		enum : std::uint32_t { unlocked = 0, locked_alone = 1, locked_with_waiters = 2 };
+		std::atomic<std::uint32_t> state{unlocked};
+
+		MPD_NOINLINE(void) lock_slow() noexcept {
+			for (unsigned i = 0; i < spin_count; i++) {
+				std::uint32_t current = state.load(std::memory_order_relaxed);
+				if (current == unlocked) {
+					if (state.compare_exchange_weak(current, locked_alone, std::memory_order_acquire, std::memory_order_relaxed))
+						return;
+				} else if (current == locked_with_waiters)
+					break; // others are already parked, so don't jump the queue
+				cpu_relax();
+			}
+			// from here on, we don't know if there are other waiters, so always leave the lock marked as having them
+			while (state.exchange(locked_with_waiters, std::memory_order_acquire) != unlocked)
+				atomic_wait(state, locked_with_waiters);
+		}
+	public:
+		adaptive_mutex() noexcept = default;
+		adaptive_mutex(const adaptive_mutex&) = delete;
+		adaptive_mutex& operator=(const adaptive_mutex&) = delete;
+
+		void lock() noexcept {
+			std::uint32_t expected = unlocked;
+			if (state.compare_exchange_strong(expected, locked_alone, std::memory_order_acquire, std::memory_order_relaxed)) { [[likely]] return; }
+			lock_slow();
+		}
+		bool try_lock() noexcept {
+			std::uint32_t expected = unlocked;
+			return state.compare_exchange_strong(expected, locked_alone, std::memory_order_acquire, std::memory_order_relaxed);
+		}
+		void unlock() noexcept {
+			if (state.exchange(unlocked, std::memory_order_release) == locked_with_waiters) { [[unlikely]]
+				atomic_notify_one(state);
+			}
+		}
+	};
+}
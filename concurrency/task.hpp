@@ -0,0 +1,313 @@
+#pragma once
+#if __cpp_impl_coroutine && __has_include(<coroutine>)
+#include <coroutine>
+#endif
+#if __cpp_impl_coroutine && __cpp_lib_coroutine
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <exception>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include "concurrency/atomic_spin.hpp"
+#include "concurrency/thread_pool.hpp"
+#include "memory/concurrent_pool.hpp"
+
+namespace mpd {
+	template<class T>
+	class task;
+
+	namespace impl {
+		/**
+		* Where coroutine frames come from: concurrent_block_pools of 128 to 1024 byte blocks, so that starting a task
+		* is a lock-free pop rather than a heap allocation. Bigger frames, and frames beyond a pool's capacity, go to
+		* the heap. Frames may be freed from any thread.
+		**/
+		class coroutine_frame_allocator {
+			static const std::size_t class_count = 4;
+			static const std::size_t smallest_class = 128;
+			// 256KB per size class, reserved on first use
+			static const std::size_t class_bytes = 256 * 1024;
+
+			// never destroyed, since frames may be freed during static destruction
+			static concurrent_block_pool& pool(std::size_t size_class) {
+				static concurrent_block_pool* pools[class_count] = {
+					new concurrent_block_pool(smallest_class, class_bytes / smallest_class),
+					new concurrent_block_pool(smallest_class * 2, class_bytes / (smallest_class * 2)),
+					new concurrent_block_pool(smallest_class * 4, class_bytes / (smallest_class * 4)),
+					new concurrent_block_pool(smallest_class * 8, class_bytes / (smallest_class * 8)),
+				};
+				return *pools[size_class];
+			}
+			static std::size_t size_class(std::size_t bytes) noexcept {
+				std::size_t c = 0;
+				for (std::size_t block = smallest_class; block < bytes; block *= 2)
+					++c;
+				return c;
+			}
+		public:
+			static void* allocate(std::size_t bytes) {
+				std::size_t c = size_class(bytes);
+				if (c < class_count) {
+					if (void* frame = pool(c).try_allocate()) { [[likely]] return frame; }
+				}
+				return ::operator new(bytes);
+			}
+			static void deallocate(void* frame, std::size_t bytes) noexcept {
+				std::size_t c = size_class(bytes);
+				if (c < class_count && pool(c).owns(frame)) { [[likely]]
+					pool(c).deallocate(frame);
+					return;
+				}
+				::operator delete(frame);
+			}
+		};
+
+		// Frames of every coroutine type here are allocated by coroutine_frame_allocator.
+		struct pooled_coroutine_frame {
+			static void* operator new(std::size_t bytes) { return coroutine_frame_allocator::allocate(bytes); }
+			static void operator delete(void* frame, std::size_t bytes) noexcept { coroutine_frame_allocator::deallocate(frame, bytes); }
+		};
+
+		// When a task finishes, resume whoever awaited it, by symmetric transfer, so that long chains of tasks
+		// that complete synchronously don't grow the stack.
+		struct task_final_awaiter {
+			bool await_ready() const noexcept { return false; }
+			template<class Promise>
+			std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> finished) noexcept {
+				std::coroutine_handle<> continuation = finished.promise().continuation;
+				return continuation ? continuation : std::noop_coroutine();
+			}
+			void await_resume() const noexcept {}
+		};
+
+		class task_promise_base : public pooled_coroutine_frame {
+		protected:
+			std::exception_ptr error;
+		public:
+			std::coroutine_handle<> continuation;
+
+			std::suspend_always initial_suspend() const noexcept { return {}; }
+			task_final_awaiter final_suspend() const noexcept { return {}; }
+			void unhandled_exception() noexcept { error = std::current_exception(); }
+		};
+
+		template<class T>
+		class task_promise final : public task_promise_base {
+			bool has_value = false;
+			alignas(T) unsigned char value[sizeof(T)];
+		public:
+			task_promise() noexcept = default;
+			task_promise(const task_promise&) = delete;
+			~task_promise() {
+				if (has_value) reinterpret_cast<T*>(value)->~T();
+			}
+			task<T> get_return_object() noexcept;
+			template<class U>
+			void return_value(U&& result) noexcept(std::is_nothrow_constructible_v<T, U&&>) {
+				::new(static_cast<void*>(value)) T(std::forward<U>(result));
+				has_value = true;
+			}
+			T result() {
+				if (error) std::rethrow_exception(error);
+				assert(has_value);
+				return std::move(*reinterpret_cast<T*>(value));
+			}
+		};
+		template<>
+		class task_promise<void> final : public task_promise_base {
+		public:
+			task<void> get_return_object() noexcept;
+			void return_void() const noexcept {}
+			void result() {
+				if (error) std::rethrow_exception(error);
+			}
+		};
+	}
+
+	/**
+	* A lazy coroutine that produces a T. It doesn't start until it's awaited, and then runs on the awaiting thread,
+	* until it awaits something that suspends. When it finishes, it resumes its awaiter directly (symmetric transfer),
+	* so deep chains of tasks don't overflow the stack. Frames are allocated from lock-free pools, not the heap.
+	* Exceptions propagate to the awaiter. Start a task from ordinary code with sync_wait, and move it between
+	* threads with co_await resume_on(pool).
+	* ex:
+	* mpd::task<int> read_and_parse(mpd::async_ifilebuf& file) {
+	*	char buffer[256];
+	*	std::size_t n = co_await file.read_some(buffer, sizeof(buffer));
+	*	co_return parse(buffer, n);
+	* }
+	* int x = mpd::sync_wait(read_and_parse(file));
+	**/
+	template<class T = void>
+	class [[nodiscard]] task {
+		static_assert(!std::is_reference_v<T>, "task<T&> isn't supported, use task<T*>");
+	public:
+		using promise_type = impl::task_promise<T>;
+		using value_type = T;
+	private:
+		std::coroutine_handle<promise_type> handle;
+
+		// awaits the task, and then either returns its result or only waits for it to finish
+		template<bool take_result>
+		struct awaiter {
+			std::coroutine_handle<promise_type> handle;
+
+			bool await_ready() const noexcept { return !handle || handle.done(); }
+			std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+				handle.promise().continuation = awaiting;
+				return handle;
+			}
+			decltype(auto) await_resume() {
+				assert(handle);
+				if constexpr (take_result) return handle.promise().result();
+			}
+		};
+		template<class U>
+		friend U sync_wait(task<U> work);
+	public:
+		task() noexcept : handle(nullptr) {}
+		explicit task(std::coroutine_handle<promise_type> handle_) noexcept : handle(handle_) {}
+		task(task&& rhs) noexcept : handle(std::exchange(rhs.handle, nullptr)) {}
+		task& operator=(task&& rhs) noexcept {
+			if (handle) handle.destroy();
+			handle = std::exchange(rhs.handle, nullptr);
+			return *this;
+		}
+		// Destroying a task that hasn't started never runs it.
+		~task() { if (handle) handle.destroy(); }
+
+		bool valid() const noexcept { return static_cast<bool>(handle); }
+		bool is_ready() const noexcept { return handle && handle.done(); }
+		auto operator co_await() const& noexcept { return awaiter<true>{handle}; }
+		auto operator co_await() const&& noexcept { return awaiter<true>{handle}; }
+		// Waits for the task to finish, without taking its result or rethrowing its exception.
+		auto when_ready() const noexcept { return awaiter<false>{handle}; }
+	};
+
+	namespace impl {
+		template<class T>
+		task<T> task_promise<T>::get_return_object() noexcept { return task<T>(std::coroutine_handle<task_promise>::from_promise(*this)); }
+		inline task<void> task_promise<void>::get_return_object() noexcept { return task<void>(std::coroutine_handle<task_promise>::from_promise(*this)); }
+
+		// Starts a task from ordinary code, and signals a completion_event when it finishes.
+		class sync_wait_runner {
+		public:
+			struct promise_type : pooled_coroutine_frame {
+				completion_event* event = nullptr;
+
+				sync_wait_runner get_return_object() noexcept { return sync_wait_runner(std::coroutine_handle<promise_type>::from_promise(*this)); }
+				std::suspend_always initial_suspend() const noexcept { return {}; }
+				auto final_suspend() const noexcept {
+					struct signal {
+						bool await_ready() const noexcept { return false; }
+						// the frame is already suspended, so the waiter may destroy it as soon as this signals
+						void await_suspend(std::coroutine_handle<promise_type> finished) const noexcept { finished.promise().event->set(); }
+						void await_resume() const noexcept {}
+					};
+					return signal{};
+				}
+				void return_void() const noexcept {}
+				// the runner only awaits when_ready(), which doesn't throw
+				void unhandled_exception() const noexcept { std::terminate(); }
+			};
+		private:
+			std::coroutine_handle<promise_type> handle;
+		public:
+			explicit sync_wait_runner(std::coroutine_handle<promise_type> handle_) noexcept : handle(handle_) {}
+			sync_wait_runner(const sync_wait_runner&) = delete;
+			sync_wait_runner& operator=(const sync_wait_runner&) = delete;
+			~sync_wait_runner() { handle.destroy(); }
+			void run(completion_event& event) {
+				handle.promise().event = &event;
+				handle.resume();
+				event.wait();
+			}
+		};
+		template<class T>
+		sync_wait_runner wait_for_task(const task<T>& work) {
+			co_await work.when_ready();
+		}
+	}
+
+	// Runs the task, and blocks until it finishes. Returns its result, or rethrows its exception.
+	// On a thread_pool worker, runs other tasks of the pool while waiting.
+	template<class T>
+	T sync_wait(task<T> work) {
+		impl::completion_event event;
+		impl::wait_for_task(work).run(event);
+		return work.handle.promise().result();
+	}
+
+	/**
+	* co_await resume_on(pool) suspends the coroutine, and resumes it on one of the pool's workers.
+	* The scheduled work lives in the coroutine frame, so it costs no allocation.
+	* ex:
+	* mpd::task<void> handle(request r) {
+	*	co_await mpd::resume_on(mpd::default_thread_pool());
+	*	process(r); // on a worker
+	* }
+	**/
+	class resume_on final : impl::pool_task {
+		thread_pool* pool;
+		std::coroutine_handle<> suspended;
+	public:
+		explicit resume_on(thread_pool& pool_) noexcept : pool(&pool_) {}
+		bool await_ready() const noexcept { return false; }
+		void await_suspend(std::coroutine_handle<> awaiting) {
+			suspended = awaiting;
+			impl::thread_pool_access::schedule(*pool, this);
+		}
+		void await_resume() const noexcept {}
+		void run() noexcept override { suspended.resume(); }
+	};
+
+	namespace impl {
+		template<class R>
+		class task_future_awaiter final : pool_task {
+			task_future<R> future;
+			std::coroutine_handle<> suspended;
+		public:
+			explicit task_future_awaiter(task_future<R>&& future_) noexcept : future(std::move(future_)) {}
+			bool await_ready() const noexcept { return future.is_ready(); }
+			bool await_suspend(std::coroutine_handle<> awaiting) noexcept {
+				suspended = awaiting;
+				// if the task completed meanwhile, don't suspend at all
+				return future.on_ready(*this);
+			}
+			R await_resume() { return future.get(); }
+			void run() noexcept override { suspended.resume(); }
+		};
+	}
+
+	namespace impl {
+		template<class R>
+		class task_future_ready_awaiter final : pool_task {
+			task_future<R>* future;
+			std::coroutine_handle<> suspended;
+		public:
+			explicit task_future_ready_awaiter(task_future<R>& future_) noexcept : future(&future_) {}
+			bool await_ready() const noexcept { return future->is_ready(); }
+			bool await_suspend(std::coroutine_handle<> awaiting) noexcept {
+				suspended = awaiting;
+				return future->on_ready(*this);
+			}
+			void await_resume() const noexcept {}
+			void run() noexcept override { suspended.resume(); }
+		};
+	}
+
+	// co_await when_ready(future) suspends until the task completes, but leaves the result in the future.
+	template<class R>
+	impl::task_future_ready_awaiter<R> when_ready(task_future<R>& future) noexcept {
+		return impl::task_future_ready_awaiter<R>(future);
+	}
+	// co_await on a task_future suspends the coroutine until the pool task completes, and then resumes it on the
+	// worker that completed it, instead of blocking a thread.
+	template<class R>
+	impl::task_future_awaiter<R> operator co_await(task_future<R>&& future) noexcept {
+		return impl::task_future_awaiter<R>(std::move(future));
+	}
+}
+#endif
@@ -0,0 +1,462 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "concurrency/atomic_spin.hpp"
+#include "concurrency/atomic_wait.hpp"
+#include "concurrency/cache_padded.hpp"
+#include "utilities/macros.hpp"
+
+namespace mpd {
+	class thread_pool;
+
+	namespace impl {
+		// A unit of work in a thread_pool. run() is called exactly once, and is responsible for freeing the task.
+		struct pool_task {
+			virtual void run() noexcept = 0;
+		protected:
+			~pool_task() = default;
+		};
+
+		/**
+		* The Chase-Lev work stealing deque: the owning worker pushes and takes from the bottom without contention,
+		* while other workers steal from the top. Only the owner may call push and take.
+		* (Le, Pop, Cohen, Nardelli. "Correct and Efficient Work-Stealing for Weak Memory Models", 2013)
+		**/
+		class work_stealing_deque {
+			struct ring {
+				std::int64_t mask;
+				std::unique_ptr<std::atomic<pool_task*>[]> slots;
+				explicit ring(std::int64_t capacity) : mask(capacity - 1), slots(new std::atomic<pool_task*>[static_cast<std::size_t>(capacity)]) {}
+				pool_task* get(std::int64_t i) const noexcept { return slots[i & mask].load(std::memory_order_relaxed); }
+				void put(std::int64_t i, pool_task* task) noexcept { slots[i & mask].store(task, std::memory_order_relaxed); }
+			};
+			alignas(hardware_destructive_interference_size) std::atomic<std::int64_t> top{0};
+			alignas(hardware_destructive_interference_size) std::atomic<std::int64_t> bottom{0};
+			std::atomic<ring*> tasks;
+			// stealers may still be reading old rings, so they're only freed with the deque
+			std::vector<std::unique_ptr<ring>> rings;
+
+			MPD_NOINLINE(ring*) grow(ring* old, std::int64_t t, std::int64_t b) {
+				rings.push_back(std::make_unique<ring>((old->mask + 1) * 2));
+				ring* bigger = rings.back().get();
+				for (std::int64_t i = t; i < b; i++)
+					bigger->put(i, old->get(i));
+				tasks.store(bigger, std::memory_order_release);
+				return bigger;
+			}
+		public:
+			work_stealing_deque() {
+				rings.push_back(std::make_unique<ring>(256));
+				tasks.store(rings.back().get(), std::memory_order_relaxed);
+			}
+			work_stealing_deque(const work_stealing_deque&) = delete;
+			work_stealing_deque& operator=(const work_stealing_deque&) = delete;
+
+			void push(pool_task* task) {
+				std::int64_t b = bottom.load(std::memory_order_relaxed);
+				std::int64_t t = top.load(std::memory_order_acquire);
+				ring* r = tasks.load(std::memory_order_relaxed);
+				if (b - t > r->mask) { [[unlikely]] r = grow(r, t, b); }
+				r->put(b, task);
+				bottom.store(b + 1, std::memory_order_release);
+			}
+			// the most recently pushed task, or nullptr
+			pool_task* take() noexcept {
+				std::int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+				ring* r = tasks.load(std::memory_order_relaxed);
+				bottom.store(b, std::memory_order_seq_cst);
+				std::int64_t t = top.load(std::memory_order_seq_cst);
+				if (t > b) {
+					bottom.store(b + 1, std::memory_order_relaxed);
+					return nullptr;
+				}
+				pool_task* task = r->get(b);
+				if (t == b) {
+					// the last task, so race the stealers for it
+					if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+						task = nullptr;
+					bottom.store(b + 1, std::memory_order_relaxed);
+				}
+				return task;
+			}
+			// the oldest task, or nullptr if it's empty or another thread won the race
+			pool_task* steal() noexcept {
+				std::int64_t t = top.load(std::memory_order_seq_cst);
+				std::int64_t b = bottom.load(std::memory_order_seq_cst);
+				if (t >= b) return nullptr;
+				pool_task* task = tasks.load(std::memory_order_acquire)->get(t);
+				if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+					return nullptr;
+				return task;
+			}
+			bool empty() const noexcept {
+				return bottom.load(std::memory_order_relaxed) <= top.load(std::memory_order_relaxed);
+			}
+		};
+
+		// The pool and worker index of the calling thread, if it's a worker.
+		struct pool_worker_identity {
+			thread_pool* pool = nullptr;
+			std::size_t index = 0;
+		};
+		inline pool_worker_identity& this_thread_pool_worker() noexcept {
+			static thread_local pool_worker_identity identity;
+			return identity;
+		}
+
+		// A task to run when a task_state completes, such as resuming a coroutine that awaits a task_future.
+		class task_continuation {
+			std::atomic<pool_task*> continuation{nullptr};
+			static pool_task* completed() noexcept { return reinterpret_cast<pool_task*>(std::uintptr_t(1)); }
+		public:
+			// Returns false, without storing it, if the state has already completed.
+			bool set(pool_task* task) noexcept {
+				pool_task* expected = nullptr;
+				return continuation.compare_exchange_strong(expected, task, std::memory_order_acq_rel, std::memory_order_acquire);
+			}
+			void run_after_completion() noexcept {
+				pool_task* task = continuation.exchange(completed(), std::memory_order_acq_rel);
+				if (task != nullptr) task->run();
+			}
+		};
+
+		// Where a task_future's result lives. Shared between the task and the future by a reference count.
+		template<class R>
+		class task_state {
+			std::atomic<std::uint32_t> refs{2};
+			std::atomic<std::uint32_t> ready{0};
+			std::exception_ptr error;
+			task_continuation continuation;
+			alignas(R) unsigned char value[sizeof(R)];
+		protected:
+			template<class F>
+			void complete(F& function) noexcept {
+				try {
+					::new(static_cast<void*>(value)) R(function());
+				} catch (...) {
+					error = std::current_exception();
+				}
+				ready.store(1, std::memory_order_release);
+				atomic_notify_all(ready);
+				continuation.run_after_completion();
+			}
+			virtual ~task_state() {
+				if (ready.load(std::memory_order_relaxed) && !error)
+					reinterpret_cast<R*>(value)->~R();
+			}
+		public:
+			bool is_ready() const noexcept { return ready.load(std::memory_order_acquire) != 0; }
+			void wait_ready() const noexcept { atomic_wait(ready, 0); }
+			bool set_continuation(pool_task* task) noexcept { return continuation.set(task); }
+			R take() {
+				if (error) std::rethrow_exception(error);
+				return std::move(*reinterpret_cast<R*>(value));
+			}
+			void release() noexcept {
+				if (refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+					delete this;
+			}
+		};
+		template<>
+		class task_state<void> {
+			std::atomic<std::uint32_t> refs{2};
+			std::atomic<std::uint32_t> ready{0};
+			std::exception_ptr error;
+			task_continuation continuation;
+		protected:
+			template<class F>
+			void complete(F& function) noexcept {
+				try {
+					function();
+				} catch (...) {
+					error = std::current_exception();
+				}
+				ready.store(1, std::memory_order_release);
+				atomic_notify_all(ready);
+				continuation.run_after_completion();
+			}
+			virtual ~task_state() = default;
+		public:
+			bool is_ready() const noexcept { return ready.load(std::memory_order_acquire) != 0; }
+			void wait_ready() const noexcept { atomic_wait(ready, 0); }
+			bool set_continuation(pool_task* task) noexcept { return continuation.set(task); }
+			void take() {
+				if (error) std::rethrow_exception(error);
+			}
+			void release() noexcept {
+				if (refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+					delete this;
+			}
+		};
+
+		template<class F, class R>
+		class future_task final : public pool_task, public task_state<R> {
+			F function;
+		public:
+			explicit future_task(F&& f) : function(std::move(f)) {}
+			void run() noexcept override {
+				this->complete(function);
+				this->release();
+			}
+		};
+		template<class F>
+		class detached_task final : public pool_task {
+			F function;
+		public:
+			explicit detached_task(F&& f) : function(std::move(f)) {}
+			void run() noexcept override {
+				function();
+				delete this;
+			}
+		};
+
+		// Runs a task from the calling worker's pool. Defined after thread_pool.
+		inline bool help_this_thread_pool() noexcept;
+		// lets awaiters and parallel algorithms schedule their own tasks on a thread_pool, without a separate allocation
+		struct thread_pool_access;
+	}
+
+	/**
+	* The result of a task submitted to a thread_pool. Like std::future, but without a mutex or condition variable,
+	* and a worker thread that waits on a task_future runs other tasks in the meantime, instead of blocking its core.
+	* Unlike std::future, the destructor doesn't wait.
+	**/
+	template<class R>
+	class task_future {
+		impl::task_state<R>* state;
+	public:
+		task_future() noexcept : state(nullptr) {}
+		explicit task_future(impl::task_state<R>* state_) noexcept : state(state_) {}
+		task_future(task_future&& rhs) noexcept : state(std::exchange(rhs.state, nullptr)) {}
+		task_future& operator=(task_future&& rhs) noexcept {
+			if (state) state->release();
+			state = std::exchange(rhs.state, nullptr);
+			return *this;
+		}
+		~task_future() { if (state) state->release(); }
+
+		bool valid() const noexcept { return state != nullptr; }
+		bool is_ready() const noexcept { assert(state); return state->is_ready(); }
+		void wait() const noexcept {
+			assert(state);
+			if (state->is_ready()) { [[likely]] return; }
+			if (impl::this_thread_pool_worker().pool != nullptr) {
+				spin_then_yield_backoff<> backoff;
+				while (!state->is_ready()) {
+					if (!impl::help_this_thread_pool())
+						backoff();
+				}
+			} else
+				state->wait_ready();
+		}
+		// Runs continuation on the thread that completes the task, or returns false if it's already complete.
+		// The continuation isn't freed by the future. At most one continuation may be set.
+		bool on_ready(impl::pool_task& continuation) noexcept { assert(state); return state->set_continuation(&continuation); }
+		// Waits for the result, and then rethrows the task's exception, or returns its result. Leaves the future invalid.
+		R get() {
+			wait();
+			impl::task_state<R>* s = std::exchange(state, nullptr);
+			struct releaser { impl::task_state<R>* s; ~releaser() { s->release(); } } release_after{s};
+			return s->take();
+		}
+	};
+
+	/**
+	* A fixed set of worker threads that run submitted tasks. Each worker has a Chase-Lev deque: tasks submitted from
+	* a worker go to its own deque, and idle workers steal from the others, so recursive and fine-grained work
+	* spreads out without a shared lock. Tasks submitted from other threads go through a shared queue.
+	* Idle workers park with atomic_wait, rather than spin.
+	* ex:
+	* mpd::thread_pool pool(4);
+	* mpd::task_future<int> answer = pool.submit([]() { return 42; });
+	* int x = answer.get();
+	**/
+	class thread_pool {
+		struct worker {
+			impl::work_stealing_deque deque;
+			std::thread thread;
+		};
+		std::vector<std::unique_ptr<worker>> workers;
+		std::mutex injection_lock;
+		std::deque<impl::pool_task*> injection_queue;
+		std::atomic<bool> injection_nonempty{false};
+		alignas(hardware_destructive_interference_size) std::atomic<std::uint32_t> work_epoch{0};
+		std::atomic<std::uint32_t> sleepers{0};
+		std::atomic<bool> stopping{false};
+		// submitted tasks that haven't finished running
+		std::atomic<std::size_t> pending{0};
+
+		impl::pool_task* pop_injected() {
+			if (!injection_nonempty.load(std::memory_order_acquire)) return nullptr;
+			std::lock_guard<std::mutex> guard(injection_lock);
+			if (injection_queue.empty()) return nullptr;
+			impl::pool_task* task = injection_queue.front();
+			injection_queue.pop_front();
+			injection_nonempty.store(!injection_queue.empty(), std::memory_order_release);
+			return task;
+		}
+		impl::pool_task* find_task(std::size_t self) {
+			if (impl::pool_task* task = workers[self]->deque.take()) return task;
+			if (impl::pool_task* task = pop_injected()) return task;
+			for (std::size_t i = 1; i < workers.size(); i++) {
+				if (impl::pool_task* task = workers[(self + i) % workers.size()]->deque.steal()) return task;
+			}
+			return nullptr;
+		}
+		void run_task(impl::pool_task* task) noexcept {
+			task->run();
+			pending.fetch_sub(1, std::memory_order_release);
+		}
+		void signal_work() noexcept {
+			work_epoch.fetch_add(1, std::memory_order_seq_cst);
+			if (sleepers.load(std::memory_order_seq_cst) != 0)
+				atomic_notify_one(work_epoch);
+		}
+		void worker_loop(std::size_t self) {
+			impl::this_thread_pool_worker() = {this, self};
+			spin_then_yield_backoff<64> backoff;
+			unsigned idle_rounds = 0;
+			while (!stopping.load(std::memory_order_acquire)) {
+				if (impl::pool_task* task = find_task(self)) {
+					run_task(task);
+					idle_rounds = 0;
+					backoff = {};
+					continue;
+				}
+				if (++idle_rounds < 64) {
+					backoff();
+					continue;
+				}
+				// announce that we're going to sleep, then check once more, so that a submit can't slip between
+				sleepers.fetch_add(1, std::memory_order_seq_cst);
+				std::uint32_t epoch = work_epoch.load(std::memory_order_seq_cst);
+				impl::pool_task* task = find_task(self);
+				if (task == nullptr && !stopping.load(std::memory_order_acquire))
+					atomic_wait(work_epoch, epoch);
+				sleepers.fetch_sub(1, std::memory_order_relaxed);
+				if (task) run_task(task);
+				idle_rounds = 0;
+			}
+		}
+		// If queueing the task throws, it isn't counted, and the caller still owns it.
+		void schedule(impl::pool_task* task) {
+			// counted before it's queued, so it can't finish before it's counted
+			pending.fetch_add(1, std::memory_order_relaxed);
+			impl::pool_worker_identity& me = impl::this_thread_pool_worker();
+			try {
+				if (me.pool == this) {
+					workers[me.index]->deque.push(task);
+				} else {
+					std::lock_guard<std::mutex> guard(injection_lock);
+					injection_queue.push_back(task);
+					injection_nonempty.store(true, std::memory_order_release);
+				}
+			} catch (...) {
+				pending.fetch_sub(1, std::memory_order_relaxed);
+				throw;
+			}
+			signal_work();
+		}
+		friend bool impl::help_this_thread_pool() noexcept;
+		friend struct impl::thread_pool_access;
+	public:
+		// A thread_count of 0 means one per hardware thread.
+		explicit thread_pool(std::size_t thread_count = 0) {
+			if (thread_count == 0) thread_count = std::max(1u, std::thread::hardware_concurrency());
+			for (std::size_t i = 0; i < thread_count; i++)
+				workers.push_back(std::make_unique<worker>());
+			for (std::size_t i = 0; i < thread_count; i++)
+				workers[i]->thread = std::thread([this, i]() { worker_loop(i); });
+		}
+		thread_pool(const thread_pool&) = delete;
+		thread_pool& operator=(const thread_pool&) = delete;
+		// Finishes every task that was already submitted, including tasks they submit, and then joins the workers.
+		~thread_pool() {
+			while (pending.load(std::memory_order_acquire) != 0)
+				std::this_thread::yield();
+			stopping.store(true, std::memory_order_release);
+			work_epoch.fetch_add(1, std::memory_order_seq_cst);
+			atomic_notify_all(work_epoch);
+			for (const std::unique_ptr<worker>& w : workers)
+				w->thread.join();
+		}
+
+		std::size_t size() const noexcept { return workers.size(); }
+		// Is the calling thread one of this pool's workers?
+		bool is_worker_thread() const noexcept { return impl::this_thread_pool_worker().pool == this; }
+
+		template<class F>
+		auto submit(F&& function) -> task_future<std::invoke_result_t<std::decay_t<F>&>> {
+			using R = std::invoke_result_t<std::decay_t<F>&>;
+			std::unique_ptr<impl::future_task<std::decay_t<F>, R>> task(new impl::future_task<std::decay_t<F>, R>(std::decay_t<F>(std::forward<F>(function))));
+			schedule(task.get());
+			return task_future<R>(task.release());
+		}
+		// Runs the function, without a way to wait for it. Exceptions escaping the function terminate the program.
+		template<class F>
+		void post(F&& function) {
+			std::unique_ptr<impl::detached_task<std::decay_t<F>>> task(new impl::detached_task<std::decay_t<F>>(std::decay_t<F>(std::forward<F>(function))));
+			schedule(task.get());
+			task.release();
+		}
+	};
+
+	namespace impl {
+		inline bool help_this_thread_pool() noexcept {
+			pool_worker_identity& me = this_thread_pool_worker();
+			if (me.pool == nullptr) return false;
+			pool_task* task = me.pool->find_task(me.index);
+			if (task == nullptr) return false;
+			me.pool->run_task(task);
+			return true;
+		}
+
+		struct thread_pool_access {
+			static void schedule(thread_pool& pool, pool_task* task) { pool.schedule(task); }
+		};
+
+		// Set once when some work finishes, and waited for by the thread that started it.
+		class completion_event {
+			std::mutex lock;
+			std::condition_variable finished;
+			std::atomic<bool> done{false};
+		public:
+			void set() {
+				// under the lock, so that the waiter can't return and destroy the event while this notifies
+				std::lock_guard<std::mutex> guard(lock);
+				done.store(true, std::memory_order_release);
+				finished.notify_all();
+			}
+			void wait() {
+				if (this_thread_pool_worker().pool != nullptr) {
+					// a worker blocking here could starve the work it waits for, so run other tasks instead
+					spin_then_yield_backoff<> backoff;
+					while (!done.load(std::memory_order_acquire)) {
+						if (!help_this_thread_pool())
+							backoff();
+					}
+				}
+				std::unique_lock<std::mutex> guard(lock);
+				finished.wait(guard, [this]() { return done.load(std::memory_order_acquire); });
+			}
+		};
+	}
+
+	// The process-wide pool, with a worker per hardware thread, created on first use.
+	inline thread_pool& default_thread_pool() {
+		static thread_pool pool;
+		return pool;
+	}
+}
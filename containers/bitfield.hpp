@@ -1,5 +1,8 @@
+#pragma once
+#include <climits>
 #include <cmath>
 #include <limits>
+#include <type_traits>
 #include "utilities/macros.hpp"
 
 namespace mpd {
@@ -91,13 +94,20 @@ namespace mpd {
 		BaseT* bits;
 	public:
 		using as_const = bitfield_member<const BaseT, const FieldT, bitcount, offset, Getter, Setter>;
+		using base_type = BaseT;
+		using field_type = FieldT;
+		static constexpr unsigned field_bitcount = bitcount;
+		static constexpr unsigned field_offset = offset;
+		// the bits of BaseT that this member occupies
+		static constexpr BaseT field_mask = lomask << offset;
 
 		constexpr explicit bitfield_member(BaseT& bits_) :bits(&bits_) {}
 		constexpr operator FieldT() const { return get(); }
 		constexpr MPD_INLINE(FieldT) get() const {
 			// Despite appearances, this whole method is branchless
-			BaseT raw_bits = (*bits >> offset) & lomask;
-			BaseT sign_extended_bits;
+			using bits_type = std::remove_const_t<BaseT>;
+			bits_type raw_bits = (*bits >> offset) & lomask;
+			bits_type sign_extended_bits;
 			if (std::numeric_limits<FieldT>::is_signed) {
 				// negative values need the sign-extension bits set
 				sign_extended_bits = ~((raw_bits >> (bitcount - 1)) - 1u);
@@ -120,7 +130,7 @@ namespace mpd {
 			// here again, negative values may have sign-extension bits outside the valid range
 			// but as we already validated the range, we can drop those sign-extension bits.
 			if (std::numeric_limits<FieldT>::is_signed) {
-				assume((newBits | lomask) == lomask || ~(newBits | lomask) == 0u);
+				assume((newBits | lomask) == lomask || static_cast<BaseT>(~(newBits | lomask)) == 0u);
 				newBits &= lomask;
 			} else {
 				assume((newBits >> offset >> bitcount) == 0u);
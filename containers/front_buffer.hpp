@@ -4,7 +4,9 @@
 #include "iterators/iterator.hpp"
 #include "iterators/reference_iterator.hpp"
 #include "utilities/macros.hpp"
+#include "memory/aligned_allocator.hpp"
 #include "memory/memory.hpp"
+#include "memory/scratch_allocator.hpp"
 #include <stdexcept>
 #include <string>
 #include <tuple>
@@ -79,13 +81,13 @@ namespace mpd {
 
 			// step 3: execute the plan (linear time)
 			if (insert_construct) {
-				std::uninitialized_copy_n(src_construct_it, insert_construct, buffer + size);
+				mpd::uninitialized_copy_n(src_construct_it, insert_construct, buffer + size);
 			}
 			if (move_construct) {
 				try {
-					uninitialized_move_n(buffer + move_assign, move_construct, buffer + move_construct_idx);
+					mpd::uninitialized_move_n(buffer + move_assign, move_construct, buffer + move_construct_idx);
 				} catch (...) { //strong exception guarantee
-					destroy(buffer + size, buffer + insert_construct);
+					destroy(buffer + size, buffer + size + insert_construct);
 					throw;
 				}
 			}
@@ -100,6 +102,20 @@ namespace mpd {
 			}
 		}
 
+		// Trivially relocatable elements are shifted up with a single memmove, and the new elements are constructed in the gap.
+		// Only used when nothing is truncated, so that the shift can be undone if a construction throws.
+		template <class T, std::size_t alignment = alignof(T), class ForwardIterator>
+		void front_buffer_insert_front_relocate(T* buffer, std::size_t size, ForwardIterator first, std::size_t insert_total) {
+			assume(is_aligned_ptr(buffer, alignment));
+			mpd::uninitialized_relocate_backward(buffer, buffer + size, buffer + insert_total + size);
+			try {
+				mpd::uninitialized_copy_n(first, insert_total, buffer);
+			} catch (...) { //strong exception guarantee
+				mpd::uninitialized_relocate(buffer + insert_total, buffer + insert_total + size, buffer);
+				throw;
+			}
+		}
+
 		template <overflow_behavior_t overflow, class T, std::size_t alignment = alignof(T), class ForwardIterator>
 		std::size_t front_buffer_insert_front(T* buffer, std::size_t size, std::size_t capacity, ForwardIterator src_first, ForwardIterator src_last, std::forward_iterator_tag dispatch_tag)
 			noexcept(noexcept(max_length_check<overflow>(0, 0))
@@ -128,65 +144,58 @@ namespace mpd {
 
 			// step 2: validate the plan
 			// step 3: execute the plan (linear time)
+			// the relocating path only exists for trivially relocatable types, and is taken when nothing is truncated
+			if constexpr (is_trivially_relocatable_v<T>) {
+				if (final_size == size + insert_total) {
+					front_buffer_insert_front_relocate<T, alignment>(buffer, size, src_first, insert_total);
+					return final_size;
+				}
+			}
 			front_buffer_insert_front_unchecked<T, alignment>(buffer, size, capacity, src_first, src_construct_it, insert_assign, move_assign, insert_construct, move_construct, insert_total, move_construct_idx, final_size);
 			return final_size;
 		}
 
-		template <overflow_behavior_t overflow, class T, std::size_t alignment = alignof(T), class ForwardIterator>
-		std::size_t front_buffer_insert_front(T* buffer, std::size_t size, std::size_t capacity, ForwardIterator first, ForwardIterator last, std::input_iterator_tag)
-			noexcept(noexcept(max_length_check<overflow>(0, 0))
-				&& std::is_nothrow_constructible_v<T, decltype(*first)>
-				&& std::is_nothrow_move_constructible_v<T>
-				&& std::is_nothrow_move_assignable_v<T>
-				&& std::is_nothrow_assignable_v<T, decltype(*first)>) {
-			// we can't know the insert size beforehand, so this gets trickier. This usually takes 3-4 write passes.
+		template <overflow_behavior_t overflow, class T, std::size_t alignment = alignof(T), class InputIterator>
+		std::size_t front_buffer_insert_front(T* buffer, std::size_t size, std::size_t capacity, InputIterator first, InputIterator last, std::input_iterator_tag) {
+			// we can't know the insert size beforehand, so copy the new items to the thread's scratch stack first,
+			// and then insert them from there with the forward-iterator algorithm.
 			assume(is_aligned_array(buffer, capacity, alignment));
 			assert(size <= capacity);
 
-			// step 1: append the new items to the data already in the buffer
-			//std::size_t max_construct_count = capacity - size;
-			auto end_construct_its = uninitialized_copy_s(first, last, buffer + size, buffer + capacity);
+			// step 1: copy the new items to scratch, growing geometrically. No more than capacity items can end up in the buffer.
+			scratch_frame frame;
+			std::size_t temp_capacity = std::min<std::size_t>(capacity, 16);
+			T* temp = frame.alloc<T>(temp_capacity);
+			std::size_t temp_size = 0;
 			try {
-				assume(end_construct_its.second >= buffer);
-				assume(end_construct_its.second <= buffer + capacity);
-				first = end_construct_its.first;
-				std::size_t new_size = end_construct_its.second - buffer;
-				assume(new_size <= capacity);
-
-				// step 2: rotate the inserted items to the front
-				std::rotate(buffer, buffer + size, buffer + new_size);
-				std::size_t pre_overwrite_size = new_size - size;
-				assume(pre_overwrite_size <= capacity);
-
-				// step 3: capacity check
-				if (first == last) {
-					return new_size;
-				} else {
+				for (;;) {
+					auto end_construct_its = mpd::uninitialized_copy_s(first, last, temp + temp_size, temp + temp_capacity);
+					first = end_construct_its.first;
+					temp_size = end_construct_its.second - temp;
+					if (first == last || temp_capacity == capacity) break;
+					std::size_t bigger_capacity = std::min(capacity, temp_capacity * 2);
+					T* bigger = frame.alloc<T>(bigger_capacity);
+					std::size_t relocate_count = temp_size;
+					temp_size = 0; // a throwing relocation destroys both ranges
+					mpd::uninitialized_relocate_n(temp, relocate_count, bigger);
+					temp = bigger;
+					temp_size = relocate_count;
+					temp_capacity = bigger_capacity;
+				}
+
+				// step 2: capacity check
+				if (first != last) {
 					max_length_check<overflow>(capacity + 1, capacity);
-					if (size == 0) {
-						return new_size;
-					}
 				}
 
-				// step 4: If we got this far, then that means we need to truncate the "old" items, but we still don't know how many to truncate.
-				// we'll simply overwrite from the back to the front, so that overwrites occur from lastmost of old content to frontmost.
-				assume(new_size == capacity);
-				auto end_assign_its = copy_s(first, last, std::make_reverse_iterator(buffer + capacity), std::make_reverse_iterator(buffer + pre_overwrite_size));
-				T* end_overwrite = end_assign_its.second.base();
-				assume(end_overwrite >= buffer + pre_overwrite_size);
-				assume(end_overwrite <= buffer + capacity);
-				// step 5: rotate the overwritten elements to the middle, and the remaining original elements to the back
-				auto begin_original = std::rotate(buffer + pre_overwrite_size, end_overwrite, buffer + capacity);
-				assume(begin_original >= buffer + pre_overwrite_size);
-				assume(begin_original <= buffer + capacity);
-				// step 6: The overwritten elements are in reverse order, so flip them around
-				std::reverse(buffer+ pre_overwrite_size, begin_original);
-				return capacity;
+				// step 3: insert from scratch (single write pass)
+				std::size_t final_size = front_buffer_insert_front<overflow, T, alignment>(buffer, size, capacity,
+					std::make_move_iterator(temp), std::make_move_iterator(temp + temp_size), std::random_access_iterator_tag{});
+				destroy(temp, temp + temp_size);
+				return final_size;
 			} catch (...) {
-				// at this point, the strong exception guarantee is a lost cause, but we can provide the weak exception guarantee
-				destroy(buffer + size, end_construct_its.second);
+				destroy(temp, temp + temp_size);
 				throw;
-
 			}
 		}
 	}
@@ -215,7 +224,7 @@ namespace mpd {
 		assume(is_aligned_array(buffer, capacity, alignment));
 		assume(size <= capacity);
 		if (size != impl::max_length_check<overflow>(size + 1, capacity)) {
-			construct_at<T>(buffer + size, std::forward<Args>(args)...);
+			mpd::construct_at<T>(buffer + size, std::forward<Args>(args)...);
 		}
 		return size + 1;
 	}
@@ -234,10 +243,10 @@ namespace mpd {
 			assume(new_size <= capacity);
 			assume(new_size >= size);
 			std::size_t append_size = new_size - size;
-			std::uninitialized_copy_n(src_first, append_size, buffer + size);
+			mpd::uninitialized_copy_n(src_first, append_size, buffer + size);
 			return new_size;
 		} else {
-			auto its = uninitialized_copy_s(src_first, src_last, buffer + size, buffer + capacity);
+			auto its = mpd::uninitialized_copy_s(src_first, src_last, buffer + size, buffer + capacity);
 			assume(its.second >= buffer + size);
 			assume(its.second <= buffer + capacity);
 			try {
@@ -272,13 +281,20 @@ namespace mpd {
 	}
 
 	template <class T, std::size_t alignment = alignof(T)>
-	std::size_t front_buffer_erase(T* buffer, std::size_t size, std::size_t pos, std::size_t erase_count) noexcept(std::is_nothrow_move_assignable_v<T>) {
+	std::size_t front_buffer_erase(T* buffer, std::size_t size, std::size_t pos, std::size_t erase_count)
+		noexcept(is_trivially_relocatable_v<T> || std::is_nothrow_move_assignable_v<T>) {
 		assume(is_aligned_ptr(buffer, alignment));
 		assume(pos <= size);
 		assume(pos + erase_count <= size);
 		std::size_t final_size = size - erase_count;
-		std::move(buffer + pos + erase_count, buffer + size, buffer + pos);
-		destroy(buffer + final_size, buffer + size);
+		// this branch is evaluated at compile time, so only one or the other exists in bytecode
+		if (is_trivially_relocatable_v<T>) {
+			destroy(buffer + pos, buffer + pos + erase_count);
+			mpd::uninitialized_relocate(buffer + pos + erase_count, buffer + size, buffer + pos);
+		} else {
+			std::move(buffer + pos + erase_count, buffer + size, buffer + pos);
+			destroy(buffer + final_size, buffer + size);
+		}
 		return final_size;
 	}
 
@@ -423,42 +439,45 @@ namespace mpd {
 		};
 
 		template<class T, class Allocator, std::size_t alignment_ = alignof(T)>
-		class front_buffer_heap_state : Allocator::template rebind<T>::type{
+		class front_buffer_heap_state : std::allocator_traits<Allocator>::template rebind_alloc<T> {
 		public:
 			using value_type = T;
 			using size_type = std::size_t;
-			using allocator = typename Allocator::template rebind<T>::type;
+			using allocator = typename std::allocator_traits<Allocator>::template rebind_alloc<T>;
+			using allocator_traits = std::allocator_traits<allocator>;
 			using bytebuffer_value_type = mpd::best_bytebuffer_type_t<T, alignment_, alignment_>;
 		protected:
 			static const bool copy_ctor_should_assign = true;
 			static const bool move_ctor_should_assign = false;
 			static const bool copy_assign_should_assign = true;
 			static const bool move_assign_should_assign = false;
-			static const bool dtor_should_destroy = false;
+			static const bool dtor_should_destroy = true;
 			static const std::size_t alignment = alignment_;
 		private:
 			size_type max;
 			size_type sz;
 			T* buffer;
 			// ensure that overaligned bytes are zeroed out, so that algorithms can read/write aligned blocks deterministically.
-			void init_overaligned() noexcept { std::memset(buffer + max, 0, sizeof(T)*(aligned_capacity()-capacity)); }
+			void init_overaligned() noexcept { std::memset(buffer + max, 0, sizeof(T)*(aligned_capacity()-max)); }
+			allocator& get_alloc() noexcept { return *this; }
 		protected:
 			void set_size(size_type s) noexcept { sz = s; }
-			static size_type aligned_capacity(size_type capcity) {
-				return std::is_trivial_v<T> ? sizeof(T) * capcity + alignment_ - 1) / alignment_ * alignment_ / sizeof(T) : capacity;
+			static size_type aligned_capacity(size_type capacity) {
+				return std::is_trivial_v<T> ? (sizeof(T) * capacity + alignment_ - 1) / alignment_ * alignment_ / sizeof(T) : capacity;
 			}
 		public:
 			explicit front_buffer_heap_state(size_type capacity_)
-				:max(capacity_), sz(0), buffer(allocate(aligned_capacity(capacity))) { init_overaligned(); }
+				:max(capacity_), sz(0), buffer(allocator_traits::allocate(get_alloc(), aligned_capacity(capacity_))) { init_overaligned(); }
 			explicit front_buffer_heap_state(size_type capacity_, const Allocator& a)
-				:allocator(a), max(capacity_), sz(0), buffer(a.allocate(aligned_capacity(capacity))) { init_overaligned(); }
+				:allocator(a), max(capacity_), sz(0), buffer(allocator_traits::allocate(get_alloc(), aligned_capacity(capacity_))) { init_overaligned(); }
 			template<class U, class Allocator2, std::size_t align2>
 			front_buffer_heap_state(const front_buffer_heap_state<U, Allocator2, align2>& rhs)
-				: allocator(rhs), max(rhs.max), sz(0), buffer(allocate(rhs.aligned_capacity())) { init_overaligned(); }
+				: allocator(allocator_traits::select_on_container_copy_construction(rhs.get_allocator()))
+				, max(rhs.capacity()), sz(0), buffer(allocator_traits::allocate(get_alloc(), aligned_capacity(rhs.capacity()))) { init_overaligned(); }
 			front_buffer_heap_state(front_buffer_heap_state&& rhs)
 				:allocator(rhs), max(rhs.max), sz(rhs.sz), buffer(rhs.buffer) 
 			{ rhs.max = 0; rhs.sz = 0; rhs.buffer = nullptr; }
-			~front_buffer_heap_state() { allocator::deallocate(buffer); }
+			~front_buffer_heap_state() { if (buffer) allocator_traits::deallocate(get_alloc(), buffer, aligned_capacity(max)); }
 			template<class U, class Allocator2, std::size_t align2>
 			front_buffer_heap_state& operator=(const front_buffer_heap_state<U, Allocator2, align2>& rhs) {
 				allocator::operator=(rhs); return *this;
@@ -475,7 +494,7 @@ namespace mpd {
 			size_type size() const noexcept { return sz; }
 			size_type capacity() const noexcept { return max; }
 			size_type aligned_capacity() const noexcept { return aligned_capacity(max); }
-			std::allocator<T> get_allocator() const { return {}; }
+			allocator get_allocator() const { return *this; }
 		};
 	}
 
@@ -511,7 +530,7 @@ namespace mpd {
 		using bytebuffer_iterator = mpd::bytebuffer_iterator_for<T, typename state::bytebuffer_value_type>;
 
 		basic_front_buffer() noexcept(noexcept(state())) { sets(0); }
-		explicit basic_front_buffer(state&& s) noexcept(noexcept(state(s))) : state(s) {}
+		explicit basic_front_buffer(state&& s) noexcept(noexcept(state(std::move(s)))) : state(std::move(s)) {}
 		basic_front_buffer(size_type count, const T& value) { assign(count, value); }
 		basic_front_buffer(state&& s, size_type count, const T& value) : state(std::move(s)) { assign(count, value); }
 		basic_front_buffer(size_type count) { resize(count); }
@@ -712,7 +731,23 @@ namespace mpd {
 				sets(front_buffer_pop_back(d(), s, s - want_s));
 			}
 		}
+		// Moves every element to the end of dest, leaving this empty. Trivially relocatable elements are moved with one memmove.
+		// dest must have room for them. If a move throws, the elements are all destroyed.
+		template<class state2, overflow_behavior_t overflow2>
+		void relocate_append_to(basic_front_buffer<state2, overflow2>& dest)
+			noexcept(is_trivially_relocatable_v<T> || std::is_nothrow_move_constructible_v<T>) {
+			static_assert(std::is_same_v<typename state2::value_type, T>, "relocation doesn't convert");
+			std::size_t count = s();
+			std::size_t dest_size = dest.size();
+			assert(count <= dest.capacity() - dest_size);
+			T* first = d();
+			sets(0); // a throwing relocation destroys both ranges
+			mpd::uninitialized_relocate_n(first, count, dest.data() + dest_size);
+			dest.sets(dest_size + count);
+		}
 		//no swap method, since that'd unexpectedly be O(n) on most implementations
+	private:
+		template<class, overflow_behavior_t> friend class basic_front_buffer;
 	};
 	template<class state1, overflow_behavior_t overflow1, class state2, overflow_behavior_t overflow2>
 	bool operator==(const basic_front_buffer<state1, overflow1>& l, const basic_front_buffer<state2, overflow2>& r) noexcept {
@@ -763,6 +798,24 @@ namespace mpd {
 
 	template<class T, class Allocator = std::allocator<T>, overflow_behavior_t overflow = overflow_behavior_t::exception, std::size_t alignment = alignof(T)>
 	using dynamic_buffer = basic_front_buffer<impl::front_buffer_heap_state<T, Allocator, alignment>, overflow>;
+
+	// a dynamic_buffer whose storage is aligned to (and padded to) a cache line, or a page, so that aligned block algorithms can be used on it.
+	template<class T, std::size_t alignment = cache_line_size, overflow_behavior_t overflow = overflow_behavior_t::exception>
+	using aligned_buffer = dynamic_buffer<T, aligned_allocator<T, alignment>, overflow, alignment>;
+	template<class T, std::size_t alignment = cache_line_size, overflow_behavior_t overflow = overflow_behavior_t::exception>
+	aligned_buffer<T, alignment, overflow> make_aligned_buffer(std::size_t capacity) {
+		using state = impl::front_buffer_heap_state<T, aligned_allocator<T, alignment>, alignment>;
+		return aligned_buffer<T, alignment, overflow>(state(capacity));
+	}
+
+	// a dynamic_buffer on the calling thread's scratch stack. It must be destroyed before the scratch_frame it was allocated from.
+	template<class T, overflow_behavior_t overflow = overflow_behavior_t::exception, std::size_t alignment = alignof(T)>
+	using scratch_buffer = dynamic_buffer<T, scratch_allocator<T>, overflow, alignment>;
+	template<class T, overflow_behavior_t overflow = overflow_behavior_t::exception, std::size_t alignment = alignof(T)>
+	scratch_buffer<T, overflow, alignment> make_scratch_buffer(scratch_frame& frame, std::size_t capacity) {
+		using state = impl::front_buffer_heap_state<T, scratch_allocator<T>, alignment>;
+		return scratch_buffer<T, overflow, alignment>(state(capacity, frame.get_allocator<T>()));
+	}
 }
 namespace std {
 	template<class state, mpd::overflow_behavior_t overflow>
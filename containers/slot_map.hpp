@@ -0,0 +1,233 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include "containers/front_buffer.hpp"
+#include "utilities/macros.hpp"
+
+namespace mpd {
+	// A stable reference to an element of a slot_map. Handles of erased elements are detected, even if the slot has been reused.
+	// A default constructed handle never refers to an element.
+	struct slot_map_handle {
+		std::uint32_t index = 0;
+		std::uint32_t generation = 0;
+
+		friend bool operator==(slot_map_handle lhs, slot_map_handle rhs) noexcept { return lhs.index == rhs.index && lhs.generation == rhs.generation; }
+		friend bool operator!=(slot_map_handle lhs, slot_map_handle rhs) noexcept { return !(lhs == rhs); }
+	};
+
+	/**
+	* An unordered container of values, that are referenced by handles that remain valid until that element is erased.
+	* Lookup and erase by handle are O(1) with no hashing, and insertion is amortized O(1).
+	*
+	* Values are stored densely, so iteration is as fast as over a vector, but erase moves the last element into the hole,
+	* so iteration order is not stable, and pointers and iterators are invalidated by insert and erase (the handles aren't).
+	* Slots are indexed by 32-bit indecies, and carry a 32-bit generation that is bumped every time the slot is filled
+	* or emptied. Odd generations are occupied, so stale handles are rejected. Empty slots are reused through a free list.
+	* ex:
+	* mpd::slot_map<session> sessions;
+	* mpd::slot_map_handle h = sessions.emplace(socket);
+	* if (session* s = sessions.find(h)) s->touch();
+	* sessions.erase(h);
+	**/
+	template<class T, class Allocator = std::allocator<T>>
+	class slot_map {
+		struct slot {
+			std::uint32_t dense_or_next_free;
+			std::uint32_t generation;
+		};
+		using value_allocator = typename std::allocator_traits<Allocator>::template rebind_alloc<T>;
+		using index_allocator = typename std::allocator_traits<Allocator>::template rebind_alloc<std::uint32_t>;
+		using slot_allocator = typename std::allocator_traits<Allocator>::template rebind_alloc<slot>;
+		template<class U, class UAllocator>
+		using buffer = dynamic_buffer<U, UAllocator>;
+		static const std::uint32_t npos = 0xFFFFFFFFu;
+
+		buffer<T, value_allocator> values;
+		buffer<std::uint32_t, index_allocator> dense_to_slot; // parallel to values
+		buffer<slot, slot_allocator> slots;
+		std::uint32_t free_head;
+
+		// dynamic_buffers don't grow, so move the contents to a bigger one.
+		template<class U, class UAllocator>
+		static void grow(buffer<U, UAllocator>& buf, std::size_t new_capacity) {
+			if (new_capacity >= npos) throw std::length_error("slot_map can't hold more than 2^32-1 elements");
+			using state = impl::front_buffer_heap_state<U, UAllocator>;
+			buffer<U, UAllocator> bigger(state(new_capacity, buf.get_allocator()));
+			if constexpr (is_trivially_relocatable_v<U> || std::is_nothrow_move_constructible_v<U>) {
+				buf.relocate_append_to(bigger);
+			} else {
+				// a relocation that throws destroys the elements, which the slots still refer to, so they're moved instead
+				bigger.insert(bigger.end(), std::make_move_iterator(buf.begin()), std::make_move_iterator(buf.end()));
+			}
+			buf = std::move(bigger);
+		}
+		static std::size_t next_capacity(std::size_t capacity) noexcept { return capacity < 8 ? 16 : capacity * 2; }
+		const slot* find_slot(slot_map_handle h) const noexcept {
+			if (h.index >= slots.size()) return nullptr;
+			const slot& s = slots[h.index];
+			return s.generation == h.generation && (h.generation & 1) ? &s : nullptr;
+		}
+		MPD_NOINLINE(void) grow_for_insert() {
+			if (values.size() == values.capacity()) {
+				std::size_t capacity = next_capacity(values.capacity());
+				grow(values, capacity);
+				grow(dense_to_slot, capacity);
+			}
+			if (free_head == npos && slots.size() == slots.capacity()) {
+				grow(slots, next_capacity(slots.capacity()));
+			}
+		}
+		// the arguments may refer to an element, which growing moves, so the value is built before growing
+		template<class...Args>
+		MPD_NOINLINE(slot_map_handle) emplace_grow(Args&&...args) {
+			T value(std::forward<Args>(args)...);
+			grow_for_insert();
+			values.emplace_back(std::move(value));
+			return link_back();
+		}
+		// claims a slot for the value that was just added to the back of values
+		slot_map_handle link_back() noexcept {
+			std::uint32_t dense = static_cast<std::uint32_t>(values.size() - 1);
+			std::uint32_t index;
+			if (free_head != npos) {
+				index = free_head;
+				free_head = slots[index].dense_or_next_free;
+			} else {
+				index = static_cast<std::uint32_t>(slots.size());
+				slots.push_back(slot{0, 0});
+			}
+			slot& s = slots[index];
+			s.dense_or_next_free = dense;
+			++s.generation;
+			dense_to_slot.push_back(index);
+			return slot_map_handle{index, s.generation};
+		}
+		void unlink(std::uint32_t index) noexcept {
+			slot& s = slots[index];
+			++s.generation;
+			s.dense_or_next_free = free_head;
+			free_head = index;
+		}
+	public:
+		using value_type = T;
+		using size_type = std::size_t;
+		using difference_type = std::ptrdiff_t;
+		using reference = T&;
+		using const_reference = const T&;
+		using pointer = T*;
+		using const_pointer = const T*;
+		using iterator = T*;
+		using const_iterator = const T*;
+		using handle = slot_map_handle;
+		using allocator_type = Allocator;
+
+		explicit slot_map(const Allocator& alloc = Allocator())
+			: values(impl::front_buffer_heap_state<T, value_allocator>(0, value_allocator(alloc)))
+			, dense_to_slot(impl::front_buffer_heap_state<std::uint32_t, index_allocator>(0, index_allocator(alloc)))
+			, slots(impl::front_buffer_heap_state<slot, slot_allocator>(0, slot_allocator(alloc)))
+			, free_head(npos) {}
+		slot_map(const slot_map&) = delete;
+		slot_map(slot_map&& rhs) noexcept
+			: values(std::move(rhs.values)), dense_to_slot(std::move(rhs.dense_to_slot)), slots(std::move(rhs.slots)), free_head(rhs.free_head)
+		{ rhs.free_head = npos; }
+		slot_map& operator=(const slot_map&) = delete;
+		slot_map& operator=(slot_map&& rhs) {
+			// the buffers swap contents, so the free list has to go with them
+			values = std::move(rhs.values);
+			dense_to_slot = std::move(rhs.dense_to_slot);
+			slots = std::move(rhs.slots);
+			std::swap(free_head, rhs.free_head);
+			return *this;
+		}
+
+		template<class...Args>
+		handle emplace(Args&&...args) {
+			if (values.size() == values.capacity() || (free_head == npos && slots.size() == slots.capacity())) { [[unlikely]]
+				return emplace_grow(std::forward<Args>(args)...);
+			}
+			values.emplace_back(std::forward<Args>(args)...);
+			return link_back();
+		}
+		handle insert(const T& value) { return emplace(value); }
+		handle insert(T&& value) { return emplace(std::move(value)); }
+		// Moves the last element into the erased element's place. Returns false if the handle was stale.
+		bool erase(handle h) {
+			const slot* s = find_slot(h);
+			if (s == nullptr) return false;
+			std::uint32_t dense = s->dense_or_next_free;
+			std::uint32_t last = static_cast<std::uint32_t>(values.size() - 1);
+			if (dense != last) {
+				values[dense] = std::move(values[last]);
+				dense_to_slot[dense] = dense_to_slot[last];
+				slots[dense_to_slot[dense]].dense_or_next_free = dense;
+			}
+			values.pop_back();
+			dense_to_slot.pop_back();
+			unlink(h.index);
+			return true;
+		}
+		// invalidates every handle
+		void clear() noexcept {
+			for (std::uint32_t index : dense_to_slot)
+				unlink(index);
+			values.clear();
+			dense_to_slot.clear();
+		}
+		void reserve(size_type new_capacity) {
+			if (new_capacity > values.capacity()) {
+				grow(values, new_capacity);
+				grow(dense_to_slot, new_capacity);
+			}
+			if (new_capacity > slots.capacity()) {
+				grow(slots, new_capacity);
+			}
+		}
+
+		bool contains(handle h) const noexcept { return find_slot(h) != nullptr; }
+		// nullptr if the element was erased
+		T* find(handle h) noexcept {
+			const slot* s = find_slot(h);
+			return s ? values.data() + s->dense_or_next_free : nullptr;
+		}
+		const T* find(handle h) const noexcept {
+			const slot* s = find_slot(h);
+			return s ? values.data() + s->dense_or_next_free : nullptr;
+		}
+		reference at(handle h) {
+			T* ptr = find(h);
+			if (ptr == nullptr) throw std::out_of_range("slot_map handle " + std::to_string(h.index) + " is stale");
+			return *ptr;
+		}
+		const_reference at(handle h) const {
+			const T* ptr = find(h);
+			if (ptr == nullptr) throw std::out_of_range("slot_map handle " + std::to_string(h.index) + " is stale");
+			return *ptr;
+		}
+		reference operator[](handle h) noexcept { assume(contains(h)); return values[slots[h.index].dense_or_next_free]; }
+		const_reference operator[](handle h) const noexcept { assume(contains(h)); return values[slots[h.index].dense_or_next_free]; }
+		// the handle of an element, given its iterator
+		handle handle_of(const_iterator it) const noexcept {
+			std::uint32_t index = dense_to_slot[static_cast<size_type>(it - values.data())];
+			return handle{index, slots[index].generation};
+		}
+
+		iterator begin() noexcept { return values.begin(); }
+		const_iterator begin() const noexcept { return values.begin(); }
+		const_iterator cbegin() const noexcept { return values.begin(); }
+		iterator end() noexcept { return values.end(); }
+		const_iterator end() const noexcept { return values.end(); }
+		const_iterator cend() const noexcept { return values.end(); }
+		T* data() noexcept { return values.data(); }
+		const T* data() const noexcept { return values.data(); }
+		bool empty() const noexcept { return values.empty(); }
+		size_type size() const noexcept { return values.size(); }
+		size_type capacity() const noexcept { return values.capacity(); }
+		allocator_type get_allocator() const { return allocator_type(values.get_allocator()); }
+	};
+}
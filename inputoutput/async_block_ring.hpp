@@ -0,0 +1,204 @@
+#pragma once
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include "concurrency/atomic_spin.hpp"
+#include "concurrency/atomic_wait.hpp"
+#include "concurrency/cache_padded.hpp"
+#include "concurrency/task.hpp"
+#include "concurrency/thread_pool.hpp"
+
+namespace mpd {
+	namespace impl {
+		/**
+		* The buffers behind async_ifilebuf and async_ofilebuf: a ring of depth blocks of block_size chars, passed in order
+		* between the stream and a worker on the default_thread_pool. The producer fills the block at produced_slot(), and
+		* publishes it with its size, and the consumer empties the block at consumed_slot(), and releases it.
+		* The worker keeps going as long as it has work (free blocks to read into, or published blocks to write out), so a
+		* busy stream keeps one worker streaming blocks, and when it runs out, it returns its thread to the pool. The stream
+		* restarts it with start_worker() whenever it publishes or releases a block.
+		**/
+		class async_block_ring {
+			std::size_t block_size_ = 0;
+			std::size_t depth_ = 0;
+			std::unique_ptr<char[]> storage;
+			std::unique_ptr<std::size_t[]> sizes;
+			// each side's slot is only used by that side
+			std::size_t produced_slot_ = 0;
+			std::size_t consumed_slot_ = 0;
+			// only their differences matter, so wrapping is fine
+			alignas(hardware_destructive_interference_size) std::atomic<std::uint32_t> produced{0};
+			alignas(hardware_destructive_interference_size) std::atomic<std::uint32_t> consumed{0};
+			std::atomic<bool> worker_running{false};
+			std::atomic<bool> stopping{false};
+			task_future<void> worker_future;
+			// run once, on the default_thread_pool, after the next block is published
+			std::atomic<pool_task*> published_continuation{nullptr};
+			// taken by publish, and scheduled once the worker stops. Producer only.
+			pool_task* resume_after_block = nullptr;
+
+			std::size_t next_slot(std::size_t slot) const noexcept { return slot + 1 == depth_ ? 0 : slot + 1; }
+			// Blocks while counter holds value. A pool worker runs other tasks meanwhile, since this ring's worker may be
+			// queued behind it.
+			static void wait_while_equal(const std::atomic<std::uint32_t>& counter, std::uint32_t value) noexcept {
+				if (counter.load(std::memory_order_acquire) != value) { [[likely]] return; }
+				if (this_thread_pool_worker().pool != nullptr) {
+					spin_then_yield_backoff<> backoff;
+					while (counter.load(std::memory_order_acquire) == value) {
+						if (!help_this_thread_pool())
+							backoff();
+					}
+				} else {
+					while (counter.load(std::memory_order_acquire) == value)
+						atomic_wait(counter, value);
+				}
+			}
+		public:
+			async_block_ring() noexcept = default;
+			async_block_ring(std::size_t block_size, std::size_t depth)
+				: block_size_(block_size), depth_(depth), storage(new char[block_size * depth]), sizes(new std::size_t[depth]()) {
+				assert(block_size > 0 && depth > 0);
+			}
+			async_block_ring(const async_block_ring&) = delete;
+			async_block_ring& operator=(const async_block_ring&) = delete;
+			// Both workers must be stopped.
+			async_block_ring& operator=(async_block_ring&& rhs) noexcept {
+				assert(!worker_running.load() && !rhs.worker_running.load());
+				block_size_ = rhs.block_size_;
+				depth_ = rhs.depth_;
+				storage = std::move(rhs.storage);
+				sizes = std::move(rhs.sizes);
+				produced_slot_ = std::exchange(rhs.produced_slot_, 0);
+				consumed_slot_ = std::exchange(rhs.consumed_slot_, 0);
+				produced.store(rhs.produced.exchange(0, std::memory_order_relaxed), std::memory_order_relaxed);
+				consumed.store(rhs.consumed.exchange(0, std::memory_order_relaxed), std::memory_order_relaxed);
+				return *this;
+			}
+			~async_block_ring() { stop_worker(); }
+
+			std::size_t block_size() const noexcept { return block_size_; }
+			std::size_t depth() const noexcept { return depth_; }
+			char* block(std::size_t slot) const noexcept { return storage.get() + slot * block_size_; }
+			std::size_t block_used(std::size_t slot) const noexcept { return sizes[slot]; }
+
+			// Blocks that were published, and not yet released.
+			std::size_t published_count() const noexcept {
+				return static_cast<std::uint32_t>(produced.load(std::memory_order_seq_cst) - consumed.load(std::memory_order_seq_cst));
+			}
+			bool full() const noexcept { return published_count() == depth_; }
+			bool empty() const noexcept { return published_count() == 0; }
+
+			// producer
+			std::size_t produced_slot() const noexcept { return produced_slot_; }
+			void publish(std::size_t used) noexcept {
+				sizes[produced_slot_] = used;
+				produced_slot_ = next_slot(produced_slot_);
+				produced.fetch_add(1, std::memory_order_seq_cst);
+				atomic_notify_all(produced);
+				if (published_continuation.load(std::memory_order_seq_cst) != nullptr) { [[unlikely]]
+					resume_after_block = published_continuation.exchange(nullptr, std::memory_order_seq_cst);
+				}
+			}
+			// Blocks until the ring has a free block to produce into.
+			void wait_not_full() const noexcept {
+				std::uint32_t done = consumed.load(std::memory_order_acquire);
+				while (static_cast<std::uint32_t>(produced.load(std::memory_order_relaxed) - done) == depth_) {
+					wait_while_equal(consumed, done);
+					done = consumed.load(std::memory_order_acquire);
+				}
+			}
+
+			// consumer
+			std::size_t consumed_slot() const noexcept { return consumed_slot_; }
+			void release() noexcept {
+				consumed_slot_ = next_slot(consumed_slot_);
+				consumed.fetch_add(1, std::memory_order_seq_cst);
+				atomic_notify_all(consumed);
+			}
+			// Blocks until the ring has a published block to consume.
+			void wait_not_empty() const noexcept {
+				std::uint32_t done = produced.load(std::memory_order_acquire);
+				while (static_cast<std::uint32_t>(done - consumed.load(std::memory_order_relaxed)) == 0) {
+					wait_while_equal(produced, done);
+					done = produced.load(std::memory_order_acquire);
+				}
+			}
+
+			/**
+			* Runs work() on the default_thread_pool until has_work() returns false, unless that's already running.
+			* Called by the stream. has_work() is also called on the stream's thread, and must be safe to call concurrently
+			* with work().
+			**/
+			template<class HasWork, class Work>
+			void start_worker(HasWork has_work, Work work) {
+				if (worker_running.load(std::memory_order_seq_cst) || !has_work()) return;
+				if (worker_running.exchange(true, std::memory_order_seq_cst)) return;
+				// the last run stopped, but may not have returned yet
+				if (worker_future.valid()) worker_future.get();
+				worker_future = default_thread_pool().submit([this, has_work, work]() {
+					for (;;) {
+						while (!stopping.load(std::memory_order_relaxed) && has_work()) {
+							work();
+							if (resume_after_block != nullptr) {
+								// hand the thread to the coroutine waiting for this block, since the pool may have only
+								// this one. It restarts the worker once it resumes.
+								pool_task* continuation = std::exchange(resume_after_block, nullptr);
+								worker_running.store(false, std::memory_order_seq_cst);
+								thread_pool_access::schedule(default_thread_pool(), continuation);
+								return;
+							}
+						}
+						worker_running.store(false, std::memory_order_seq_cst);
+						// the stream may have made more work after the last check, and seen this still running
+						if (stopping.load(std::memory_order_relaxed) || !has_work() || worker_running.exchange(true, std::memory_order_seq_cst))
+							return;
+					}
+				});
+			}
+			// Waits for the worker to run out of work.
+			void finish_worker() {
+				if (worker_future.valid()) worker_future.get();
+			}
+			// Stops the worker after the block it's on, and waits for it.
+			void stop_worker() noexcept {
+				stopping.store(true, std::memory_order_relaxed);
+				if (worker_future.valid()) worker_future.wait();
+				worker_future = task_future<void>();
+				stopping.store(false, std::memory_order_relaxed);
+			}
+			// Drops every published block. The worker must be stopped.
+			void clear() noexcept {
+				assert(!worker_running.load());
+				produced_slot_ = consumed_slot_ = 0;
+				produced.store(0, std::memory_order_relaxed);
+				consumed.store(0, std::memory_order_relaxed);
+			}
+#if __cpp_impl_coroutine && __cpp_lib_coroutine
+			// co_await suspends until the ring has a published block, and then resumes on the default_thread_pool.
+			// The worker stops after that block, so the awaiting coroutine must restart it.
+			class published_awaiter final : pool_task {
+				async_block_ring* ring;
+				std::coroutine_handle<> suspended;
+			public:
+				explicit published_awaiter(async_block_ring& ring_) noexcept : ring(&ring_) {}
+				bool await_ready() const noexcept { return !ring->empty(); }
+				bool await_suspend(std::coroutine_handle<> awaiting) noexcept {
+					suspended = awaiting;
+					assert(ring->published_continuation.load() == nullptr);
+					ring->published_continuation.store(this, std::memory_order_seq_cst);
+					// a block published before the store didn't see it. Take it back, unless that publish already did.
+					if (!ring->empty())
+						return ring->published_continuation.exchange(nullptr, std::memory_order_seq_cst) != this;
+					return true;
+				}
+				void await_resume() const noexcept {}
+				void run() noexcept override { suspended.resume(); }
+			};
+			published_awaiter when_published() noexcept { return published_awaiter(*this); }
+#endif
+		};
+	}
+}
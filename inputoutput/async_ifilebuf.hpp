@@ -3,15 +3,95 @@
 //as a heavy rewrite of  https://stackoverflow.com/a/21127776/845092
 //which was written by Dietmar Khl Jan 15 '14
 
+#include <algorithm>
+#include <cstring>
 #include <fstream>
-#include <future>
 #include <streambuf>
-#include <vector>
+#include <utility>
+#include "concurrency/task.hpp"
+#include "inputoutput/async_block_ring.hpp"
+#if defined(__unix__) || defined(__APPLE__)
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#define MPD_POSIX_INPUT_FILE 1
+#endif
 
 namespace mpd {
-// std::streambuf that pre-reads up to 4kb in a background thread for istream, so that the calling thread
-// is unlikely to stall. When reads are interlaced with cpu usage, this can greatly improve performance.
-// When reads are not interlaced with cpu usage, this will slightly hinder performance.
+	namespace impl {
+#if MPD_POSIX_INPUT_FILE
+		// The file under an async_ifilebuf: a plain descriptor, so that blocks are read straight into the ring, and the
+		// kernel is told that the file is read sequentially, so that it reads further ahead.
+		class async_input_file {
+			int fd = -1;
+		public:
+			async_input_file() noexcept = default;
+			async_input_file(async_input_file&& rhs) noexcept : fd(std::exchange(rhs.fd, -1)) {}
+			async_input_file& operator=(async_input_file&& rhs) noexcept {
+				close();
+				fd = std::exchange(rhs.fd, -1);
+				return *this;
+			}
+			~async_input_file() { close(); }
+			bool open(const char* name, std::ios_base::openmode) noexcept {
+				close();
+				fd = ::open(name, O_RDONLY | O_CLOEXEC);
+				if (fd < 0) return false;
+#ifdef POSIX_FADV_SEQUENTIAL
+				posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+				return true;
+			}
+			void close() noexcept {
+				if (fd >= 0) ::close(fd);
+				fd = -1;
+			}
+			// Reads until count chars, or the end of the file. Returns how many were read.
+			std::size_t read(char* dest, std::size_t count) noexcept {
+				std::size_t total = 0;
+				while (total < count && fd >= 0) {
+					ssize_t n = ::read(fd, dest + total, count - total);
+					if (n > 0) total += static_cast<std::size_t>(n);
+					else if (n == 0 || errno != EINTR) break;
+				}
+				return total;
+			}
+			// Returns the new position, or -1.
+			std::streamoff seek(std::streamoff off, std::ios_base::seekdir dir) noexcept {
+				if (fd < 0) return -1;
+				int whence = dir == std::ios_base::beg ? SEEK_SET : dir == std::ios_base::cur ? SEEK_CUR : SEEK_END;
+				return static_cast<std::streamoff>(::lseek(fd, static_cast<off_t>(off), whence));
+			}
+		};
+#else
+		// The file under an async_ifilebuf.
+		class async_input_file {
+			std::ifstream in;
+		public:
+			template<class Char>
+			bool open(const Char* name, std::ios_base::openmode mode) {
+				in.open(name, mode | std::ios_base::in);
+				return in.is_open();
+			}
+			void close() { in.close(); }
+			std::size_t read(char* dest, std::size_t count) {
+				in.read(dest, static_cast<std::streamsize>(count));
+				return static_cast<std::size_t>(in.gcount());
+			}
+			std::streamoff seek(std::streamoff off, std::ios_base::seekdir dir) {
+				in.clear();
+				in.seekg(off, dir);
+				return static_cast<std::streamoff>(in.tellg());
+			}
+		};
+#endif
+	}
+
+// std::streambuf that reads ahead on the default_thread_pool, into a ring of ring_depth blocks of block_size chars,
+// so that the calling thread is unlikely to stall. While the stream keeps consuming, one pool worker keeps the ring
+// full, and when the ring is full, it returns to the pool until a block is consumed.
+// When reads are interlaced with cpu usage, this can greatly improve performance. For bulk reads of big files, use
+// big blocks, such as 1MB x 4.
 // ex:
 // async_ifilebuf stream_buf(in_path.c_str(), std::ios_base::binary);
 // std::istream stream(&stream_buf);
@@ -20,27 +100,81 @@ namespace mpd {
 //     doStuff(myData);
 // }
 	struct async_ifilebuf : virtual std::streambuf {
-		const std::size_t buffer_dump_size = 4096;
+		static const std::size_t default_block_size = 64 * 1024;
+		static const std::size_t default_ring_depth = 4;
+	private:
+		impl::async_input_file in;
+		impl::async_block_ring ring;
+		// set by the worker when it reads a short block, which is the last one. The stream never releases that block.
+		std::atomic<bool> ended{false};
+		// the get area is the ring's consumed_slot
+		bool holding = false;
 
-		std::ifstream in; // TODO :replace with std::filebuf
-		std::vector<char> filling_buffer;
-		std::vector<char> dumping_buffer;
-		std::future<void> fill_future;
-
-		void worker() {
-			filling_buffer.resize(buffer_dump_size);
-			in.read(filling_buffer.data(), filling_buffer.size());
-			filling_buffer.resize(in.gcount());
+		bool has_fill_work() const noexcept { return !ended.load(std::memory_order_acquire) && !ring.full(); }
+		void fill_block() {
+			std::size_t slot = ring.produced_slot();
+			std::size_t count = in.read(ring.block(slot), ring.block_size());
+			if (count < ring.block_size())
+				ended.store(true, std::memory_order_release);
+			ring.publish(count);
+		}
+		// A file that didn't open, or seek, reads as empty. The worker must be stopped.
+		void end_with_empty_block() noexcept {
+			ended.store(true, std::memory_order_relaxed);
+			ring.publish(0);
+		}
+		void start_filling() { ring.start_worker([this]() { return has_fill_work(); }, [this]() { fill_block(); }); }
+		// Lets the worker reuse the block in the get area. Returns false if that's the last block.
+		bool release_block() noexcept {
+			if (!holding) return true;
+			if (static_cast<std::size_t>(egptr() - eback()) < ring.block_size()) return false;
+			holding = false;
+			setg(nullptr, nullptr, nullptr);
+			ring.release();
+			return true;
+		}
+		// Makes the next published block the get area.
+		void hold_block() noexcept {
+			holding = true;
+			char* block = ring.block(ring.consumed_slot());
+			setg(block, block, block + ring.block_used(ring.consumed_slot()));
+		}
+		std::streamsize take_buffered(char* dest, std::streamsize count) noexcept {
+			std::streamsize n = (std::min)(count, static_cast<std::streamsize>(egptr() - gptr()));
+			if (n <= 0) return 0;
+			std::memcpy(dest, gptr(), static_cast<std::size_t>(n));
+			setg(eback(), gptr() + n, egptr());
+			return n;
+		}
+		// Chars that were read from the file, but not yet by the stream. While the worker runs, a lower bound.
+		std::streamoff unread() const noexcept {
+			std::streamoff count = egptr() - gptr();
+			std::size_t slot = ring.consumed_slot();
+			std::size_t published = ring.published_count();
+			for (std::size_t i = holding ? 1 : 0; i < published; i++)
+				count += static_cast<std::streamoff>(ring.block_used((slot + i) % ring.depth()));
+			return count;
+		}
+		template<class Char>
+		void open(const Char* name, std::ios_base::openmode mode, std::size_t block_size, std::size_t ring_depth) {
+			ring = impl::async_block_ring(block_size, ring_depth);
+			if (in.open(name, mode))
+				start_filling();
+			else
+				end_with_empty_block();
 		}
 	public:
-		async_ifilebuf(const char* name, std::ios_base::openmode mode = std::ios_base::in) {
-			fill_future = std::async(std::launch::async, [this, name, mode]() {in.open(name, mode); worker(); });
+		explicit async_ifilebuf(const char* name, std::ios_base::openmode mode = std::ios_base::in,
+			std::size_t block_size = default_block_size, std::size_t ring_depth = default_ring_depth) {
+			open(name, mode, block_size, ring_depth);
 		}
-		async_ifilebuf(const wchar_t* name, std::ios_base::openmode mode = std::ios_base::in) {
-			fill_future = std::async(std::launch::async, [this, name, mode]() {in.open(name, mode); worker(); });
+#ifdef _MSC_VER // MSVC extension
+		explicit async_ifilebuf(const wchar_t* name, std::ios_base::openmode mode = std::ios_base::in,
+			std::size_t block_size = default_block_size, std::size_t ring_depth = default_ring_depth) {
+			open(name, mode, block_size, ring_depth);
 		}
+#endif
 		async_ifilebuf(async_ifilebuf&& rhs) noexcept {
-			rhs.sync();
 			operator=(std::move(rhs));
 		}
 		~async_ifilebuf() noexcept {
@@ -48,38 +182,114 @@ namespace mpd {
 		}
 		async_ifilebuf& operator=(async_ifilebuf&& rhs) noexcept {
 			close();
+			rhs.ring.stop_worker();
 			in = std::move(rhs.in);
-			filling_buffer = std::move(rhs.filling_buffer);
-			dumping_buffer = std::move(rhs.dumping_buffer);
-			fill_future = std::move(rhs.fill_future);
+			ring = std::move(rhs.ring);
+			ended.store(rhs.ended.load(std::memory_order_relaxed), std::memory_order_relaxed);
+			holding = std::exchange(rhs.holding, false);
+			// the blocks moved with the ring's storage
+			setg(rhs.eback(), rhs.gptr(), rhs.egptr());
+			rhs.setg(nullptr, nullptr, nullptr);
+			start_filling();
 			return *this;
 		}
+		std::size_t block_size() const noexcept { return ring.block_size(); }
+		std::size_t ring_depth() const noexcept { return ring.depth(); }
 		void close() {
-			if (fill_future.valid()) fill_future.get();
+			ring.stop_worker();
 			in.close();
 		}
 		int underflow() override {
 			char* ptr = gptr();
-			if (ptr != nullptr && ptr != egptr()) {
-				unsigned v = (unsigned) *ptr;
-				return v;
+			if (ptr != nullptr && ptr != egptr())
+				return traits_type::to_int_type(*ptr);
+			if (!release_block()) return traits_type::eof();
+			start_filling();
+			ring.wait_not_empty();
+			hold_block();
+			if (gptr() == egptr()) return traits_type::eof();
+			return traits_type::to_int_type(*gptr());
+		}
+		std::streamsize xsgetn(char_type* dest, std::streamsize count) override {
+			std::streamsize total = 0;
+			for (;;) {
+				total += take_buffered(dest + total, count - total);
+				if (total == count) return total;
+				if (static_cast<std::size_t>(count - total) >= ring.block_size()) break;
+				if (underflow() == traits_type::eof()) return total;
 			}
-			if (fill_future.valid()) fill_future.get();
-			dumping_buffer.swap(filling_buffer);
-			if (filling_buffer.empty() && in.eof()) return std::char_traits<char>::eof();
-			if (!dumping_buffer.empty()) 
-				fill_future = std::async(std::launch::async, [this]() { worker(); });
-			setg(dumping_buffer.data(), dumping_buffer.data(), dumping_buffer.data() + dumping_buffer.size());
-			return (unsigned) *dumping_buffer.data();
+			// a read of a block or more skips the ring: the blocks that were already read come first, and then the rest
+			// is read straight into dest
+			ring.stop_worker();
+			for (;;) {
+				if (!release_block()) return total;
+				if (ring.empty()) break;
+				hold_block();
+				total += take_buffered(dest + total, count - total);
+				if (total == count) {
+					start_filling();
+					return total;
+				}
+			}
+			std::size_t wanted = static_cast<std::size_t>(count - total);
+			std::size_t got = in.read(dest + total, wanted);
+			total += static_cast<std::streamsize>(got);
+			if (got == wanted)
+				start_filling();
+			else
+				end_with_empty_block();
+			return total;
+		}
+		// Chars that can be read without waiting, or -1 at the end of the file.
+		std::streamsize showmanyc() override {
+			std::streamoff count = unread();
+			if (count == 0 && holding && static_cast<std::size_t>(egptr() - eback()) < ring.block_size())
+				return -1;
+			return static_cast<std::streamsize>(count);
 		}
+#if __cpp_impl_coroutine && __cpp_lib_coroutine
+		// Copies up to count buffered chars to dest, and returns how many, or 0 at the end of the file.
+		// If no block is ready, suspends the coroutine until the worker publishes one, rather than blocking.
+		task<std::streamsize> read_some(char* dest, std::streamsize count) {
+			if (gptr() == egptr()) {
+				if (!release_block()) co_return 0;
+				start_filling();
+				if (ring.empty()) {
+					co_await ring.when_published();
+					start_filling();
+				}
+				if (underflow() == traits_type::eof()) co_return 0;
+			}
+			co_return take_buffered(dest, count);
+		}
+#endif
 		pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode = std::ios_base::in) override {
-			if (fill_future.valid()) fill_future.get();
-			fill_future = std::async(std::launch::async, [this, off, dir]() { in.seekg(off, dir);  worker(); });
-			setg(dumping_buffer.data(), dumping_buffer.data(), dumping_buffer.data());
-			return in.tellg();
+			ring.stop_worker();
+			if (dir == std::ios_base::cur) {
+				std::streamoff pos = in.seek(0, std::ios_base::cur);
+				if (pos < 0) return pos_type(off_type(-1));
+				pos -= unread();
+				// tellg() doesn't need to drop the blocks that were already read
+				if (off == 0) {
+					start_filling();
+					return pos_type(pos);
+				}
+				off += pos;
+				dir = std::ios_base::beg;
+			}
+			holding = false;
+			setg(nullptr, nullptr, nullptr);
+			ring.clear();
+			std::streamoff pos = in.seek(off, dir);
+			ended.store(false, std::memory_order_relaxed);
+			if (pos >= 0)
+				start_filling();
+			else
+				end_with_empty_block();
+			return pos_type(pos);
 		}
 		pos_type seekpos(pos_type pos, std::ios_base::openmode which = std::ios_base::in) override {
 			return seekoff(pos, std::ios_base::beg, which);
 		}
 	};
-}
\ No newline at end of file
+}
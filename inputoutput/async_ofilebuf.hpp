@@ -3,16 +3,19 @@
 //as a heavy rewrite of  https://stackoverflow.com/a/21127776/845092
 //which was written by Dietmar Kühl Jan 15 '14
 
+#include <algorithm>
+#include <cstring>
 #include <fstream>
-#include <future>
 #include <iomanip>
 #include <streambuf>
-#include <vector>
+#include <utility>
+#include "inputoutput/async_block_ring.hpp"
 
 namespace mpd {
-// std::streambuf that pre-reads up to 4kb in a background thread for istream, so that the calling thread
-// is unlikely to stall. When reads are interlaced with cpu usage, this can greatly improve performance.
-// When reads are not interlaced with cpu usage, this will slightly hinder performance.
+// std::streambuf that writes on the default_thread_pool, from a ring of ring_depth blocks of block_size chars, so that
+// the calling thread only stalls when every block is waiting for the disk. While the stream keeps producing, one pool
+// worker keeps writing, and when the ring is empty, it returns to the pool until a block is filled.
+// When writes are interlaced with cpu usage, this can greatly improve performance. For bulk writes, use big blocks.
 // ex:
 // MyClass myData;
 // async_ofilebuf stream_buf(in_path.c_str(), std::ios_base::binary);
@@ -21,42 +24,50 @@ namespace mpd {
 //   stream << myData.calculateStuff() << '\n';
 // }
 	struct async_ofilebuf : virtual std::streambuf {
-		const std::size_t buffer_dump_size = 4096;
-
+		static const std::size_t default_block_size = 64 * 1024;
+		static const std::size_t default_ring_depth = 4;
+	private:
 		std::ofstream out; // TODO :replace with std::filebuf
-		std::vector<char> filling_buffer;
-		std::vector<char> dumping_buffer;
-		std::future<void> dump_future;
+		impl::async_block_ring ring;
 
-		void worker() {
-			out.write(dumping_buffer.data(), dumping_buffer.size());
-			dumping_buffer.clear();
+		bool has_write_work() const noexcept { return !ring.empty(); }
+		void write_block() {
+			std::size_t slot = ring.consumed_slot();
+			out.write(ring.block(slot), static_cast<std::streamsize>(ring.block_used(slot)));
+			ring.release();
 		}
-
+		void start_writing() { ring.start_worker([this]() { return has_write_work(); }, [this]() { write_block(); }); }
+		void start_block() {
+			char* block = ring.block(ring.produced_slot());
+			setp(block, block + ring.block_size());
+		}
+		// Hands the put area to the worker, and waits for a free block to put into.
 		void dump() {
 			std::size_t filling_count = std::size_t(pptr() - pbase());
-			if (filling_count == 0 && !dump_future.valid()) return;
-			filling_buffer.resize(filling_count);
-			if (dump_future.valid()) dump_future.get();
-			filling_buffer.swap(dumping_buffer);
-			if (!dumping_buffer.empty()) 
-				dump_future = std::async(std::launch::async, [this]() {worker(); });
-			filling_buffer.resize(buffer_dump_size);
-			setp(filling_buffer.data(), filling_buffer.data() + filling_buffer.size() - 1);
+			if (filling_count == 0) return;
+			ring.publish(filling_count);
+			start_writing();
+			ring.wait_not_full();
+			start_block();
+		}
+		template<class Char>
+		void open(const Char* name, std::ios_base::openmode mode, std::size_t block_size, std::size_t ring_depth) {
+			ring = impl::async_block_ring(block_size, ring_depth);
+			out.open(name, mode);
+			start_block();
 		}
 	public:
-		async_ofilebuf(const char* name, std::ios_base::openmode mode = std::ios_base::out)
-			: filling_buffer(buffer_dump_size) {
-			setp(filling_buffer.data(), filling_buffer.data() + filling_buffer.size() - 1);
-			dump_future = std::async(std::launch::async, [this, name, mode]() {out.open(name, mode); });
+		explicit async_ofilebuf(const char* name, std::ios_base::openmode mode = std::ios_base::out,
+			std::size_t block_size = default_block_size, std::size_t ring_depth = default_ring_depth) {
+			open(name, mode, block_size, ring_depth);
 		}
-		async_ofilebuf(const wchar_t* name, std::ios_base::openmode mode = std::ios_base::out)
-			: filling_buffer(buffer_dump_size) {
-			setp(filling_buffer.data(), filling_buffer.data() + filling_buffer.size() - 1);
-			dump_future = std::async(std::launch::async, [this, name, mode]() {out.open(name, mode); });
+#ifdef _MSC_VER // MSVC extension
+		explicit async_ofilebuf(const wchar_t* name, std::ios_base::openmode mode = std::ios_base::out,
+			std::size_t block_size = default_block_size, std::size_t ring_depth = default_ring_depth) {
+			open(name, mode, block_size, ring_depth);
 		}
+#endif
 		async_ofilebuf(async_ofilebuf&& rhs) noexcept {
-			rhs.sync();
 			operator=(std::move(rhs));
 		}
 		~async_ofilebuf() noexcept {
@@ -66,11 +77,13 @@ namespace mpd {
 			close();
 			rhs.sync();
 			out = std::move(rhs.out);
-			filling_buffer = std::move(rhs.filling_buffer);
-			dumping_buffer = std::move(rhs.dumping_buffer);
-			dump_future = std::move(rhs.dump_future);
+			ring = std::move(rhs.ring);
+			start_block();
+			rhs.setp(nullptr, nullptr);
 			return *this;
 		}
+		std::size_t block_size() const noexcept { return ring.block_size(); }
+		std::size_t ring_depth() const noexcept { return ring.depth(); }
 		void close() {
 			sync();
 			out.close();
@@ -86,23 +99,39 @@ namespace mpd {
 				return c;
 			}
 		}
+		std::streamsize xsputn(const char_type* src, std::streamsize count) override {
+			if (static_cast<std::size_t>(count) >= ring.block_size()) {
+				// a write of a block or more skips the ring, once the blocks before it are written
+				dump();
+				ring.finish_worker();
+				out.write(src, count);
+				return out ? count : 0;
+			}
+			std::streamsize total = 0;
+			while (total < count) {
+				if (pptr() == epptr()) dump();
+				std::streamsize n = (std::min)(count - total, static_cast<std::streamsize>(epptr() - pptr()));
+				std::memcpy(pptr(), src + total, static_cast<std::size_t>(n));
+				pbump(static_cast<int>(n));
+				total += n;
+			}
+			return total;
+		}
 		int sync() override {
+			if (ring.depth() == 0) return 0;
 			dump();
-			if (dump_future.valid()) dump_future.get();
+			ring.finish_worker();
 			out.flush();
 			return 0;
 		}
 		pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode = std::ios_base::out) override {
-			dump(); // initiate dump of any pending writes
-			dump_future = std::async(std::launch::async, [this, off, dir, old_dump_future=std::move(dump_future)]() mutable {
-				if (old_dump_future.valid()) old_dump_future.get(); // once that's done, THEN seek, but we don't have to block calling thread for that
-				out.seekp(off, dir); 
-			});
-			setp(dumping_buffer.data(), dumping_buffer.data(), dumping_buffer.data());
+			sync();
+			if (off != 0 || dir != std::ios_base::cur)
+				out.seekp(off, dir);
 			return out.tellp();
 		}
 		pos_type seekpos(pos_type pos, std::ios_base::openmode which = std::ios_base::out) override {
 			return seekoff(pos, std::ios_base::beg, which);
 		}
 	};
-}
\ No newline at end of file
+}
@@ -0,0 +1,113 @@
+#pragma once
+#include <cassert>
+#include <cstddef>
+#include <iterator>
+#include <type_traits>
+#include "memory/offset_ptr.hpp"
+
+namespace mpd {
+	/**
+	* A forward iterator that walks a singly linked chain of nodes, following the offset_ptr member `next`.
+	* A default constructed iterator is the end of every chain.
+	* ex:
+	* struct node { int value; mpd::offset_ptr<node> next; };
+	* using node_iterator = mpd::offset_link_iterator<node, &node::next>;
+	* for (auto it = node_iterator(head); it != node_iterator(); ++it) ...
+	**/
+	template<class Node, offset_ptr<Node> Node::*next>
+	class offset_link_iterator {
+		Node* node;
+	public:
+		using value_type = Node;
+		using difference_type = std::ptrdiff_t;
+		using pointer = Node*;
+		using reference = Node&;
+		using iterator_category = std::forward_iterator_tag;
+
+		offset_link_iterator() noexcept : node(nullptr) {}
+		explicit offset_link_iterator(Node* first) noexcept : node(first) {}
+
+		reference operator*() const noexcept { assert(node); return *node; }
+		pointer operator->() const noexcept { assert(node); return node; }
+		offset_link_iterator& operator++() noexcept { assert(node); node = (node->*next).get(); return *this; }
+		offset_link_iterator operator++(int) noexcept { offset_link_iterator r(*this); ++*this; return r; }
+
+		friend bool operator==(const offset_link_iterator& l, const offset_link_iterator& r) noexcept { return l.node == r.node; }
+		friend bool operator!=(const offset_link_iterator& l, const offset_link_iterator& r) noexcept { return l.node != r.node; }
+	};
+
+	/**
+	* A forward iterator that walks a singly linked chain of nodes in an array, following the arena_index member `next`.
+	* Holds the array base, so it's two pointers wide, but the links in the nodes are only 4 bytes.
+	* A default constructed iterator is the end of every chain.
+	**/
+	template<class Node, arena_index<Node> Node::*next>
+	class index_link_iterator {
+		Node* base;
+		arena_index<Node> current;
+	public:
+		using value_type = Node;
+		using difference_type = std::ptrdiff_t;
+		using pointer = Node*;
+		using reference = Node&;
+		using iterator_category = std::forward_iterator_tag;
+
+		index_link_iterator() noexcept : base(nullptr), current() {}
+		index_link_iterator(Node* base_, arena_index<Node> first) noexcept : base(base_), current(first) {}
+
+		arena_index<Node> index() const noexcept { return current; }
+		reference operator*() const noexcept { return current.in(base); }
+		pointer operator->() const noexcept { return &current.in(base); }
+		index_link_iterator& operator++() noexcept { current = current.in(base).*next; return *this; }
+		index_link_iterator operator++(int) noexcept { index_link_iterator r(*this); ++*this; return r; }
+
+		friend bool operator==(const index_link_iterator& l, const index_link_iterator& r) noexcept { return l.current == r.current; }
+		friend bool operator!=(const index_link_iterator& l, const index_link_iterator& r) noexcept { return l.current != r.current; }
+	};
+
+	/**
+	* Adapts an iterator over arena_index<T>s (such as an adjacency list) into an iterator over the referenced Ts.
+	* Has the same category as the underlying iterator.
+	* ex:
+	* for (auto it = mpd::index_deref_iter(vertices.data(), edges.begin()); ...)
+	**/
+	template<class T, class IndexIterator>
+	class index_deref_iterator {
+		T* base;
+		IndexIterator it;
+	public:
+		using value_type = std::remove_const_t<T>;
+		using difference_type = typename std::iterator_traits<IndexIterator>::difference_type;
+		using pointer = T*;
+		using reference = T&;
+		using iterator_category = typename std::iterator_traits<IndexIterator>::iterator_category;
+
+		index_deref_iterator() noexcept : base(nullptr), it() {}
+		index_deref_iterator(T* base_, IndexIterator it_) noexcept : base(base_), it(it_) {}
+
+		IndexIterator index_iterator() const noexcept { return it; }
+		reference operator*() const noexcept { return it->in(base); }
+		pointer operator->() const noexcept { return &it->in(base); }
+		reference operator[](difference_type o) const noexcept { return it[o].in(base); }
+
+		index_deref_iterator& operator++() noexcept { ++it; return *this; }
+		index_deref_iterator operator++(int) noexcept { return {base, it++}; }
+		index_deref_iterator& operator--() noexcept { --it; return *this; }
+		index_deref_iterator operator--(int) noexcept { return {base, it--}; }
+		index_deref_iterator& operator+=(difference_type o) noexcept { it += o; return *this; }
+		index_deref_iterator& operator-=(difference_type o) noexcept { it -= o; return *this; }
+		friend index_deref_iterator operator+(const index_deref_iterator& l, difference_type o) noexcept { return {l.base, l.it + o}; }
+		friend index_deref_iterator operator+(difference_type o, const index_deref_iterator& r) noexcept { return {r.base, r.it + o}; }
+		friend index_deref_iterator operator-(const index_deref_iterator& l, difference_type o) noexcept { return {l.base, l.it - o}; }
+		friend difference_type operator-(const index_deref_iterator& l, const index_deref_iterator& r) noexcept { return l.it - r.it; }
+
+		friend bool operator==(const index_deref_iterator& l, const index_deref_iterator& r) noexcept { return l.it == r.it; }
+		friend bool operator!=(const index_deref_iterator& l, const index_deref_iterator& r) noexcept { return l.it != r.it; }
+		friend bool operator<(const index_deref_iterator& l, const index_deref_iterator& r) noexcept { return l.it < r.it; }
+		friend bool operator>(const index_deref_iterator& l, const index_deref_iterator& r) noexcept { return l.it > r.it; }
+		friend bool operator<=(const index_deref_iterator& l, const index_deref_iterator& r) noexcept { return l.it <= r.it; }
+		friend bool operator>=(const index_deref_iterator& l, const index_deref_iterator& r) noexcept { return l.it >= r.it; }
+	};
+	template<class T, class IndexIterator>
+	index_deref_iterator<T, IndexIterator> index_deref_iter(T* base, IndexIterator it) noexcept { return {base, it}; }
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include <cstddef>
+#include <limits>
+#include <new>
+#include <type_traits>
+#if __has_include(<version>)
+#include <version>
+#endif
+
+namespace mpd {
+	// The distance that two objects should be apart, to avoid false sharing. MSVC's std value is 64 for all targets.
+	// GCC warns when its value is used in headers, since it varies by -mtune, so everywhere else this is hardcoded.
+#if defined(_MSC_VER) && __cpp_lib_hardware_interference_size
+	constexpr std::size_t hardware_destructive_interference_size = std::hardware_destructive_interference_size;
+#elif defined(__aarch64__) && defined(__APPLE__)
+	constexpr std::size_t hardware_destructive_interference_size = 128;
+#else
+	constexpr std::size_t hardware_destructive_interference_size = 64;
+#endif
+	constexpr std::size_t cache_line_size = 64;
+	constexpr std::size_t page_size = 4096;
+
+	/**
+	* A stateless standard-conforming allocator whose allocations are aligned to at least `alignment` bytes, and padded
+	* to a multiple of `alignment` bytes, so that no other allocation shares the first or last cache line (or page).
+	* This is what makes the `alignment` parameter of `dynamic_buffer` safe to use with more than `alignof(T)`.
+	* ex:
+	* mpd::dynamic_buffer<float, mpd::aligned_allocator<float, 64>, mpd::overflow_behavior_t::exception, 64> samples(...);
+	**/
+	template<class T, std::size_t alignment = cache_line_size>
+	class aligned_allocator {
+		static_assert(alignment != 0 && (alignment & (alignment - 1)) == 0, "alignment must be a power of two");
+		static const std::size_t alloc_alignment = alignment > alignof(T) ? alignment : alignof(T);
+		static std::size_t padded_bytes(std::size_t count) noexcept { return (count * sizeof(T) + alloc_alignment - 1) / alloc_alignment * alloc_alignment; }
+	public:
+		using pointer = T*;
+		using const_pointer = const T*;
+		using void_pointer = void*;
+		using const_void_pointer = const void*;
+		using value_type = T;
+		using size_type = std::size_t;
+		using difference_type = std::ptrdiff_t;
+		using propagate_on_container_copy_assignment = std::false_type;
+		using propagate_on_container_move_assignment = std::true_type;
+		using propagate_on_container_swap = std::false_type;
+		using is_always_equal = std::true_type;
+		template <class U> struct rebind { using other = aligned_allocator<U, alignment>; };
+
+		aligned_allocator() noexcept {}
+		template<class U>
+		aligned_allocator(const aligned_allocator<U, alignment>&) noexcept {}
+
+		pointer allocate(std::size_t count) {
+			if (count > max_size()) throw std::bad_array_new_length();
+			return static_cast<pointer>(::operator new(padded_bytes(count), std::align_val_t(alloc_alignment)));
+		}
+		pointer allocate(std::size_t count, const_void_pointer) { return allocate(count); }
+		void deallocate(pointer ptr, std::size_t) noexcept { ::operator delete(ptr, std::align_val_t(alloc_alignment)); }
+		std::size_t max_size() const noexcept { return (std::numeric_limits<std::size_t>::max() - alloc_alignment) / sizeof(T); }
+
+		template<class U>
+		bool operator==(const aligned_allocator<U, alignment>&) const noexcept { return true; }
+		template<class U>
+		bool operator!=(const aligned_allocator<U, alignment>&) const noexcept { return false; }
+	};
+
+	template<class T>
+	using cache_aligned_allocator = aligned_allocator<T, cache_line_size>;
+	template<class T>
+	using page_aligned_allocator = aligned_allocator<T, page_size>;
+}
@@ -0,0 +1,214 @@
+#pragma once
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#if __has_include(<memory_resource>)
+#include <memory_resource>
+#endif
+#include "utilities/macros.hpp"
+
+namespace mpd {
+	/**
+	* A bump-pointer arena. Allocation is a pointer bump, deallocation is a no-op, and `reset` releases
+	* everything at once.
+	*
+	* The arena starts in an optional caller-provided buffer (usually on the stack), and when that's exhausted
+	* it grows geometrically into heap chunks. `reset` rewinds to the initial buffer in constant time, but
+	* keeps the heap chunks, so that an arena that is reset per-request stops touching the heap entirely
+	* once it has warmed up. `release` returns the heap chunks.
+	**/
+	class monotonic_arena {
+		struct chunk_header {
+			chunk_header* next;
+			std::size_t size_bytes;
+			char* begin() noexcept { return reinterpret_cast<char*>(this + 1); }
+			char* end() noexcept { return begin() + size_bytes; }
+		};
+
+		char* initial_buffer;
+		std::size_t initial_size;
+		char* cur;
+		char* last;
+		chunk_header* first_chunk; // all heap chunks, in the order they were allocated
+		chunk_header* last_chunk;
+		chunk_header* current_chunk; // nullptr when still in the initial buffer
+		std::size_t first_chunk_size;
+		std::size_t next_chunk_size;
+		std::size_t chunk_bytes_total;
+
+		// bumps cur past an aligned allocation, or returns nullptr if it doesn't fit before last.
+		// Compares sizes rather than pointers, since a pointer past last is undefined behavior.
+		char* bump(std::size_t bytes, std::size_t alignment) noexcept {
+			std::size_t room = static_cast<std::size_t>(last - cur);
+			std::size_t padding = (alignment - reinterpret_cast<std::uintptr_t>(cur) % alignment) % alignment;
+			if (padding > room || bytes > room - padding) return nullptr;
+			char* ptr = cur + padding;
+			cur = ptr + bytes;
+			return ptr;
+		}
+		void enter(chunk_header* chunk) noexcept {
+			current_chunk = chunk;
+			cur = chunk->begin();
+			last = chunk->end();
+		}
+		MPD_NOINLINE(void*) allocate_slow(std::size_t bytes, std::size_t alignment) {
+			// reuse chunks retained by a previous reset before going to the heap.
+			chunk_header* next = current_chunk ? current_chunk->next : first_chunk;
+			for (; next != nullptr; next = next->next) {
+				enter(next);
+				if (char* ptr = bump(bytes, alignment))
+					return ptr;
+			}
+			if (bytes > std::size_t(-1) - sizeof(chunk_header) - alignment) throw std::bad_alloc();
+			std::size_t want = bytes + alignment;
+			std::size_t size = next_chunk_size > want ? next_chunk_size : want;
+			chunk_header* chunk = static_cast<chunk_header*>(::operator new(sizeof(chunk_header) + size));
+			chunk->next = nullptr;
+			chunk->size_bytes = size;
+			if (last_chunk) last_chunk->next = chunk;
+			else first_chunk = chunk;
+			last_chunk = chunk;
+			chunk_bytes_total += size;
+			next_chunk_size *= 2;
+			enter(chunk);
+			char* ptr = bump(bytes, alignment);
+			assume(ptr != nullptr);
+			return ptr;
+		}
+	public:
+		static const std::size_t default_chunk_size = 4096;
+
+		// a position in the arena, that the arena can later be rewound to.
+		class marker {
+			friend class monotonic_arena;
+			chunk_header* chunk;
+			char* cur;
+			marker(chunk_header* chunk_, char* cur_) noexcept : chunk(chunk_), cur(cur_) {}
+		};
+
+		// Arena that starts allocating from the buffer, and falls back to heap chunks of at least first_chunk_size bytes.
+		monotonic_arena(void* buffer, std::size_t buffer_size, std::size_t first_chunk_size_ = default_chunk_size) noexcept
+			: initial_buffer(static_cast<char*>(buffer)), initial_size(buffer_size)
+			, cur(initial_buffer), last(initial_buffer + buffer_size)
+			, first_chunk(nullptr), last_chunk(nullptr), current_chunk(nullptr)
+			, first_chunk_size(first_chunk_size_ ? first_chunk_size_ : default_chunk_size)
+			, next_chunk_size(first_chunk_size), chunk_bytes_total(0) {}
+		explicit monotonic_arena(std::size_t first_chunk_size_ = default_chunk_size) noexcept
+			: monotonic_arena(nullptr, 0, first_chunk_size_) {}
+		monotonic_arena(const monotonic_arena&) = delete;
+		monotonic_arena& operator=(const monotonic_arena&) = delete;
+		~monotonic_arena() { release(); }
+
+		void* raw_allocate(std::size_t bytes, std::size_t alignment = alignof(std::max_align_t)) {
+			assert(alignment != 0 && (alignment & (alignment - 1)) == 0);
+			if (char* ptr = bump(bytes, alignment)) { [[likely]] return ptr; }
+			return allocate_slow(bytes, alignment);
+		}
+		// individual deallocations are ignored, except that the most recent allocation can be rolled back.
+		void raw_deallocate(void* ptr, std::size_t bytes) noexcept {
+			if (static_cast<char*>(ptr) + bytes == cur) cur = static_cast<char*>(ptr);
+		}
+		// rewinds to the initial buffer in constant time. Heap chunks are kept for reuse.
+		void reset() noexcept {
+			current_chunk = nullptr;
+			cur = initial_buffer;
+			last = initial_buffer + initial_size;
+		}
+		marker mark() const noexcept { return marker(current_chunk, cur); }
+		// releases everything allocated since the marker was taken. Heap chunks are kept for reuse.
+		void rewind(marker m) noexcept {
+			current_chunk = m.chunk;
+			cur = m.cur;
+			last = current_chunk ? current_chunk->end() : initial_buffer + initial_size;
+		}
+		// rewinds to the initial buffer, and returns all heap chunks.
+		void release() noexcept {
+			reset();
+			while (first_chunk) {
+				chunk_header* next = first_chunk->next;
+				::operator delete(first_chunk);
+				first_chunk = next;
+			}
+			last_chunk = nullptr;
+			next_chunk_size = first_chunk_size;
+			chunk_bytes_total = 0;
+		}
+		// bytes of heap memory currently owned by the arena
+		std::size_t heap_bytes() const noexcept { return chunk_bytes_total; }
+		// bytes of the initial buffer in use. All of it, once the arena has moved on to heap chunks.
+		std::size_t initial_bytes_used() const noexcept { return current_chunk ? initial_size : static_cast<std::size_t>(cur - initial_buffer); }
+		// bytes remaining in the current block before the arena has to move to another chunk
+		std::size_t remaining_bytes() const noexcept { return static_cast<std::size_t>(last - cur); }
+		bool owns(const void* ptr) const noexcept {
+			const char* p = static_cast<const char*>(ptr);
+			if (p >= initial_buffer && p < initial_buffer + initial_size) return true;
+			for (chunk_header* c = first_chunk; c != nullptr; c = c->next)
+				if (p >= c->begin() && p < c->end()) return true;
+			return false;
+		}
+	};
+
+	// A monotonic_arena that is its own initial buffer. Like local_allocator, this is intended to live on the stack.
+	template<std::size_t buffer_bytes, std::size_t alignment = alignof(std::max_align_t)>
+	class local_arena : public monotonic_arena {
+		alignas(alignment) char buffer[buffer_bytes];
+	public:
+		explicit local_arena(std::size_t first_chunk_size = buffer_bytes * 2) noexcept
+			: monotonic_arena(buffer, buffer_bytes, first_chunk_size) {}
+	};
+
+	// One pointer, allocates from the referenced monotonic_arena. deallocate is (nearly) a no-op.
+	template<class T>
+	class arena_allocator {
+		template<class U> friend class arena_allocator;
+		monotonic_arena* arena;
+	public:
+		using pointer = T*;
+		using const_pointer = const T*;
+		using void_pointer = void*;
+		using const_void_pointer = const void*;
+		using value_type = T;
+		using size_type = std::size_t;
+		using difference_type = std::ptrdiff_t;
+		using propagate_on_container_copy_assignment = std::true_type;
+		using propagate_on_container_move_assignment = std::true_type;
+		using propagate_on_container_swap = std::true_type;
+		using is_always_equal = std::false_type;
+		template <class U> struct rebind { using other = arena_allocator<U>; };
+
+		arena_allocator(monotonic_arena& arena_) noexcept : arena(&arena_) {}
+		template<class U>
+		arena_allocator(const arena_allocator<U>& rhs) noexcept : arena(rhs.arena) {}
+		arena_allocator select_on_container_copy_construction() const noexcept { return *this; }
+
+		pointer allocate(std::size_t count) { return static_cast<pointer>(arena->raw_allocate(count * sizeof(T), alignof(T))); }
+		pointer allocate(std::size_t count, const_void_pointer) { return allocate(count); }
+		void deallocate(pointer ptr, std::size_t count) noexcept { arena->raw_deallocate(ptr, count * sizeof(T)); }
+		std::size_t max_size() const noexcept { return std::size_t(-1) / sizeof(T); }
+		monotonic_arena& resource() const noexcept { return *arena; }
+
+		template<class U>
+		bool operator==(const arena_allocator<U>& rhs) const noexcept { return arena == rhs.arena; }
+		template<class U>
+		bool operator!=(const arena_allocator<U>& rhs) const noexcept { return arena != rhs.arena; }
+	};
+
+#if __cpp_lib_memory_resource
+	// Exposes a monotonic_arena as a std::pmr::memory_resource, for std::pmr containers.
+	class arena_memory_resource : public std::pmr::memory_resource {
+		monotonic_arena* arena;
+	public:
+		arena_memory_resource(monotonic_arena& arena_) noexcept : arena(&arena_) {}
+		monotonic_arena& arena_resource() const noexcept { return *arena; }
+	protected:
+		void* do_allocate(std::size_t bytes, std::size_t alignment) override { return arena->raw_allocate(bytes, alignment); }
+		void do_deallocate(void* ptr, std::size_t bytes, std::size_t) override { arena->raw_deallocate(ptr, bytes); }
+		bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+			const arena_memory_resource* rhs = dynamic_cast<const arena_memory_resource*>(&other);
+			return rhs != nullptr && rhs->arena == arena;
+		}
+	};
+#endif
+}
@@ -0,0 +1,156 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include "memory/aligned_allocator.hpp"
+
+namespace mpd {
+	/**
+	* A fixed number of fixed size blocks, that any thread can allocate, and any thread can free, without locks.
+	*
+	* The free blocks form a Treiber stack. The head packs the index of the top block with a version counter that is
+	* bumped on every push and pop, so a pop that read a stale head (the ABA problem) fails its compare-exchange instead
+	* of corrupting the list. The links live beside the blocks rather than inside them, so a racing pop never reads a
+	* block that another thread has already been handed.
+	* ex:
+	* mpd::concurrent_block_pool pool(sizeof(message), 4096);
+	* message* m = new(pool.allocate()) message(...); // producer thread
+	* m->~message(); pool.deallocate(m); // consumer thread
+	**/
+	class concurrent_block_pool {
+		static const std::uint32_t null_index = 0xFFFFFFFFu;
+		static std::uint64_t pack(std::uint64_t version, std::uint32_t index) noexcept { return (version << 32) | index; }
+		static std::uint32_t index_of(std::uint64_t head) noexcept { return static_cast<std::uint32_t>(head); }
+		static std::uint64_t version_of(std::uint64_t head) noexcept { return head >> 32; }
+
+		std::size_t block_bytes;
+		std::size_t alignment;
+		std::uint32_t count;
+		char* blocks;
+		std::unique_ptr<std::atomic<std::uint32_t>[]> links;
+		// last and aligned, so it has a cache line to itself
+		alignas(hardware_destructive_interference_size) std::atomic<std::uint64_t> head;
+
+		std::uint32_t index_of_block(const void* block) const noexcept {
+			assert(owns(block));
+			std::size_t offset = static_cast<std::size_t>(static_cast<const char*>(block) - blocks);
+			assert(offset % block_bytes == 0);
+			return static_cast<std::uint32_t>(offset / block_bytes);
+		}
+	public:
+		concurrent_block_pool(std::size_t block_size_bytes, std::size_t block_count, std::size_t block_alignment = alignof(std::max_align_t))
+			: block_bytes((std::max)(block_size_bytes, std::size_t(1)))
+			, alignment(block_alignment)
+			, count(static_cast<std::uint32_t>(block_count))
+			, blocks(nullptr)
+			, links(new std::atomic<std::uint32_t>[block_count])
+			, head(pack(0, block_count ? 0 : null_index))
+		{
+			assert(block_count < null_index);
+			assert(block_alignment != 0 && (block_alignment & (block_alignment - 1)) == 0);
+			block_bytes = (block_bytes + alignment - 1) / alignment * alignment;
+			blocks = static_cast<char*>(::operator new(block_bytes * count, std::align_val_t(alignment)));
+			for (std::uint32_t i = 0; i < count; i++)
+				links[i].store(i + 1 < count ? i + 1 : null_index, std::memory_order_relaxed);
+		}
+		concurrent_block_pool(const concurrent_block_pool&) = delete;
+		concurrent_block_pool& operator=(const concurrent_block_pool&) = delete;
+		~concurrent_block_pool() {
+			::operator delete(blocks, std::align_val_t(alignment));
+		}
+
+		// nullptr if every block is in use
+		void* try_allocate() noexcept {
+			std::uint64_t old_head = head.load(std::memory_order_acquire);
+			for (;;) {
+				std::uint32_t index = index_of(old_head);
+				if (index == null_index) { [[unlikely]] return nullptr; }
+				// if another thread popped this block first, then this link may be stale, but the version check catches it
+				std::uint32_t next = links[index].load(std::memory_order_relaxed);
+				if (head.compare_exchange_weak(old_head, pack(version_of(old_head) + 1, next),
+					std::memory_order_acquire, std::memory_order_acquire)) { [[likely]]
+					return blocks + std::size_t(index) * block_bytes;
+				}
+			}
+		}
+		void* allocate() {
+			void* block = try_allocate();
+			if (block == nullptr) throw std::bad_alloc();
+			return block;
+		}
+		void deallocate(void* block) noexcept {
+			std::uint32_t index = index_of_block(block);
+			std::uint64_t old_head = head.load(std::memory_order_relaxed);
+			do {
+				links[index].store(index_of(old_head), std::memory_order_relaxed);
+			} while (!head.compare_exchange_weak(old_head, pack(version_of(old_head) + 1, index),
+				std::memory_order_release, std::memory_order_relaxed));
+		}
+		bool owns(const void* ptr) const noexcept {
+			const char* p = static_cast<const char*>(ptr);
+			return p >= blocks && p < blocks + block_bytes * count;
+		}
+		std::size_t block_size() const noexcept { return block_bytes; }
+		std::size_t block_alignment() const noexcept { return alignment; }
+		std::size_t capacity() const noexcept { return count; }
+		// Walks the free list. Only accurate if no other thread is using the pool.
+		std::size_t unsafe_free_count() const noexcept {
+			std::size_t free_count = 0;
+			for (std::uint32_t i = index_of(head.load(std::memory_order_acquire)); i != null_index; i = links[i].load(std::memory_order_relaxed))
+				++free_count;
+			return free_count;
+		}
+	};
+
+	// A standard-conforming allocator for single objects from a concurrent_block_pool. Array allocations, and objects
+	// that don't fit in a block, go to the heap instead. Copies may be used from any thread.
+	template<class T>
+	class concurrent_pool_allocator {
+		template<class U> friend class concurrent_pool_allocator;
+		concurrent_block_pool* pool;
+		bool fits(std::size_t count) const noexcept {
+			return count == 1 && sizeof(T) <= pool->block_size() && alignof(T) <= pool->block_alignment();
+		}
+	public:
+		using pointer = T*;
+		using const_pointer = const T*;
+		using void_pointer = void*;
+		using const_void_pointer = const void*;
+		using value_type = T;
+		using size_type = std::size_t;
+		using difference_type = std::ptrdiff_t;
+		using propagate_on_container_copy_assignment = std::true_type;
+		using propagate_on_container_move_assignment = std::true_type;
+		using propagate_on_container_swap = std::true_type;
+		using is_always_equal = std::false_type;
+		template <class U> struct rebind { using other = concurrent_pool_allocator<U>; };
+
+		concurrent_pool_allocator(concurrent_block_pool& pool_) noexcept : pool(&pool_) {}
+		template<class U>
+		concurrent_pool_allocator(const concurrent_pool_allocator<U>& rhs) noexcept : pool(rhs.pool) {}
+
+		pointer allocate(std::size_t count) {
+			void* block = fits(count) ? pool->try_allocate() : nullptr;
+			if (block) { [[likely]] return static_cast<pointer>(block); }
+			if (count > max_size()) throw std::bad_array_new_length();
+			return static_cast<pointer>(::operator new(count * sizeof(T), std::align_val_t(alignof(T))));
+		}
+		pointer allocate(std::size_t count, const_void_pointer) { return allocate(count); }
+		void deallocate(pointer ptr, std::size_t) noexcept {
+			if (pool->owns(ptr)) { [[likely]] pool->deallocate(ptr); }
+			else ::operator delete(ptr, std::align_val_t(alignof(T)));
+		}
+		std::size_t max_size() const noexcept { return std::numeric_limits<std::size_t>::max() / sizeof(T); }
+
+		template<class U>
+		bool operator==(const concurrent_pool_allocator<U>& rhs) const noexcept { return pool == rhs.pool; }
+		template<class U>
+		bool operator!=(const concurrent_pool_allocator<U>& rhs) const noexcept { return pool != rhs.pool; }
+	};
+}
@@ -0,0 +1,333 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "utilities/macros.hpp"
+
+namespace mpd {
+	constexpr unsigned allocation_histogram_buckets = 16;
+	constexpr unsigned allocation_tag_slots = 32;
+
+	/**
+	* Allocation counts and bytes. size_histogram[i] counts allocations of up to 8<<i bytes (and bigger than the
+	* previous bucket). The last bucket also counts everything bigger.
+	**/
+	struct allocation_stats {
+		unsigned long long allocations = 0;
+		unsigned long long deallocations = 0;
+		unsigned long long bytes_allocated = 0;
+		unsigned long long bytes_deallocated = 0;
+		unsigned long long size_histogram[allocation_histogram_buckets] = {};
+	};
+	struct allocation_tag_stats {
+		const char* tag;
+		unsigned long long allocations;
+		unsigned long long bytes_allocated;
+	};
+
+	namespace impl {
+		// only ever written by the owning thread, so updates are a plain load+store, and never an atomic RMW.
+		class relaxed_counter {
+			std::atomic<unsigned long long> value{0};
+		public:
+			void add(unsigned long long n) noexcept { value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed); }
+			unsigned long long get() const noexcept { return value.load(std::memory_order_relaxed); }
+		};
+		inline unsigned allocation_histogram_bucket(std::size_t bytes) noexcept {
+			unsigned bucket = 0;
+			for (std::size_t limit = 8; bucket + 1 < allocation_histogram_buckets && bytes > limit; limit <<= 1)
+				++bucket;
+			return bucket;
+		}
+
+		struct thread_allocation_counters {
+			relaxed_counter allocations;
+			relaxed_counter deallocations;
+			relaxed_counter bytes_allocated;
+			relaxed_counter bytes_deallocated;
+			relaxed_counter size_histogram[allocation_histogram_buckets];
+			// tags are compared by address. Slot 0 is for untagged allocations, and for new tags once the other slots are full.
+			std::atomic<const char*> tags[allocation_tag_slots] = {};
+			relaxed_counter tag_allocations[allocation_tag_slots];
+			relaxed_counter tag_bytes[allocation_tag_slots];
+			const char* current_tag = nullptr;
+			thread_allocation_counters* next = nullptr;
+
+			thread_allocation_counters() noexcept;
+			~thread_allocation_counters();
+			void add_to(allocation_stats& stats) const noexcept {
+				stats.allocations += allocations.get();
+				stats.deallocations += deallocations.get();
+				stats.bytes_allocated += bytes_allocated.get();
+				stats.bytes_deallocated += bytes_deallocated.get();
+				for (unsigned i = 0; i < allocation_histogram_buckets; i++)
+					stats.size_histogram[i] += size_histogram[i].get();
+			}
+			void record_tag(const char* tag, std::size_t bytes) noexcept {
+				unsigned slot = 0;
+				if (tag != nullptr) {
+					for (slot = 1; slot < allocation_tag_slots; slot++) {
+						const char* existing = tags[slot].load(std::memory_order_relaxed);
+						if (existing == tag) break;
+						if (existing == nullptr) {
+							tags[slot].store(tag, std::memory_order_release);
+							break;
+						}
+					}
+					if (slot == allocation_tag_slots) slot = 0;
+				}
+				tag_allocations[slot].add(1);
+				tag_bytes[slot].add(bytes);
+			}
+		};
+
+		// all live threads' counters, plus the totals of threads that have exited.
+		// This never allocates, since it's updated from inside of operator new and thread exit.
+		struct allocation_registry {
+			static const unsigned retired_tag_slots = allocation_tag_slots * 4;
+			std::mutex lock;
+			thread_allocation_counters* threads = nullptr;
+			allocation_stats retired;
+			allocation_tag_stats retired_tags[retired_tag_slots] = {};
+			unsigned retired_tag_count = 0;
+
+			void retire_tag(const char* tag, unsigned long long allocations, unsigned long long bytes) noexcept {
+				unsigned slot = 0;
+				for (; slot < retired_tag_count && retired_tags[slot].tag != tag; slot++) {}
+				if (slot == retired_tag_count && slot < retired_tag_slots) {
+					retired_tags[slot].tag = tag;
+					retired_tag_count++;
+				}
+				if (slot == retired_tag_slots) slot = 0; // out of slots: count it with whatever's in the first slot.
+				retired_tags[slot].allocations += allocations;
+				retired_tags[slot].bytes_allocated += bytes;
+			}
+		};
+		// never destroyed, since threads may exit during static destruction.
+		inline allocation_registry& allocation_counters_registry() {
+			static allocation_registry* registry = ::new(std::malloc(sizeof(allocation_registry))) allocation_registry();
+			return *registry;
+		}
+		inline void add_tag_stats(std::vector<allocation_tag_stats>& out, const char* tag, unsigned long long allocations, unsigned long long bytes) {
+			for (allocation_tag_stats& existing : out) {
+				if (existing.tag == tag || (existing.tag && tag && std::strcmp(existing.tag, tag) == 0)) {
+					existing.allocations += allocations;
+					existing.bytes_allocated += bytes;
+					return;
+				}
+			}
+			out.push_back({tag, allocations, bytes});
+		}
+		inline void add_tag_stats(std::vector<allocation_tag_stats>& out, const thread_allocation_counters& counters) {
+			for (unsigned slot = 0; slot < allocation_tag_slots; slot++) {
+				unsigned long long count = counters.tag_allocations[slot].get();
+				if (count) add_tag_stats(out, counters.tags[slot].load(std::memory_order_acquire), count, counters.tag_bytes[slot].get());
+			}
+		}
+
+		inline thread_local bool thread_allocation_counters_alive = false;
+
+		inline thread_allocation_counters::thread_allocation_counters() noexcept {
+			thread_allocation_counters_alive = true;
+			allocation_registry& registry = allocation_counters_registry();
+			std::lock_guard<std::mutex> guard(registry.lock);
+			next = registry.threads;
+			registry.threads = this;
+		}
+		inline thread_allocation_counters::~thread_allocation_counters() {
+			allocation_registry& registry = allocation_counters_registry();
+			std::lock_guard<std::mutex> guard(registry.lock);
+			add_to(registry.retired);
+			for (unsigned slot = 0; slot < allocation_tag_slots; slot++) {
+				if (tag_allocations[slot].get())
+					registry.retire_tag(tags[slot].load(std::memory_order_relaxed), tag_allocations[slot].get(), tag_bytes[slot].get());
+			}
+			thread_allocation_counters** it = &registry.threads;
+			while (*it != this) it = &(*it)->next;
+			*it = next;
+			thread_allocation_counters_alive = false;
+		}
+		// returns nullptr once the calling thread's counters have been destroyed during thread exit.
+		inline thread_allocation_counters* this_thread_allocation_counters() noexcept {
+			static thread_local thread_allocation_counters counters;
+			return thread_allocation_counters_alive ? &counters : nullptr;
+		}
+	}
+
+	// Records an allocation in the calling thread's counters. Cheap enough to call on every allocation.
+	inline void record_allocation(std::size_t bytes, const char* tag = nullptr) noexcept {
+		impl::thread_allocation_counters* counters = impl::this_thread_allocation_counters();
+		if (counters == nullptr) { [[unlikely]] return; }
+		counters->allocations.add(1);
+		counters->bytes_allocated.add(bytes);
+		counters->size_histogram[impl::allocation_histogram_bucket(bytes)].add(1);
+		counters->record_tag(tag ? tag : counters->current_tag, bytes);
+	}
+	inline void record_deallocation(std::size_t bytes) noexcept {
+		impl::thread_allocation_counters* counters = impl::this_thread_allocation_counters();
+		if (counters == nullptr) { [[unlikely]] return; }
+		counters->deallocations.add(1);
+		counters->bytes_deallocated.add(bytes);
+	}
+
+	// Sums the counters of every thread, including threads that have exited. This takes a lock, so call it rarely.
+	inline allocation_stats allocation_totals() {
+		impl::allocation_registry& registry = impl::allocation_counters_registry();
+		std::lock_guard<std::mutex> guard(registry.lock);
+		allocation_stats totals = registry.retired;
+		for (impl::thread_allocation_counters* it = registry.threads; it != nullptr; it = it->next)
+			it->add_to(totals);
+		return totals;
+	}
+	// Allocation counts per call-site tag, for every thread. Untagged allocations are reported with a nullptr tag.
+	inline std::vector<allocation_tag_stats> allocation_tag_totals() {
+		impl::allocation_registry& registry = impl::allocation_counters_registry();
+		std::lock_guard<std::mutex> guard(registry.lock);
+		std::vector<allocation_tag_stats> totals;
+		for (unsigned slot = 0; slot < registry.retired_tag_count; slot++)
+			impl::add_tag_stats(totals, registry.retired_tags[slot].tag, registry.retired_tags[slot].allocations, registry.retired_tags[slot].bytes_allocated);
+		for (impl::thread_allocation_counters* it = registry.threads; it != nullptr; it = it->next)
+			impl::add_tag_stats(totals, *it);
+		return totals;
+	}
+
+	/**
+	* Reports how many allocations the calling thread made while the scope is alive. If given a tag, then allocations
+	* without their own tag are attributed to it until the scope ends.
+	* ex:
+	* mpd::allocation_scope scope("parse");
+	* parse(input);
+	* assert(scope.allocations() == 0);
+	* A scope opened during thread exit, once the thread's counters are gone, counts nothing, and a scope that outlives
+	* them reports 0.
+	**/
+	class allocation_scope {
+		impl::thread_allocation_counters* counters;
+		const char* previous_tag = nullptr;
+		unsigned long long start_allocations = 0;
+		unsigned long long start_bytes = 0;
+		// the counters may have been destroyed since, if the scope outlived them during thread exit
+		bool counting() const noexcept { return counters && impl::thread_allocation_counters_alive; }
+	public:
+		explicit allocation_scope(const char* tag = nullptr) noexcept : counters(impl::this_thread_allocation_counters()) {
+			if (counters == nullptr) { [[unlikely]] return; }
+			previous_tag = counters->current_tag;
+			start_allocations = counters->allocations.get();
+			start_bytes = counters->bytes_allocated.get();
+			if (tag) counters->current_tag = tag;
+		}
+		allocation_scope(const allocation_scope&) = delete;
+		allocation_scope& operator=(const allocation_scope&) = delete;
+		~allocation_scope() {
+			if (counting()) counters->current_tag = previous_tag;
+		}
+		unsigned long long allocations() const noexcept { return counting() ? counters->allocations.get() - start_allocations : 0; }
+		unsigned long long bytes_allocated() const noexcept { return counting() ? counters->bytes_allocated.get() - start_bytes : 0; }
+	};
+
+	// An allocator adapter that records every allocation and deallocation of the wrapped allocator, optionally with a tag.
+	template<class Alloc>
+	class counting_allocator : Alloc {
+		template<class U> friend class counting_allocator;
+		using traits = std::allocator_traits<Alloc>;
+		const char* tag;
+	public:
+		using pointer = typename traits::pointer;
+		using const_pointer = typename traits::const_pointer;
+		using void_pointer = typename traits::void_pointer;
+		using const_void_pointer = typename traits::const_void_pointer;
+		using value_type = typename traits::value_type;
+		using size_type = typename traits::size_type;
+		using difference_type = typename traits::difference_type;
+		using propagate_on_container_copy_assignment = typename traits::propagate_on_container_copy_assignment;
+		using propagate_on_container_move_assignment = typename traits::propagate_on_container_move_assignment;
+		using propagate_on_container_swap = typename traits::propagate_on_container_swap;
+		using is_always_equal = typename traits::is_always_equal;
+		template <class U> struct rebind { using other = counting_allocator<typename traits::template rebind_alloc<U>>; };
+
+		counting_allocator() noexcept(std::is_nothrow_default_constructible_v<Alloc>) : Alloc(), tag(nullptr) {}
+		explicit counting_allocator(const Alloc& alloc, const char* tag_ = nullptr) noexcept(std::is_nothrow_copy_constructible_v<Alloc>) : Alloc(alloc), tag(tag_) {}
+		template<class Alloc2>
+		counting_allocator(const counting_allocator<Alloc2>& rhs) : Alloc(rhs.inner()), tag(rhs.tag) {}
+		counting_allocator select_on_container_copy_construction() const {
+			return counting_allocator(traits::select_on_container_copy_construction(inner()), tag);
+		}
+
+		pointer allocate(size_type count) {
+			pointer ptr = traits::allocate(inner(), count);
+			record_allocation(count * sizeof(value_type), tag);
+			return ptr;
+		}
+		pointer allocate(size_type count, const_void_pointer hint) {
+			pointer ptr = traits::allocate(inner(), count, hint);
+			record_allocation(count * sizeof(value_type), tag);
+			return ptr;
+		}
+		void deallocate(pointer ptr, size_type count) {
+			record_deallocation(count * sizeof(value_type));
+			traits::deallocate(inner(), ptr, count);
+		}
+		size_type max_size() const noexcept { return traits::max_size(inner()); }
+		Alloc& inner() noexcept { return *this; }
+		const Alloc& inner() const noexcept { return *this; }
+		const char* get_tag() const noexcept { return tag; }
+
+		template<class Alloc2>
+		bool operator==(const counting_allocator<Alloc2>& rhs) const noexcept { return inner() == rhs.inner(); }
+		template<class Alloc2>
+		bool operator!=(const counting_allocator<Alloc2>& rhs) const noexcept { return !(inner() == rhs.inner()); }
+	};
+}
+
+/**
+* Define MPD_COUNT_GLOBAL_ALLOCATIONS before including this header in exactly one source file to replace the global
+* operator new and delete with versions that record every heap allocation in the program.
+* Overaligned allocations are not counted.
+**/
+#ifdef MPD_COUNT_GLOBAL_ALLOCATIONS
+namespace mpd {
+	namespace impl {
+		// each allocation is prefixed with its size, so that unsized deletes can report their bytes.
+		static const std::size_t counted_allocation_header = alignof(std::max_align_t);
+		inline void* counted_malloc(std::size_t bytes) noexcept {
+			void* raw = std::malloc(bytes + counted_allocation_header);
+			if (raw == nullptr) return nullptr;
+			*static_cast<std::size_t*>(raw) = bytes;
+			record_allocation(bytes);
+			return static_cast<char*>(raw) + counted_allocation_header;
+		}
+		inline void counted_free(void* ptr) noexcept {
+			if (ptr == nullptr) return;
+			void* raw = static_cast<char*>(ptr) - counted_allocation_header;
+			record_deallocation(*static_cast<std::size_t*>(raw));
+			std::free(raw);
+		}
+		inline void* counted_new(std::size_t bytes) {
+			for (;;) {
+				void* ptr = counted_malloc(bytes);
+				if (ptr) return ptr;
+				std::new_handler handler = std::get_new_handler();
+				if (!handler) throw std::bad_alloc();
+				handler();
+			}
+		}
+	}
+}
+void* operator new(std::size_t bytes) { return mpd::impl::counted_new(bytes); }
+void* operator new[](std::size_t bytes) { return mpd::impl::counted_new(bytes); }
+void* operator new(std::size_t bytes, const std::nothrow_t&) noexcept { return mpd::impl::counted_malloc(bytes); }
+void* operator new[](std::size_t bytes, const std::nothrow_t&) noexcept { return mpd::impl::counted_malloc(bytes); }
+void operator delete(void* ptr) noexcept { mpd::impl::counted_free(ptr); }
+void operator delete[](void* ptr) noexcept { mpd::impl::counted_free(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept { mpd::impl::counted_free(ptr); }
+void operator delete[](void* ptr, std::size_t) noexcept { mpd::impl::counted_free(ptr); }
+void operator delete(void* ptr, const std::nothrow_t&) noexcept { mpd::impl::counted_free(ptr); }
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept { mpd::impl::counted_free(ptr); }
+#endif
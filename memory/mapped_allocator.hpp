@@ -0,0 +1,260 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <new>
+#include <type_traits>
+#include <utility>
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#include "memory/arena_allocator.hpp"
+
+namespace mpd {
+	enum map_flags : unsigned {
+		map_default = 0,
+		// ask for transparent huge pages. Regions of 2MB or more are 2MB aligned, so that they can actually get them.
+		map_huge_pages = 1,
+		// touch every page up front, so that the page faults don't happen on the hot path later.
+		map_prefault = 2,
+	};
+	constexpr map_flags operator|(map_flags l, map_flags r) noexcept { return static_cast<map_flags>(static_cast<unsigned>(l) | r); }
+
+	// process-wide counters for memory mapped by this header.
+	struct mapped_memory_stats {
+		std::size_t mapped_bytes; // currently mapped, including pages that were discarded
+		std::size_t peak_mapped_bytes;
+		std::size_t discarded_bytes; // total ever returned to the OS by shrink/trim
+		std::size_t map_calls;
+		std::size_t huge_page_failures; // the OS refused the huge page advice
+	};
+
+	namespace impl {
+		constexpr std::size_t huge_page_size = 2 * 1024 * 1024;
+
+		struct mapped_memory_counters {
+			std::atomic<std::size_t> mapped_bytes{0};
+			std::atomic<std::size_t> peak_mapped_bytes{0};
+			std::atomic<std::size_t> discarded_bytes{0};
+			std::atomic<std::size_t> map_calls{0};
+			std::atomic<std::size_t> huge_page_failures{0};
+		};
+		inline mapped_memory_counters& mapped_counters() noexcept {
+			static mapped_memory_counters counters;
+			return counters;
+		}
+		inline std::size_t os_page_size() noexcept {
+#ifdef _WIN32
+			static const std::size_t size = [] { SYSTEM_INFO info; GetSystemInfo(&info); return static_cast<std::size_t>(info.dwPageSize); }();
+#else
+			static const std::size_t size = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+#endif
+			return size;
+		}
+		// the number of bytes that map_pages actually maps for a request
+		inline std::size_t mapped_size(std::size_t bytes, unsigned flags) noexcept {
+			std::size_t granule = (flags & map_huge_pages) && bytes >= huge_page_size ? huge_page_size : os_page_size();
+			return (bytes + granule - 1) / granule * granule;
+		}
+		inline void prefault_pages(char* ptr, std::size_t bytes) noexcept {
+#if defined(MADV_POPULATE_WRITE)
+			if (madvise(ptr, bytes, MADV_POPULATE_WRITE) == 0) return;
+#endif
+			// the pages are already zeroed, but writing forces the OS to back them.
+			std::size_t page = os_page_size();
+			for (std::size_t i = 0; i < bytes; i += page)
+				reinterpret_cast<volatile char*>(ptr)[i] = 0;
+		}
+		inline void record_map(std::size_t bytes) noexcept {
+			mapped_memory_counters& counters = mapped_counters();
+			counters.map_calls.fetch_add(1, std::memory_order_relaxed);
+			std::size_t now = counters.mapped_bytes.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+			std::size_t peak = counters.peak_mapped_bytes.load(std::memory_order_relaxed);
+			while (now > peak && !counters.peak_mapped_bytes.compare_exchange_weak(peak, now, std::memory_order_relaxed)) {}
+		}
+
+		// maps mapped_size(bytes, flags) bytes of zeroed memory, or throws std::bad_alloc.
+		inline void* map_pages(std::size_t bytes, unsigned flags) {
+			std::size_t size = mapped_size(bytes, flags);
+#ifdef _WIN32
+			// large pages on Windows require SeLockMemoryPrivilege, so map_huge_pages is only advice that we can't give.
+			char* ptr = static_cast<char*>(VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE));
+			if (ptr == nullptr) throw std::bad_alloc();
+			if (flags & map_huge_pages) mapped_counters().huge_page_failures.fetch_add(1, std::memory_order_relaxed);
+#else
+			bool align_huge = (flags & map_huge_pages) && size >= huge_page_size;
+			std::size_t map_size = align_huge ? size + huge_page_size : size;
+			void* raw = mmap(nullptr, map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if (raw == MAP_FAILED) throw std::bad_alloc();
+			char* ptr = static_cast<char*>(raw);
+			if (align_huge) {
+				// over-map, and then unmap the unaligned head and tail
+				char* aligned = reinterpret_cast<char*>((reinterpret_cast<std::uintptr_t>(ptr) + huge_page_size - 1) & ~std::uintptr_t(huge_page_size - 1));
+				if (aligned != ptr) munmap(ptr, static_cast<std::size_t>(aligned - ptr));
+				std::size_t tail = static_cast<std::size_t>(ptr + map_size - (aligned + size));
+				if (tail) munmap(aligned + size, tail);
+				ptr = aligned;
+			}
+			if (flags & map_huge_pages) {
+#if defined(MADV_HUGEPAGE)
+				if (madvise(ptr, size, MADV_HUGEPAGE) != 0) mapped_counters().huge_page_failures.fetch_add(1, std::memory_order_relaxed);
+#else
+				mapped_counters().huge_page_failures.fetch_add(1, std::memory_order_relaxed);
+#endif
+			}
+#endif
+			if (flags & map_prefault) prefault_pages(ptr, size);
+			record_map(size);
+			return ptr;
+		}
+		inline void unmap_pages(void* ptr, std::size_t bytes, unsigned flags) noexcept {
+			std::size_t size = mapped_size(bytes, flags);
+#ifdef _WIN32
+			VirtualFree(ptr, 0, MEM_RELEASE);
+#else
+			munmap(ptr, size);
+#endif
+			mapped_counters().mapped_bytes.fetch_sub(size, std::memory_order_relaxed);
+		}
+		// returns the physical pages in the range to the OS, but keeps the addresses mapped. They read as zero afterwards.
+		// The range is shrunk inwards to whole pages.
+		inline std::size_t discard_pages(void* ptr, std::size_t bytes) noexcept {
+			std::size_t page = os_page_size();
+			std::uintptr_t first = (reinterpret_cast<std::uintptr_t>(ptr) + page - 1) & ~std::uintptr_t(page - 1);
+			std::uintptr_t last = (reinterpret_cast<std::uintptr_t>(ptr) + bytes) & ~std::uintptr_t(page - 1);
+			if (last <= first) return 0;
+			std::size_t size = static_cast<std::size_t>(last - first);
+#ifdef _WIN32
+			// MEM_RESET doesn't zero, so decommit and recommit instead, which keeps the zeroing semantics of MADV_DONTNEED.
+			VirtualFree(reinterpret_cast<void*>(first), size, MEM_DECOMMIT);
+			VirtualAlloc(reinterpret_cast<void*>(first), size, MEM_COMMIT, PAGE_READWRITE);
+#else
+			madvise(reinterpret_cast<void*>(first), size, MADV_DONTNEED);
+#endif
+			mapped_counters().discarded_bytes.fetch_add(size, std::memory_order_relaxed);
+			return size;
+		}
+	}
+
+	inline mapped_memory_stats mapped_memory_totals() noexcept {
+		impl::mapped_memory_counters& counters = impl::mapped_counters();
+		return {
+			counters.mapped_bytes.load(std::memory_order_relaxed),
+			counters.peak_mapped_bytes.load(std::memory_order_relaxed),
+			counters.discarded_bytes.load(std::memory_order_relaxed),
+			counters.map_calls.load(std::memory_order_relaxed),
+			counters.huge_page_failures.load(std::memory_order_relaxed),
+		};
+	}
+
+	/**
+	* An owning block of memory mapped directly from the OS, optionally backed by transparent huge pages, and optionally
+	* prefaulted. `shrink` returns the physical pages past a point to the OS, without unmapping them, so the region can
+	* grow back into them later (they read as zeroes).
+	**/
+	class mapped_region {
+		char* ptr;
+		std::size_t bytes;
+		map_flags flags;
+	public:
+		mapped_region() noexcept : ptr(nullptr), bytes(0), flags(map_default) {}
+		explicit mapped_region(std::size_t bytes_, map_flags flags_ = map_huge_pages)
+			: ptr(static_cast<char*>(impl::map_pages(bytes_, flags_))), bytes(impl::mapped_size(bytes_, flags_)), flags(flags_) {}
+		mapped_region(mapped_region&& rhs) noexcept : ptr(rhs.ptr), bytes(rhs.bytes), flags(rhs.flags) { rhs.ptr = nullptr; rhs.bytes = 0; }
+		mapped_region& operator=(mapped_region&& rhs) noexcept {
+			std::swap(ptr, rhs.ptr);
+			std::swap(bytes, rhs.bytes);
+			std::swap(flags, rhs.flags);
+			return *this;
+		}
+		~mapped_region() { release(); }
+
+		char* data() const noexcept { return ptr; }
+		std::size_t size() const noexcept { return bytes; }
+		map_flags options() const noexcept { return flags; }
+		// discards the physical pages after the first keep_bytes. Returns the number of bytes discarded.
+		std::size_t shrink(std::size_t keep_bytes) noexcept {
+			if (keep_bytes >= bytes) return 0;
+			return impl::discard_pages(ptr + keep_bytes, bytes - keep_bytes);
+		}
+		void release() noexcept {
+			if (ptr) impl::unmap_pages(ptr, bytes, map_default);
+			ptr = nullptr;
+			bytes = 0;
+		}
+	};
+
+	/**
+	* A stateless allocator that maps every allocation directly from the OS. Only appropriate for large, long-lived buffers,
+	* such as a dynamic_buffer with millions of elements, since each allocation is a system call and at least a page.
+	* ex:
+	* using table_allocator = mpd::mapped_allocator<entry, mpd::map_huge_pages | mpd::map_prefault>;
+	**/
+	template<class T, map_flags flags = map_huge_pages>
+	class mapped_allocator {
+	public:
+		using pointer = T*;
+		using const_pointer = const T*;
+		using void_pointer = void*;
+		using const_void_pointer = const void*;
+		using value_type = T;
+		using size_type = std::size_t;
+		using difference_type = std::ptrdiff_t;
+		using propagate_on_container_copy_assignment = std::false_type;
+		using propagate_on_container_move_assignment = std::true_type;
+		using propagate_on_container_swap = std::false_type;
+		using is_always_equal = std::true_type;
+		template <class U> struct rebind { using other = mapped_allocator<U, flags>; };
+
+		mapped_allocator() noexcept {}
+		template<class U>
+		mapped_allocator(const mapped_allocator<U, flags>&) noexcept {}
+
+		pointer allocate(std::size_t count) {
+			if (count > max_size()) throw std::bad_array_new_length();
+			return static_cast<pointer>(impl::map_pages(count * sizeof(T), flags));
+		}
+		pointer allocate(std::size_t count, const_void_pointer) { return allocate(count); }
+		void deallocate(pointer ptr, std::size_t count) noexcept { impl::unmap_pages(ptr, count * sizeof(T), flags); }
+		std::size_t max_size() const noexcept { return (std::numeric_limits<std::size_t>::max() - impl::huge_page_size) / sizeof(T); }
+		// returns the physical pages past the first used_count elements of an allocation to the OS.
+		static std::size_t discard_tail(pointer ptr, std::size_t used_count, std::size_t count) noexcept {
+			return impl::discard_pages(ptr + used_count, (count - used_count) * sizeof(T));
+		}
+
+		template<class U>
+		bool operator==(const mapped_allocator<U, flags>&) const noexcept { return true; }
+		template<class U>
+		bool operator!=(const mapped_allocator<U, flags>&) const noexcept { return false; }
+	};
+
+	namespace impl {
+		// so that the region is constructed before the arena that uses it
+		struct mapped_region_holder {
+			mapped_region region;
+			mapped_region_holder(std::size_t bytes, map_flags flags) : region(bytes, flags) {}
+		};
+	}
+
+	/**
+	* A monotonic_arena whose initial buffer is a mapped_region. Reserve generously: address space is cheap, and
+	* (unless prefaulted) pages are only backed when they're touched. `trim` returns the pages past the current position
+	* to the OS, which makes a reset arena give its memory back without unmapping it.
+	* If the region is exhausted, the arena falls back to heap chunks like any other monotonic_arena.
+	**/
+	class mapped_arena : private impl::mapped_region_holder, public monotonic_arena {
+	public:
+		explicit mapped_arena(std::size_t reserve_bytes, map_flags flags = map_huge_pages, std::size_t first_chunk_size = default_chunk_size)
+			: impl::mapped_region_holder(reserve_bytes, flags), monotonic_arena(region.data(), region.size(), first_chunk_size) {}
+		const mapped_region& mapping() const noexcept { return region; }
+		// discards the unused pages of the mapped region. Returns the number of bytes discarded.
+		std::size_t trim() noexcept { return region.shrink(initial_bytes_used()); }
+	};
+}
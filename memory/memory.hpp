@@ -1,6 +1,9 @@
 #pragma once
+#include <algorithm>
+#include <cstring>
 #include <iterator>
 #include <memory>
+#include <type_traits>
 #include <utility>
 #include "../utilities/macros.hpp"
 
@@ -83,58 +86,192 @@ namespace mpd {
 	}
 #endif
 
-#if _cplusplus >= 201703L
-	using std::uninitialized_move;
-	using std::uninitialized_move_n;
-#else
-	template< class InputIt, class NoThrowForwardIt >
-	NoThrowForwardIt uninitialized_move(InputIt src_first, InputIt src_last, NoThrowForwardIt d_first) {
-		using Value = typename std::iterator_traits<NoThrowForwardIt>::value_type;
-		NoThrowForwardIt current = d_first;
-		try {
-			for (; src_first != src_last; ++src_first, (void) ++current)
-				indirect_construct_at(current, std::move(*src_first));
-			return current;
-		} catch (...) {
-			destroy(d_first, current);
-			throw;
+	/**
+	* Types that can be moved to a new address by copying their bytes, after which the source is treated as destroyed.
+	* Defaults to trivially copyable types. Types that don't care about their own address (most unique_ptr-like types)
+	* can specialize this to true, but types that point into themselves (some SSO strings) must not.
+	**/
+	template<class T>
+	struct is_trivially_relocatable : std::is_trivially_copyable<T> {};
+	template<class T>
+	constexpr bool is_trivially_relocatable_v = is_trivially_relocatable<T>::value;
+
+	namespace impl {
+		// source and destination are pointers to the same trivially copyable type, so construction is a memcpy.
+		template<class SourceIt, class DestIt>
+		struct is_bitwise_copyable : std::false_type {};
+		template<class T, class U>
+		struct is_bitwise_copyable<T*, U*> : std::integral_constant<bool,
+			std::is_same_v<std::remove_const_t<T>, U> && !std::is_const_v<U> && std::is_trivially_copyable_v<U>> {};
+		template<class T, class U>
+		struct is_bitwise_copyable<std::move_iterator<T*>, U*> : is_bitwise_copyable<T*, U*> {};
+
+		template<class SourceIt, class DestIt>
+		struct is_bitwise_relocatable : std::false_type {};
+		template<class T>
+		struct is_bitwise_relocatable<T*, T*> : std::integral_constant<bool, is_trivially_relocatable_v<T> && !std::is_const_v<T>> {};
+
+		template<class T>
+		T* to_pointer(T* it) noexcept { return it; }
+		template<class T>
+		T* to_pointer(std::move_iterator<T*> it) noexcept { return it.base(); }
+
+		template<class SourceIt, class DestIt>
+		std::pair<SourceIt, DestIt> uninitialized_copy_n(SourceIt src_first, std::size_t count, DestIt dest_first, std::true_type) noexcept {
+			if (count) std::memcpy(static_cast<void*>(dest_first), static_cast<const void*>(to_pointer(src_first)), count * sizeof(*dest_first));
+			return {src_first + count, dest_first + count};
+		}
+		template<class SourceIt, class DestIt>
+		std::pair<SourceIt, DestIt> uninitialized_copy_n(SourceIt src_first, std::size_t count, DestIt dest_first, std::false_type) {
+			DestIt current = dest_first;
+			try {
+				for (; count > 0; ++src_first, (void) ++current, --count)
+					indirect_construct_at(current, *src_first);
+				return {src_first, current};
+			} catch (...) {
+				destroy(dest_first, current);
+				throw;
+			}
+		}
+		template<class SourceIt, class DestIt>
+		DestIt uninitialized_copy(SourceIt src_first, SourceIt src_last, DestIt dest_first, std::true_type) noexcept {
+			return uninitialized_copy_n(src_first, static_cast<std::size_t>(src_last - src_first), dest_first, std::true_type{}).second;
+		}
+		template<class SourceIt, class DestIt>
+		DestIt uninitialized_copy(SourceIt src_first, SourceIt src_last, DestIt dest_first, std::false_type) {
+			DestIt current = dest_first;
+			try {
+				for (; src_first != src_last; ++src_first, (void) ++current)
+					indirect_construct_at(current, *src_first);
+				return current;
+			} catch (...) {
+				destroy(dest_first, current);
+				throw;
+			}
+		}
+		template<class SourceIt, class DestIt>
+		std::pair<SourceIt, DestIt> uninitialized_copy_s(SourceIt src_first, SourceIt src_last, DestIt dest_first, DestIt dest_last, std::true_type) noexcept {
+			std::size_t count = static_cast<std::size_t>(std::min(src_last - src_first, dest_last - dest_first));
+			return uninitialized_copy_n(src_first, count, dest_first, std::true_type{});
+		}
+		template<class SourceIt, class DestIt>
+		std::pair<SourceIt, DestIt> uninitialized_copy_s(SourceIt src_first, SourceIt src_last, DestIt dest_first, DestIt dest_last, std::false_type) {
+			DestIt first_dest = dest_first;
+			try {
+				while (src_first != src_last && dest_first != dest_last) {
+					indirect_construct_at(dest_first, *src_first);
+					++src_first;
+					++dest_first;
+				}
+				return {src_first, dest_first};
+			} catch (...) {
+				destroy(first_dest, dest_first);
+				throw;
+			}
 		}
-	}
 
-	template< class InputIt, class Size, class NoThrowForwardIt >
-	std::pair<InputIt, NoThrowForwardIt> uninitialized_move_n(InputIt src_first, Size count, NoThrowForwardIt d_first) {
-		NoThrowForwardIt current = d_first;
-		try {
-			for (; count > 0; ++src_first, (void) ++current, --count)
-				indirect_construct_at(current, std::move(*src_first));
-		} catch (...) {
-			destroy(d_first, current);
-			throw;
+		// memmove, so the ranges may overlap in either direction
+		template<class T>
+		std::pair<T*, T*> uninitialized_relocate_n(T* src_first, std::size_t count, T* dest_first, std::true_type) noexcept {
+			if (count) std::memmove(static_cast<void*>(dest_first), static_cast<const void*>(src_first), count * sizeof(T));
+			return {src_first + count, dest_first + count};
+		}
+		// if a move throws, the constructed destinations and the remaining sources are all destroyed.
+		template<class SourceIt, class DestIt>
+		std::pair<SourceIt, DestIt> uninitialized_relocate_n(SourceIt src_first, std::size_t count, DestIt dest_first, std::false_type) {
+			DestIt current = dest_first;
+			try {
+				for (; count > 0; ++src_first, (void) ++current, --count) {
+					indirect_construct_at(current, std::move(*src_first));
+					destroy_at(std::addressof(*src_first));
+				}
+				return {src_first, current};
+			} catch (...) {
+				destroy(dest_first, current);
+				destroy_at(std::addressof(*src_first));
+				for (++src_first, --count; count > 0; ++src_first, --count)
+					destroy_at(std::addressof(*src_first));
+				throw;
+			}
+		}
+		template<class T>
+		T* uninitialized_relocate_backward(T* src_first, T* src_last, T* dest_last, std::true_type) noexcept {
+			std::size_t count = static_cast<std::size_t>(src_last - src_first);
+			uninitialized_relocate_n(src_first, count, dest_last - count, std::true_type{});
+			return dest_last - count;
+		}
+		template<class SourceIt, class DestIt>
+		DestIt uninitialized_relocate_backward(SourceIt src_first, SourceIt src_last, DestIt dest_last, std::false_type) {
+			DestIt current = dest_last;
+			try {
+				while (src_first != src_last) {
+					--src_last;
+					--current;
+					indirect_construct_at(current, std::move(*src_last));
+					destroy_at(std::addressof(*src_last));
+				}
+				return current;
+			} catch (...) {
+				destroy(++current, dest_last);
+				destroy(src_first, ++src_last);
+				throw;
+			}
 		}
-		return {src_first, current};
+	}
 
+	// These match the std algorithms of the same names, except that trivially copyable elements in contiguous
+	// memory are copied with a single memcpy, rather than constructed one at a time.
+	template<class InputIt, class NoThrowForwardIt>
+	NoThrowForwardIt uninitialized_copy(InputIt src_first, InputIt src_last, NoThrowForwardIt d_first) {
+		return impl::uninitialized_copy(src_first, src_last, d_first, impl::is_bitwise_copyable<InputIt, NoThrowForwardIt>{});
+	}
+	template<class InputIt, class Size, class NoThrowForwardIt>
+	NoThrowForwardIt uninitialized_copy_n(InputIt src_first, Size count, NoThrowForwardIt d_first) {
+		if (count <= 0) return d_first;
+		return impl::uninitialized_copy_n(src_first, static_cast<std::size_t>(count), d_first, impl::is_bitwise_copyable<InputIt, NoThrowForwardIt>{}).second;
+	}
+	template<class InputIt, class NoThrowForwardIt>
+	NoThrowForwardIt uninitialized_move(InputIt src_first, InputIt src_last, NoThrowForwardIt d_first) {
+		return uninitialized_copy(std::make_move_iterator(src_first), std::make_move_iterator(src_last), d_first);
+	}
+	template<class InputIt, class Size, class NoThrowForwardIt>
+	std::pair<InputIt, NoThrowForwardIt> uninitialized_move_n(InputIt src_first, Size count, NoThrowForwardIt d_first) {
+		if (count <= 0) return {src_first, d_first};
+		auto its = impl::uninitialized_copy_n(std::make_move_iterator(src_first), static_cast<std::size_t>(count), d_first,
+			impl::is_bitwise_copyable<std::move_iterator<InputIt>, NoThrowForwardIt>{});
+		return {its.first.base(), its.second};
 	}
-#endif
 
+	// Copies until either the source or the destination is exhausted. Returns where both stopped.
 	template<class SourceIt, class DestIt>
 	std::pair<SourceIt, DestIt> uninitialized_copy_s(SourceIt src_first, SourceIt src_last, DestIt dest_first, DestIt dest_last) {
-		DestIt first_dest = dest_first;
-		try {
-			while (src_first != src_last && dest_first != dest_last) {
-				indirect_construct_at(dest_first, *src_first);
-				++src_first;
-				++dest_first;
-			}
-			return {src_first, dest_first};
-		} catch (...) {
-			destroy(first_dest, dest_first);
-			throw;
-		}
+		return impl::uninitialized_copy_s(src_first, src_last, dest_first, dest_last, impl::is_bitwise_copyable<SourceIt, DestIt>{});
 	}
 
 	template<class SourceIt, class DestIt>
 	std::pair<SourceIt, DestIt> uninitialized_move_s(SourceIt src_first, SourceIt src_last, DestIt dest_first, DestIt dest_last) {
-		auto pair = uninitialized_copy(std::make_move_iterator(src_first), std::make_move_iterator(src_last), dest_first, dest_last);
+		auto pair = uninitialized_copy_s(std::make_move_iterator(src_first), std::make_move_iterator(src_last), dest_first, dest_last);
 		return {pair.first.base(), pair.second};
 	}
+
+	/**
+	* Moves each element to the destination and destroys the source, in a single pass. Trivially relocatable
+	* elements in contiguous memory are relocated with a single memmove, so the ranges may overlap, and
+	* the relocation cannot throw. Otherwise, the ranges may only overlap if d_first is before src_first, and if
+	* a move constructor throws, then the elements in both ranges are destroyed.
+	**/
+	template<class InputIt, class Size, class NoThrowForwardIt>
+	std::pair<InputIt, NoThrowForwardIt> uninitialized_relocate_n(InputIt src_first, Size count, NoThrowForwardIt d_first) {
+		if (count <= 0) return {src_first, d_first};
+		return impl::uninitialized_relocate_n(src_first, static_cast<std::size_t>(count), d_first, impl::is_bitwise_relocatable<InputIt, NoThrowForwardIt>{});
+	}
+	template<class ForwardIt, class NoThrowForwardIt>
+	NoThrowForwardIt uninitialized_relocate(ForwardIt src_first, ForwardIt src_last, NoThrowForwardIt d_first) {
+		return uninitialized_relocate_n(src_first, std::distance(src_first, src_last), d_first).second;
+	}
+	// Like uninitialized_relocate, but goes from the back, so the ranges may overlap if d_last is after src_last.
+	template<class BidirIt, class NoThrowBidirIt>
+	NoThrowBidirIt uninitialized_relocate_backward(BidirIt src_first, BidirIt src_last, NoThrowBidirIt d_last) {
+		return impl::uninitialized_relocate_backward(src_first, src_last, d_last, impl::is_bitwise_relocatable<BidirIt, NoThrowBidirIt>{});
+	}
 }
\ No newline at end of file
@@ -0,0 +1,109 @@
+#pragma once
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <type_traits>
+
+namespace mpd {
+	/**
+	* A 4 byte pointer, that stores the distance from itself to the target. The target must be within +/-2GB of the
+	* offset_ptr itself, which is always true for links between objects in the same arena or buffer.
+	*
+	* Since the offset is relative, a block of memory containing objects that link to each other with offset_ptrs can
+	* be memcpy'd, memory mapped, or relocated as a whole without fix-ups. Conversely, copying a single offset_ptr
+	* recalculates the offset for the new location, so that it still points at the same target.
+	* ex:
+	* struct node { int value; mpd::offset_ptr<node> next; };
+	**/
+	template<class T>
+	class offset_ptr {
+		static const std::int32_t null_offset = std::numeric_limits<std::int32_t>::min();
+		std::int32_t offset;
+
+		static std::int32_t offset_of(const void* self, const T* target) noexcept {
+			if (target == nullptr) return null_offset;
+			// through integers, since the target and the offset_ptr are usually different objects, and subtracting
+			// pointers to different objects is undefined (and optimizers do assume it doesn't happen)
+			std::ptrdiff_t diff = static_cast<std::ptrdiff_t>(reinterpret_cast<std::uintptr_t>(target) - reinterpret_cast<std::uintptr_t>(self));
+			assert(diff > null_offset && diff <= std::numeric_limits<std::int32_t>::max());
+			return static_cast<std::int32_t>(diff);
+		}
+	public:
+		using element_type = T;
+		using pointer = T*;
+		using difference_type = std::ptrdiff_t;
+
+		offset_ptr() noexcept : offset(null_offset) {}
+		offset_ptr(std::nullptr_t) noexcept : offset(null_offset) {}
+		offset_ptr(T* target) noexcept : offset(offset_of(this, target)) {}
+		offset_ptr(const offset_ptr& rhs) noexcept : offset(offset_of(this, rhs.get())) {}
+		template<class U, class = std::enable_if_t<std::is_convertible_v<U*, T*>>>
+		offset_ptr(const offset_ptr<U>& rhs) noexcept : offset(offset_of(this, rhs.get())) {}
+		offset_ptr& operator=(const offset_ptr& rhs) noexcept { offset = offset_of(this, rhs.get()); return *this; }
+		offset_ptr& operator=(T* target) noexcept { offset = offset_of(this, target); return *this; }
+		offset_ptr& operator=(std::nullptr_t) noexcept { offset = null_offset; return *this; }
+
+		T* get() const noexcept {
+			if (offset == null_offset) return nullptr;
+			return reinterpret_cast<T*>(reinterpret_cast<std::uintptr_t>(this) + static_cast<std::uintptr_t>(static_cast<std::intptr_t>(offset)));
+		}
+		T& operator*() const noexcept { assert(offset != null_offset); return *get(); }
+		T* operator->() const noexcept { assert(offset != null_offset); return get(); }
+		T& operator[](std::ptrdiff_t i) const noexcept { return get()[i]; }
+		explicit operator bool() const noexcept { return offset != null_offset; }
+
+		friend bool operator==(const offset_ptr& l, const offset_ptr& r) noexcept { return l.get() == r.get(); }
+		friend bool operator!=(const offset_ptr& l, const offset_ptr& r) noexcept { return l.get() != r.get(); }
+		friend bool operator==(const offset_ptr& l, std::nullptr_t) noexcept { return !l; }
+		friend bool operator!=(const offset_ptr& l, std::nullptr_t) noexcept { return !!l; }
+		friend bool operator<(const offset_ptr& l, const offset_ptr& r) noexcept { return std::less<T*>{}(l.get(), r.get()); }
+	};
+
+	/**
+	* A 4 byte reference to an element of an array, such as a dynamic_buffer, or a block of an arena.
+	* Unlike an offset_ptr, this doesn't care where the index itself is stored, but the array base has to be passed in
+	* to dereference it. The array can grow, move, or be persisted without invalidating the indexes.
+	* ex:
+	* struct vertex { int weight; mpd::arena_index<vertex> parent; };
+	* vertex& p = v.parent.in(vertices.data());
+	**/
+	template<class T>
+	class arena_index {
+		static const std::uint32_t null_index = 0xFFFFFFFFu;
+		std::uint32_t idx;
+	public:
+		using element_type = T;
+
+		constexpr arena_index() noexcept : idx(null_index) {}
+		constexpr arena_index(std::nullptr_t) noexcept : idx(null_index) {}
+		constexpr explicit arena_index(std::uint32_t index) noexcept : idx(index) {}
+		// the index of target in the array starting at base
+		static arena_index of(const T* base, const T* target) noexcept {
+			if (target == nullptr) return {};
+			assert(target >= base && static_cast<std::size_t>(target - base) < null_index);
+			return arena_index(static_cast<std::uint32_t>(target - base));
+		}
+
+		constexpr std::uint32_t index() const noexcept { return idx; }
+		constexpr explicit operator bool() const noexcept { return idx != null_index; }
+		T* get(T* base) const noexcept { return idx == null_index ? nullptr : base + idx; }
+		const T* get(const T* base) const noexcept { return idx == null_index ? nullptr : base + idx; }
+		T& in(T* base) const noexcept { assert(idx != null_index); return base[idx]; }
+		const T& in(const T* base) const noexcept { assert(idx != null_index); return base[idx]; }
+		// anything with a data() member, such as a dynamic_buffer or std::vector
+		template<class Container>
+		auto& in(Container& array) const noexcept { return in(array.data()); }
+
+		friend constexpr bool operator==(arena_index l, arena_index r) noexcept { return l.idx == r.idx; }
+		friend constexpr bool operator!=(arena_index l, arena_index r) noexcept { return l.idx != r.idx; }
+		friend constexpr bool operator<(arena_index l, arena_index r) noexcept { return l.idx < r.idx; }
+	};
+}
+namespace std {
+	template<class T>
+	struct hash<mpd::arena_index<T>> {
+		std::size_t operator()(mpd::arena_index<T> i) const noexcept { return std::hash<std::uint32_t>{}(i.index()); }
+	};
+}
@@ -0,0 +1,219 @@
+#pragma once
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include "numerics/bit.hpp"
+#include "utilities/macros.hpp"
+
+namespace mpd {
+	namespace impl {
+		// size classes are 16 byte steps up to 128, and then four classes per power of two up to 1024.
+		constexpr std::size_t pool_max_block_size = 1024;
+		constexpr std::size_t pool_block_alignment = 16;
+		constexpr unsigned pool_class_count = 20;
+		constexpr std::size_t pool_class_size(unsigned size_class) noexcept {
+			return size_class < 8 ? (size_class + 1) * 16
+				: (std::size_t(5 + (size_class - 8) % 4) << (5 + (size_class - 8) / 4));
+		}
+		inline unsigned pool_size_class(std::size_t bytes) noexcept {
+			assume(bytes <= pool_max_block_size);
+			if (bytes <= 128) return bytes ? static_cast<unsigned>((bytes - 1) / 16) : 0;
+			unsigned shift = bit_width(bytes - 1) - 3;
+			return 8 + (shift - 5) * 4 + static_cast<unsigned>((bytes - 1) >> shift) - 4;
+		}
+
+		// A slab is an allocation_buffer for a single size class, with the bitmap in the header.
+		// Slabs are aligned to their size, so the slab of any block can be found by masking the pointer.
+		struct pool_slab {
+			static const std::size_t slab_bytes = 64 * 1024;
+			static const std::size_t bitmap_words = slab_bytes / pool_block_alignment / 64;
+
+			pool_slab* next_partial;
+			bool in_partial;
+			unsigned size_class;
+			unsigned used_count;
+			unsigned block_count;
+			std::uint64_t used[bitmap_words];
+
+			static std::size_t header_bytes() noexcept { return (sizeof(pool_slab) + pool_block_alignment - 1) / pool_block_alignment * pool_block_alignment; }
+			char* blocks() noexcept { return reinterpret_cast<char*>(this) + header_bytes(); }
+			std::size_t block_size() const noexcept { return pool_class_size(size_class); }
+			static pool_slab* of(void* block) noexcept {
+				return reinterpret_cast<pool_slab*>(reinterpret_cast<std::uintptr_t>(block) & ~std::uintptr_t(slab_bytes - 1));
+			}
+
+			static pool_slab* create(unsigned size_class) {
+				void* raw = ::operator new(slab_bytes, std::align_val_t(slab_bytes));
+				pool_slab* slab = ::new(raw) pool_slab();
+				slab->next_partial = nullptr;
+				slab->in_partial = false;
+				slab->size_class = size_class;
+				slab->used_count = 0;
+				slab->block_count = static_cast<unsigned>((slab_bytes - header_bytes()) / slab->block_size());
+				// blocks past the end of the slab are permanently marked used
+				for (std::size_t i = slab->block_count; i < bitmap_words * 64; i++)
+					slab->used[i / 64] |= std::uint64_t(1) << (i % 64);
+				return slab;
+			}
+			// claims up to count free blocks. Returns how many were claimed.
+			std::size_t take(void** out, std::size_t count) noexcept {
+				std::size_t taken = 0;
+				std::size_t size = block_size();
+				for (std::size_t w = 0; w < bitmap_words && taken < count; w++) {
+					while (~used[w] != 0 && taken < count) {
+						unsigned bit = countr_zero(~used[w]);
+						used[w] |= std::uint64_t(1) << bit;
+						out[taken++] = blocks() + (w * 64 + bit) * size;
+					}
+				}
+				used_count += static_cast<unsigned>(taken);
+				return taken;
+			}
+			void give(void* block) noexcept {
+				std::size_t idx = static_cast<std::size_t>(static_cast<char*>(block) - blocks()) / block_size();
+				assert(idx < block_count);
+				assert(used[idx / 64] & (std::uint64_t(1) << (idx % 64)));
+				used[idx / 64] &= ~(std::uint64_t(1) << (idx % 64));
+				--used_count;
+			}
+			bool full() const noexcept { return used_count == block_count; }
+		};
+
+		// The shared pool for a single size class. Only touched when a thread's magazine is empty or full.
+		class pool_depot {
+			std::mutex lock;
+			pool_slab* partial = nullptr;
+			std::size_t slab_count = 0;
+		public:
+			std::size_t take(unsigned size_class, void** out, std::size_t count) {
+				std::lock_guard<std::mutex> guard(lock);
+				std::size_t taken = 0;
+				while (taken < count) {
+					if (partial == nullptr) {
+						partial = pool_slab::create(size_class);
+						partial->in_partial = true;
+						++slab_count;
+					}
+					taken += partial->take(out + taken, count - taken);
+					if (partial->full()) {
+						partial->in_partial = false;
+						partial = partial->next_partial;
+					}
+				}
+				return taken;
+			}
+			void give(void** in, std::size_t count) noexcept {
+				std::lock_guard<std::mutex> guard(lock);
+				for (std::size_t i = 0; i < count; i++) {
+					pool_slab* slab = pool_slab::of(in[i]);
+					slab->give(in[i]);
+					if (!slab->in_partial) {
+						slab->in_partial = true;
+						slab->next_partial = partial;
+						partial = slab;
+					}
+				}
+			}
+			std::size_t slabs() noexcept { std::lock_guard<std::mutex> guard(lock); return slab_count; }
+		};
+		// depots are never destroyed, since thread caches may flush into them during static destruction.
+		inline pool_depot* pool_depots() {
+			static pool_depot* depots = new pool_depot[pool_class_count];
+			return depots;
+		}
+
+		// Per-thread magazines. Allocation and deallocation only touch this, except when a magazine
+		// is empty (refill half from the depot) or full (return half to the depot). Blocks freed by a different
+		// thread than allocated them simply land in the freeing thread's magazine.
+		class pool_thread_cache {
+			static const std::size_t magazine_size = 64;
+			struct magazine {
+				std::size_t count = 0;
+				void* blocks[magazine_size];
+			};
+			magazine mags[pool_class_count];
+		public:
+			~pool_thread_cache() {
+				for (unsigned c = 0; c < pool_class_count; c++)
+					if (mags[c].count) pool_depots()[c].give(mags[c].blocks, mags[c].count);
+			}
+			void* allocate(unsigned size_class) {
+				magazine& mag = mags[size_class];
+				if (mag.count == 0) { [[unlikely]]
+					mag.count = pool_depots()[size_class].take(size_class, mag.blocks, magazine_size / 2);
+				}
+				return mag.blocks[--mag.count];
+			}
+			void deallocate(unsigned size_class, void* block) noexcept {
+				magazine& mag = mags[size_class];
+				if (mag.count == magazine_size) { [[unlikely]]
+					pool_depots()[size_class].give(mag.blocks + magazine_size / 2, magazine_size / 2);
+					mag.count = magazine_size / 2;
+				}
+				mag.blocks[mag.count++] = block;
+			}
+		};
+		inline pool_thread_cache& pool_cache() {
+			static thread_local pool_thread_cache cache;
+			return cache;
+		}
+	}
+
+	/**
+	* Allocate from the process-wide size-class pool. Blocks up to 1024 bytes are carved from 64KB slabs,
+	* and cached in per-thread magazines, so the common case takes no locks and no atomics. Larger or overaligned
+	* requests go to the heap. Memory may be freed from any thread, but the size and alignment must match the allocation.
+	**/
+	inline void* pool_allocate(std::size_t bytes, std::size_t alignment = alignof(std::max_align_t)) {
+		if (bytes > impl::pool_max_block_size || alignment > impl::pool_block_alignment) {
+			return ::operator new(bytes, std::align_val_t(alignment));
+		}
+		return impl::pool_cache().allocate(impl::pool_size_class(bytes));
+	}
+	inline void pool_deallocate(void* ptr, std::size_t bytes, std::size_t alignment = alignof(std::max_align_t)) noexcept {
+		if (bytes > impl::pool_max_block_size || alignment > impl::pool_block_alignment) {
+			::operator delete(ptr, std::align_val_t(alignment));
+			return;
+		}
+		impl::pool_cache().deallocate(impl::pool_size_class(bytes), ptr);
+	}
+
+	// A stateless standard-conforming allocator that allocates from the process-wide size-class pool.
+	template<class T>
+	class pool_allocator {
+	public:
+		using pointer = T*;
+		using const_pointer = const T*;
+		using void_pointer = void*;
+		using const_void_pointer = const void*;
+		using value_type = T;
+		using size_type = std::size_t;
+		using difference_type = std::ptrdiff_t;
+		using propagate_on_container_copy_assignment = std::false_type;
+		using propagate_on_container_move_assignment = std::true_type;
+		using propagate_on_container_swap = std::false_type;
+		using is_always_equal = std::true_type;
+		template <class U> struct rebind { using other = pool_allocator<U>; };
+
+		pool_allocator() noexcept {}
+		template<class U>
+		pool_allocator(const pool_allocator<U>&) noexcept {}
+
+		pointer allocate(std::size_t count) {
+			if (count > max_size()) throw std::bad_array_new_length();
+			return static_cast<pointer>(pool_allocate(count * sizeof(T), alignof(T)));
+		}
+		pointer allocate(std::size_t count, const_void_pointer) { return allocate(count); }
+		void deallocate(pointer ptr, std::size_t count) noexcept { pool_deallocate(ptr, count * sizeof(T), alignof(T)); }
+		std::size_t max_size() const noexcept { return std::numeric_limits<std::size_t>::max() / sizeof(T); }
+
+		template<class U>
+		bool operator==(const pool_allocator<U>&) const noexcept { return true; }
+		template<class U>
+		bool operator!=(const pool_allocator<U>&) const noexcept { return false; }
+	};
+}
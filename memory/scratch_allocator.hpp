@@ -0,0 +1,106 @@
+#pragma once
+#include <cassert>
+#include <cstddef>
+#include <type_traits>
+#include "memory/arena_allocator.hpp"
+
+namespace mpd {
+	class scratch_frame;
+	template<class T> class scratch_allocator;
+	namespace impl {
+		// each thread has a LIFO scratch stack, that grows in 64KB chunks and never shrinks.
+		inline monotonic_arena& scratch_arena() noexcept {
+			static thread_local monotonic_arena arena(64 * 1024);
+			return arena;
+		}
+		// the innermost live scratch_frame on the calling thread, which is the only one that may allocate.
+		inline scratch_frame*& scratch_top_frame() noexcept {
+			static thread_local scratch_frame* top = nullptr;
+			return top;
+		}
+	}
+
+	/**
+	* A scope on the calling thread's scratch stack. Everything allocated from the frame is released when the frame
+	* goes out of scope, at the cost of a pointer bump per allocation. This replaces alloca, and std::vector temporaries.
+	*
+	* Frames must be destroyed in the reverse order that they were created, which scoping takes care of. The frame
+	* only provides memory: objects constructed in it must be destroyed before the frame is, and must not escape it.
+	* Only the innermost frame may allocate, since an inner frame's rewind would release what an outer frame allocated
+	* after it. So a container on an outer frame must not grow while an inner frame is alive, which debug builds assert.
+	* ex:
+	* scratch_frame frame;
+	* int* temp = frame.alloc<int>(count);
+	* std::vector<int, mpd::scratch_allocator<int>> temp_vec(frame.get_allocator<int>());
+	**/
+	class scratch_frame {
+		monotonic_arena& arena;
+		monotonic_arena::marker start;
+		scratch_frame* previous;
+	public:
+		scratch_frame() noexcept : arena(impl::scratch_arena()), start(arena.mark()), previous(impl::scratch_top_frame()) {
+			impl::scratch_top_frame() = this;
+		}
+		scratch_frame(const scratch_frame&) = delete;
+		scratch_frame& operator=(const scratch_frame&) = delete;
+		~scratch_frame() {
+			assert(is_top());
+			impl::scratch_top_frame() = previous;
+			arena.rewind(start);
+		}
+
+		// true if this is the innermost frame on the calling thread, and so may allocate
+		bool is_top() const noexcept { return impl::scratch_top_frame() == this; }
+		// uninitialized storage for count objects of type T
+		template<class T>
+		T* alloc(std::size_t count) { return static_cast<T*>(raw_allocate(count * sizeof(T), alignof(T))); }
+		void* raw_allocate(std::size_t bytes, std::size_t alignment = alignof(std::max_align_t)) {
+			assert(is_top() && "an outer scratch_frame allocated while an inner frame is alive");
+			return arena.raw_allocate(bytes, alignment);
+		}
+		// Only reclaims the space if it's the frame's last allocation.
+		void raw_deallocate(void* ptr, std::size_t bytes) noexcept { arena.raw_deallocate(ptr, bytes); }
+		// allocator for containers that live inside of this frame
+		template<class T>
+		scratch_allocator<T> get_allocator() noexcept;
+	};
+
+	// An allocator bound to a scratch_frame, for containers that live inside of that frame.
+	template<class T>
+	class scratch_allocator {
+		template<class U> friend class scratch_allocator;
+		scratch_frame* frame;
+	public:
+		using pointer = T*;
+		using const_pointer = const T*;
+		using void_pointer = void*;
+		using const_void_pointer = const void*;
+		using value_type = T;
+		using size_type = std::size_t;
+		using difference_type = std::ptrdiff_t;
+		using propagate_on_container_copy_assignment = std::true_type;
+		using propagate_on_container_move_assignment = std::true_type;
+		using propagate_on_container_swap = std::true_type;
+		using is_always_equal = std::false_type;
+		template <class U> struct rebind { using other = scratch_allocator<U>; };
+
+		explicit scratch_allocator(scratch_frame& frame_) noexcept : frame(&frame_) {}
+		template<class U>
+		scratch_allocator(const scratch_allocator<U>& rhs) noexcept : frame(rhs.frame) {}
+		scratch_allocator select_on_container_copy_construction() const noexcept { return *this; }
+
+		pointer allocate(std::size_t count) { return frame->alloc<T>(count); }
+		pointer allocate(std::size_t count, const_void_pointer) { return allocate(count); }
+		void deallocate(pointer ptr, std::size_t count) noexcept { frame->raw_deallocate(ptr, count * sizeof(T)); }
+		std::size_t max_size() const noexcept { return std::size_t(-1) / sizeof(T); }
+		scratch_frame& resource() const noexcept { return *frame; }
+
+		template<class U>
+		bool operator==(const scratch_allocator<U>& rhs) const noexcept { return frame == rhs.frame; }
+		template<class U>
+		bool operator!=(const scratch_allocator<U>& rhs) const noexcept { return frame != rhs.frame; }
+	};
+
+	template<class T>
+	scratch_allocator<T> scratch_frame::get_allocator() noexcept { return scratch_allocator<T>(*this); }
+}
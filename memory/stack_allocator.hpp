@@ -1,74 +1,74 @@
 #pragma once
+#include <algorithm>
 #include <cassert>
 #include <cstddef>
-#include <bitset>
+#include <cstdint>
+#include <iterator>
 #include <memory>
+#include <new>
+#include <stdexcept>
 #include <string>
+#include <type_traits>
 #include <vector>
-#include <intrin.h>
-#pragma intrinsic(_BitScanForward, _BitScanForward64)
+#if __has_include(<string_view>)
+#include <string_view>
+#endif
+#include "numerics/bit.hpp"
 
 namespace mpd {
-	template<unsigned char alloc_size_bytes, unsigned char alloc_count = 1>
+	template<std::size_t alloc_size_bytes, std::size_t alloc_count = 1>
 	class allocation_buffer {
-		using block = char[alloc_size_bytes];
+		static_assert(alloc_size_bytes > 0 && alloc_count > 0, "allocation_buffer must have space");
+		static const std::size_t block_bytes = (alloc_size_bytes + alignof(std::max_align_t) - 1) / alignof(std::max_align_t) * alignof(std::max_align_t);
+		static const std::size_t word_count = (alloc_count + 63) / 64;
 
-		std::bitset<alloc_count> used;
-		block buffer[alloc_count];
-		int first_unused_index() {
-			const int ulz = sizeof(unsigned long);
-			const int ullz = sizeof(unsigned long long);
-			if (alloc_count == 1) {
-				return used.any() ? throw std::bad_alloc() : 0;
-			} else if (alloc_count <= ulz) {
-				unsigned long bits = used.to_ulong();
-				if (bits == 0) return 0;
-				if (~bits == 0) throw std::bad_alloc();
-				unsigned long result;
-				_BitScanForward(&result, ~bits);
-				if (result >= alloc_count) throw std::bad_alloc();
-				return result;
-			}
-			int ullong_alloc_count = (alloc_count + ullz - 1) / ullz;
-			int offset = 0;
-			for (int i = 0; i < ullong_alloc_count; i++) {
-				unsigned long long bits = (used >> (i * ullz)).to_ullong();
-				if (bits == 0) return 0;
-				if (~bits == 0) {
-					offset += ullz;
-					continue;
-				}
-				unsigned long result;
-				_BitScanForward64(&result, ~bits);
-				if (result + offset < alloc_count) return result;
-			}
-			throw std::bad_alloc();
+		std::uint64_t used[word_count] = {};
+		alignas(std::max_align_t) char buffer[alloc_count * block_bytes];
+		static std::uint64_t valid_bits(std::size_t word) noexcept {
+			return word + 1 < word_count || alloc_count % 64 == 0 ? ~std::uint64_t(0) : (std::uint64_t(1) << (alloc_count % 64)) - 1;
 		}
 	public:
 		allocation_buffer() noexcept {}
+		allocation_buffer(const allocation_buffer&) = delete;
+		allocation_buffer& operator=(const allocation_buffer&) = delete;
 		~allocation_buffer() {
-			assert(!used.any());
+			assert(std::none_of(std::begin(used), std::end(used), [](std::uint64_t w) { return w != 0; }));
+		}
+		// nullptr if the size is too big, or all blocks are in use
+		char* try_raw_allocate(std::size_t size_bytes) noexcept {
+			if (size_bytes > alloc_size_bytes) return nullptr;
+			for (std::size_t w = 0; w < word_count; w++) {
+				std::uint64_t free_bits = ~used[w] & valid_bits(w);
+				if (free_bits) {
+					unsigned bit = countr_zero(free_bits);
+					used[w] |= std::uint64_t(1) << bit;
+					return buffer + (w * 64 + bit) * block_bytes;
+				}
+			}
+			return nullptr;
 		}
 		char* raw_allocate(std::size_t size_bytes) {
-			assert(size_bytes <= alloc_size_bytes);
-			int idx = first_unused_index();
-			used.set(idx);;
-			return &(buffer[idx][0]);
+			char* ptr = try_raw_allocate(size_bytes);
+			if (ptr == nullptr) throw std::bad_alloc();
+			return ptr;
 		}
 		void raw_deallocate(char* ptr) noexcept {
-			assert((ptr - (char*) std::begin(buffer)) % sizeof(block) == 0);
-			assert(ptr >= (char*) std::begin(buffer));
-			assert(ptr < (char*) std::end(buffer));
-			std::ptrdiff_t idx = (block*) ptr - std::begin(buffer);
-			assert(idx >= 0);
-			assert(idx < alloc_count);
-			used.reset(idx);
+			assert(owns(ptr));
+			assert((ptr - buffer) % block_bytes == 0);
+			std::size_t idx = static_cast<std::size_t>(ptr - buffer) / block_bytes;
+			assert(used[idx / 64] & (std::uint64_t(1) << (idx % 64)));
+			used[idx / 64] &= ~(std::uint64_t(1) << (idx % 64));
+		}
+		bool owns(const void* ptr) const noexcept {
+			const char* p = static_cast<const char*>(ptr);
+			return p >= buffer && p < buffer + sizeof(buffer);
 		}
 	};
 
 	// One pointer, allocates from the referenced allocation_buffer
-	template<class T, unsigned short alloc_size_bytes, unsigned char alloc_count>
+	template<class T, std::size_t alloc_size_bytes, std::size_t alloc_count>
 	class buffer_allocator {
+		template<class U, std::size_t, std::size_t> friend class buffer_allocator;
 		allocation_buffer<alloc_size_bytes, alloc_count>* buffer;
 	public:
 		using pointer = T*;
@@ -78,36 +78,37 @@ namespace mpd {
 		using value_type = T;
 		using size_type = std::size_t;
 		using difference_type = std::ptrdiff_t;
-		const bool propagate_on_container_copy_assignment = true;
-		const bool propagate_on_container_move_assignment = true;
-		const bool propagate_on_container_swap = true;
-		const bool is_always_equal = false;
+		using propagate_on_container_copy_assignment = std::true_type;
+		using propagate_on_container_move_assignment = std::true_type;
+		using propagate_on_container_swap = std::true_type;
+		using is_always_equal = std::false_type;
 		template <class U> struct rebind { using other = buffer_allocator<U, alloc_size_bytes, alloc_count>; };
 
 		buffer_allocator(allocation_buffer<alloc_size_bytes, alloc_count>& _buffer) noexcept : buffer(&_buffer) {}
-		buffer_allocator(const buffer_allocator& rhs) noexcept : buffer(rhs.buffer) {}
-		buffer_allocator(buffer_allocator&& rhs) noexcept : buffer(rhs.buffer) {}
-		buffer_allocator& operator=(const buffer_allocator& rhs) noexcept { buffer = rhs.buffer; return *this; }
-		buffer_allocator& operator=(buffer_allocator&& rhs) noexcept { buffer = rhs.buffer; return *this; }
-		buffer_allocator select_on_container_copy_construction() noexcept { return buffer_allocator(*this); }
+		template<class U>
+		buffer_allocator(const buffer_allocator<U, alloc_size_bytes, alloc_count>& rhs) noexcept : buffer(rhs.buffer) {}
+		buffer_allocator select_on_container_copy_construction() const noexcept { return *this; }
 
-		pointer allocate(std::size_t bytes) { return (pointer) (buffer->raw_allocate(bytes)); }
-		pointer allocate(std::size_t bytes, const_void_pointer hint) noexcept { return allocate(bytes); }
-		void deallocate(pointer ptr, std::size_t) { buffer->raw_deallocate((char*) ptr); }
-		std::size_t max_size() noexcept { return alloc_size_bytes; }
-		template<class T, class...Us>
-		T construct(T* ptr, Us... vs) { return new(ptr)T(std::forward<Us...>(vs)); }
-		template<class T>
-		void destroy(T* ptr) noexcept { ptr->~T(); }
+		pointer allocate(std::size_t count) { return reinterpret_cast<pointer>(buffer->raw_allocate(count * sizeof(T))); }
+		pointer allocate(std::size_t count, const_void_pointer) { return allocate(count); }
+		void deallocate(pointer ptr, std::size_t) noexcept { buffer->raw_deallocate(reinterpret_cast<char*>(ptr)); }
+		std::size_t max_size() const noexcept { return alloc_size_bytes / sizeof(T); }
 
-		bool operator==(const buffer_allocator& rhs) const noexcept { return buffer == rhs.buffer; }
-		bool operator!=(const buffer_allocator& rhs) const noexcept { return buffer != rhs.buffer; }
+		template<class U>
+		bool operator==(const buffer_allocator<U, alloc_size_bytes, alloc_count>& rhs) const noexcept { return buffer == rhs.buffer; }
+		template<class U>
+		bool operator!=(const buffer_allocator<U, alloc_size_bytes, alloc_count>& rhs) const noexcept { return buffer != rhs.buffer; }
 	};
 
-	// large buffer, is a allocation_buffer
-	template<class T, unsigned char alloc_size_bytes, unsigned char alloc_count = 1>
+	// Is its own allocation_buffer. Allocations that don't fit in a free block go to the Fallback allocator instead.
+	template<class T, std::size_t alloc_size_bytes, std::size_t alloc_count = 1, class Fallback = std::allocator<T>>
 	struct local_allocator
 		: allocation_buffer<alloc_size_bytes, alloc_count> {
+	private:
+		using fallback_allocator = typename std::allocator_traits<Fallback>::template rebind_alloc<T>;
+		using fallback_traits = std::allocator_traits<fallback_allocator>;
+		fallback_allocator fallback;
+	public:
 		using pointer = T*;
 		using const_pointer = const T*;
 		using void_pointer = void*;
@@ -115,63 +116,102 @@ namespace mpd {
 		using value_type = T;
 		using size_type = std::size_t;
 		using difference_type = std::ptrdiff_t;
-		const bool propagate_on_container_copy_assignment = false;
-		const bool propagate_on_container_move_assignment = false;
-		const bool propagate_on_container_swap = false;
-		const bool is_always_equal = false;
-		template <class U> struct rebind { using other = local_allocator<U, alloc_size_bytes, alloc_count>; };
+		using propagate_on_container_copy_assignment = std::false_type;
+		using propagate_on_container_move_assignment = std::false_type;
+		using propagate_on_container_swap = std::false_type;
+		using is_always_equal = std::false_type;
+		template <class U> struct rebind { using other = local_allocator<U, alloc_size_bytes, alloc_count, Fallback>; };
 
 		local_allocator() noexcept {}
-		local_allocator(const local_allocator& rhs) noexcept {}
-		local_allocator(local_allocator&& rhs) noexcept {}
+		explicit local_allocator(const Fallback& fallback_) noexcept : fallback(fallback_) {}
+		local_allocator(const local_allocator& rhs) noexcept : fallback(rhs.fallback) {}
 		template<class U>
-		local_allocator(const local_allocator<U, alloc_size_bytes, alloc_count>& rhs) noexcept {}
-		local_allocator& operator=(const local_allocator& rhs) noexcept { return *this; }
-		local_allocator& operator=(local_allocator&& rhs) noexcept { return *this; }
-		template<class U>
-		local_allocator& operator=(const local_allocator<U, alloc_size_bytes, alloc_count>& rhs) noexcept { return *this; }
-		local_allocator select_on_container_copy_construction() noexcept { return local_allocator(); }
-
-		pointer allocate(std::size_t bytes) { return (pointer) (this->raw_allocate(bytes)); }
-		pointer allocate(std::size_t bytes, const_void_pointer hint) noexcept { return allocate(bytes); }
-		void deallocate(pointer ptr, std::size_t) { this->raw_deallocate((char*) ptr); }
-		std::size_t max_size() noexcept { return alloc_size_bytes; }
-		template<class T, class...Us>
-		T* construct(T* ptr, Us... vs) { return new(ptr)T(std::forward<Us...>(vs...)); }
-		template<class T>
-		void destroy(T* ptr) noexcept { ptr->~T(); }
+		local_allocator(const local_allocator<U, alloc_size_bytes, alloc_count, Fallback>& rhs) noexcept : fallback(rhs.get_fallback()) {}
+		local_allocator& operator=(const local_allocator&) noexcept { return *this; }
+		local_allocator select_on_container_copy_construction() const noexcept { return local_allocator(*this); }
 
-		bool operator==(const local_allocator& rhs) const noexcept { return false; }
-		bool operator!=(const local_allocator& rhs) const noexcept { return true; }
+		pointer allocate(std::size_t count) {
+			if (alignof(T) <= alignof(std::max_align_t) && count <= alloc_size_bytes / sizeof(T)) {
+				char* ptr = this->try_raw_allocate(count * sizeof(T));
+				if (ptr) { [[likely]] return reinterpret_cast<pointer>(ptr); }
+			}
+			return fallback_traits::allocate(fallback, count);
+		}
+		pointer allocate(std::size_t count, const_void_pointer) { return allocate(count); }
+		void deallocate(pointer ptr, std::size_t count) noexcept {
+			if (this->owns(ptr)) { [[likely]] this->raw_deallocate(reinterpret_cast<char*>(ptr)); }
+			else fallback_traits::deallocate(fallback, ptr, count);
+		}
+		std::size_t max_size() const noexcept { return fallback_traits::max_size(fallback); }
+		const fallback_allocator& get_fallback() const noexcept { return fallback; }
 
+		bool operator==(const local_allocator& rhs) const noexcept { return this == &rhs; }
+		bool operator!=(const local_allocator& rhs) const noexcept { return this != &rhs; }
 	};
 
-	template<class T, unsigned char max_len>
-	struct small_std_vector : std::vector<T, local_allocator<T, max_len * sizeof(T)>> {
+	/**
+	* A std::vector with space for max_len elements inside of the object. It only touches the heap (or the Fallback
+	* allocator, such as an arena_allocator) if it grows past that.
+	*
+	* Moves and swaps move the elements one by one, since the inline buffer can't be handed to another vector.
+	**/
+	template<class T, std::size_t max_len, class Fallback = std::allocator<T>>
+	struct small_std_vector : std::vector<T, local_allocator<T, max_len * sizeof(T), 1, Fallback>> {
+		using base = std::vector<T, local_allocator<T, max_len * sizeof(T), 1, Fallback>>;
+
 		small_std_vector() noexcept {
 			this->reserve(max_len);
 		}
+		explicit small_std_vector(const Fallback& fallback) : base(typename base::allocator_type(fallback)) {
+			this->reserve(max_len);
+		}
 		explicit small_std_vector(std::size_t count, const T& value) {
 			this->reserve(max_len); this->assign(count, value);
 		}
 		explicit small_std_vector(std::size_t count) {
 			this->reserve(max_len); this->resize(count);
 		}
-		template<class InputIt>
+		template<class InputIt, class = typename std::iterator_traits<InputIt>::iterator_category>
 		small_std_vector(InputIt first, InputIt last) {
 			this->reserve(max_len); this->assign(first, last);
 		}
 		template<class alloc>
-		small_std_vector(const std::vector < T, alloc>& other) {
-			this->reserve(max_len); this->assign(other);
+		small_std_vector(const std::vector<T, alloc>& other) {
+			this->reserve(max_len); this->assign(other.begin(), other.end());
 		}
 		small_std_vector(std::initializer_list<T> init) {
 			this->reserve(max_len); this->assign(init);
 		}
+		small_std_vector(const small_std_vector& other) : base(typename base::allocator_type(other.get_allocator().get_fallback())) {
+			this->reserve(max_len); this->assign(other.begin(), other.end());
+		}
+		small_std_vector(small_std_vector&& other) : base(typename base::allocator_type(other.get_allocator().get_fallback())) {
+			this->reserve(max_len); this->assign(std::make_move_iterator(other.begin()), std::make_move_iterator(other.end()));
+		}
+		small_std_vector& operator=(const small_std_vector& other) {
+			this->assign(other.begin(), other.end()); return *this;
+		}
+		small_std_vector& operator=(small_std_vector&& other) {
+			this->assign(std::make_move_iterator(other.begin()), std::make_move_iterator(other.end())); return *this;
+		}
+		small_std_vector& operator=(std::initializer_list<T> init) {
+			this->assign(init); return *this;
+		}
+		// std::vector implements these by trading buffers with a temporary, which has its own inline buffer
+		void shrink_to_fit() noexcept {}
+		void swap(small_std_vector& other) {
+			small_std_vector tmp(std::move(other));
+			other = std::move(*this);
+			*this = std::move(tmp);
+		}
+		friend void swap(small_std_vector& l, small_std_vector& r) { l.swap(r); }
 	};
 
-	template<class charT, unsigned char max_len>
-	struct small_std_basic_string : std::basic_string<charT, std::char_traits<charT>, local_allocator<charT, (max_len + 1 * sizeof(charT))>> {
+	// A std::basic_string with space for max_len characters inside of the object. It only touches the heap if it grows past that.
+	template<class charT, std::size_t max_len>
+	struct small_std_basic_string : std::basic_string<charT, std::char_traits<charT>, local_allocator<charT, (max_len + 1) * sizeof(charT)>> {
+		using base = std::basic_string<charT, std::char_traits<charT>, local_allocator<charT, (max_len + 1) * sizeof(charT)>>;
+
 		small_std_basic_string() noexcept {
 			this->reserve(max_len);
 		}
@@ -180,8 +220,9 @@ namespace mpd {
 		}
 		template<class alloc>
 		small_std_basic_string(const std::basic_string<charT, std::char_traits<charT>, alloc>& other,
-			std::size_t pos, std::size_t count = std::basic_string<charT>::npos) {
-			this->reserve(max_len); this->assign(other, pos, count);
+			std::size_t pos, std::size_t count = base::npos) {
+			if (pos > other.size()) throw std::out_of_range(std::to_string(pos) + " is past the end of the string");
+			this->reserve(max_len); this->assign(other.data() + pos, std::min(count, other.size() - pos));
 		}
 		small_std_basic_string(const charT* s, std::size_t count) {
 			this->reserve(max_len); this->assign(s, count);
@@ -189,42 +230,63 @@ namespace mpd {
 		small_std_basic_string(const charT* s) {
 			this->reserve(max_len); this->assign(s);
 		}
-		template<class InputIt>
+		template<class InputIt, class = typename std::iterator_traits<InputIt>::iterator_category>
 		small_std_basic_string(InputIt first, InputIt last) {
 			this->reserve(max_len); this->assign(first, last);
 		}
 		template<class alloc>
 		small_std_basic_string(const std::basic_string<charT, std::char_traits<charT>, alloc>& other) {
-			this->reserve(max_len); this->assign(other);
+			this->reserve(max_len); this->assign(other.data(), other.size());
 		}
 		small_std_basic_string(const std::initializer_list<charT>& iList) {
 			this->reserve(max_len); this->assign(iList);
 		}
-#if _HAS_CXX17
-		template<class T, std::enable_if_t <
+		small_std_basic_string(const small_std_basic_string& other) : base() {
+			this->reserve(max_len); this->assign(other.data(), other.size());
+		}
+		small_std_basic_string(small_std_basic_string&& other) : base() {
+			this->reserve(max_len); this->assign(other.data(), other.size());
+		}
+		small_std_basic_string& operator=(const small_std_basic_string& other) {
+			this->assign(other.data(), other.size()); return *this;
+		}
+		small_std_basic_string& operator=(small_std_basic_string&& other) {
+			this->assign(other.data(), other.size()); return *this;
+		}
+		small_std_basic_string& operator=(const charT* s) {
+			this->assign(s); return *this;
+		}
+		void shrink_to_fit() noexcept {}
+		void swap(small_std_basic_string& other) {
+			small_std_basic_string tmp(std::move(other));
+			other = std::move(*this);
+			*this = std::move(tmp);
+		}
+		friend void swap(small_std_basic_string& l, small_std_basic_string& r) { l.swap(r); }
+#if __cpp_lib_string_view
+		template<class T, std::enable_if_t<
 			std::is_convertible_v<const T&, std::basic_string_view<charT>>
-			&& !std::is_convertible_v<const T&, const CharT* >>= 0>
-			explicit small_std_basic_string(const T& other) {
-			this->reserve(max_len); this->assign(std::basic_string_view<charT, std::char_tarits<charT>>(other));
+			&& !std::is_convertible_v<const T&, const charT*>, int> = 0>
+		explicit small_std_basic_string(const T& other) {
+			this->reserve(max_len); this->assign(std::basic_string_view<charT>(other));
 		}
 		template<class T, std::enable_if_t<
-			std::is_convertible_v<const T&, std::basic_string_view<CharT, Traits>> >= 0>
+			std::is_convertible_v<const T&, std::basic_string_view<charT>>, int> = 0>
 		small_std_basic_string(const T& other, std::size_t pos, std::size_t n) {
-			this->reserve(max_len); this->assign(std::basic_string_view<charT, std::char_tarits<charT>>(other, pos, n));
+			this->reserve(max_len); this->assign(std::basic_string_view<charT>(other).substr(pos, n));
 		}
 #endif
 	};
-	template<unsigned char max_len>
+	template<std::size_t max_len>
 	using small_std_string = small_std_basic_string<char, max_len>;
-	template<unsigned char max_len>
+	template<std::size_t max_len>
 	using small_std_wstring = small_std_basic_string<wchar_t, max_len>;
-#if _HAS_CXX17
-	template<unsigned char max_len>
-	using small_std_u8string = small_std_basic_string<std::char8_t, max_len>;
-	template<unsigned char max_len>
-	using small_std_u16string = small_std_basic_string<std::char16_t, max_len>;
-	template<unsigned char max_len>
-	using small_std_u32string = small_std_basic_string<std::char32_t, max_len>;
-}
+#if __cpp_char8_t
+	template<std::size_t max_len>
+	using small_std_u8string = small_std_basic_string<char8_t, max_len>;
 #endif
-}
\ No newline at end of file
+	template<std::size_t max_len>
+	using small_std_u16string = small_std_basic_string<char16_t, max_len>;
+	template<std::size_t max_len>
+	using small_std_u32string = small_std_basic_string<char32_t, max_len>;
+}
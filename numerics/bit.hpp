@@ -0,0 +1,40 @@
+#pragma once
+#include <cstdint>
+#if __has_include(<bit>)
+#include <bit>
+#endif
+#if defined(_MSC_VER) && !__cpp_lib_bitops
+#include <intrin.h>
+#pragma intrinsic(_BitScanForward64, _BitScanReverse64)
+#endif
+
+namespace mpd {
+	// C++14 forwards compatability for <bit>, for the 64 bit case only.
+#if __cpp_lib_bitops
+	inline unsigned countr_zero(std::uint64_t bits) noexcept { return static_cast<unsigned>(std::countr_zero(bits)); }
+	inline unsigned bit_width(std::uint64_t bits) noexcept { return static_cast<unsigned>(std::bit_width(bits)); }
+#else
+	// the number of zero bits below the lowest set bit. 64 if there are no set bits.
+	inline unsigned countr_zero(std::uint64_t bits) noexcept {
+		if (bits == 0) return 64;
+#ifdef _MSC_VER
+		unsigned long result;
+		_BitScanForward64(&result, bits);
+		return result;
+#else
+		return static_cast<unsigned>(__builtin_ctzll(bits));
+#endif
+	}
+	// the number of bits needed to represent the value. 0 for 0.
+	inline unsigned bit_width(std::uint64_t bits) noexcept {
+		if (bits == 0) return 0;
+#ifdef _MSC_VER
+		unsigned long result;
+		_BitScanReverse64(&result, bits);
+		return result + 1;
+#else
+		return 64u - static_cast<unsigned>(__builtin_clzll(bits));
+#endif
+	}
+#endif
+}
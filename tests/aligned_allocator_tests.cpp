@@ -0,0 +1,25 @@
+#include "containers/front_buffer.hpp"
+#include "memory/aligned_allocator.hpp"
+#include "memory/memory.hpp"
+#include <cassert>
+#include <vector>
+
+void test_aligned_allocator() {
+	{ // standard containers
+		std::vector<char, mpd::aligned_allocator<char, 64>> vec(3);
+		assert(mpd::is_aligned_ptr(vec.data(), 64));
+		std::vector<double, mpd::page_aligned_allocator<double>> pages(1000);
+		assert(mpd::is_aligned_ptr(pages.data(), mpd::page_size));
+		assert(mpd::aligned_allocator<int>() == mpd::aligned_allocator<char>());
+	}
+	{ // aligned dynamic_buffer
+		mpd::aligned_buffer<float> samples = mpd::make_aligned_buffer<float>(10);
+		assert(mpd::is_aligned_ptr(samples.data(), mpd::cache_line_size));
+		for (int i = 0; i < 10; i++)
+			samples.push_back(static_cast<float>(i));
+		assert(samples.size() == 10);
+		assert(samples[9] == 9.0f);
+		mpd::aligned_buffer<char, mpd::page_size> page = mpd::make_aligned_buffer<char, mpd::page_size>(100);
+		assert(mpd::is_aligned_ptr(page.data(), mpd::page_size));
+	}
+}
@@ -0,0 +1,108 @@
+#include "containers/front_buffer.hpp"
+#include "memory/arena_allocator.hpp"
+#include "memory/memory.hpp"
+#include "memory/stack_allocator.hpp"
+#include <cassert>
+#include <cstdint>
+#include <new>
+#include <string>
+#include <vector>
+
+void test_arena_allocator() {
+	{ // allocations come from the local buffer first, then grow into the heap
+		mpd::local_arena<256> arena;
+		void* a = arena.raw_allocate(100);
+		assert(arena.owns(a));
+		assert(arena.heap_bytes() == 0);
+		void* b = arena.raw_allocate(100);
+		assert(b != a);
+		assert(arena.heap_bytes() == 0);
+		void* c = arena.raw_allocate(100);
+		assert(arena.owns(c));
+		assert(arena.heap_bytes() >= 100);
+		assert(mpd::is_aligned_ptr(static_cast<char*>(c), alignof(std::max_align_t)));
+	}
+	{ // reset keeps the heap chunks, and reuses them
+		mpd::local_arena<64> arena(1024);
+		arena.raw_allocate(64);
+		void* first_heap = arena.raw_allocate(512);
+		std::size_t heap = arena.heap_bytes();
+		arena.reset();
+		arena.raw_allocate(64);
+		void* second_heap = arena.raw_allocate(512);
+		assert(first_heap == second_heap);
+		assert(arena.heap_bytes() == heap);
+		arena.release();
+		assert(arena.heap_bytes() == 0);
+	}
+	{ // oversized allocations get their own chunk
+		mpd::monotonic_arena arena(64);
+		void* big = arena.raw_allocate(10000, 64);
+		assert(arena.owns(big));
+		assert(mpd::is_aligned_ptr(static_cast<char*>(big), 64));
+		assert(arena.heap_bytes() >= 10000);
+	}
+	{ // standard-conforming allocator
+		mpd::local_arena<1024> arena;
+		std::vector<int, mpd::arena_allocator<int>> vec{mpd::arena_allocator<int>(arena)};
+		for (int i = 0; i < 100; i++)
+			vec.push_back(i);
+		assert(vec.size() == 100);
+		assert(vec[99] == 99);
+		assert(arena.owns(vec.data()));
+		std::basic_string<char, std::char_traits<char>, mpd::arena_allocator<char>> str("this is a string too long for SSO", mpd::arena_allocator<char>(arena));
+		assert(arena.owns(str.data()));
+	}
+	{ // dynamic_buffer
+		mpd::local_arena<1024> arena;
+		using state = mpd::impl::front_buffer_heap_state<std::string, mpd::arena_allocator<std::string>, alignof(std::string)>;
+		mpd::dynamic_buffer<std::string, mpd::arena_allocator<std::string>> buffer(state(20, mpd::arena_allocator<std::string>(arena)));
+		assert(buffer.capacity() == 20);
+		for (int i = 0; i < 20; i++)
+			buffer.push_back(std::to_string(i));
+		assert(arena.owns(buffer.data()));
+		assert(buffer[19] == "19");
+		buffer.erase(buffer.begin(), buffer.begin() + 10);
+		assert(buffer.size() == 10 && buffer[0] == "10");
+		assert(arena.heap_bytes() == 0);
+	}
+	{ // small_std_vector spills into the arena instead of the heap
+		mpd::local_arena<4096> arena;
+		using vector_t = mpd::small_std_vector<int, 8, mpd::arena_allocator<int>>;
+		vector_t vec{mpd::arena_allocator<int>(arena)};
+		for (int i = 0; i < 8; i++)
+			vec.push_back(i);
+		const char* self = reinterpret_cast<const char*>(&vec);
+		const char* data = reinterpret_cast<const char*>(vec.data());
+		assert(data >= self && data < self + sizeof(vec));
+		assert(arena.initial_bytes_used() == 0);
+		for (int i = 8; i < 100; i++)
+			vec.push_back(i);
+		assert(arena.owns(vec.data()));
+		assert(vec.size() == 100 && vec[99] == 99);
+		vector_t copy(vec);
+		assert(arena.owns(copy.data()) && copy[99] == 99);
+		assert(arena.heap_bytes() == 0);
+	}
+	{ // sizes near the top of the address space neither wrap around, nor form pointers past the buffer
+		mpd::local_arena<64> arena;
+		arena.raw_allocate(8);
+		bool thrown = false;
+		try { arena.raw_allocate(std::size_t(-1) - 16); }
+		catch (const std::bad_alloc&) { thrown = true; }
+		assert(thrown);
+		assert(arena.remaining_bytes() <= 64);
+		void* fits = arena.raw_allocate(8, 1);
+		assert(arena.owns(fits));
+	}
+#if __cpp_lib_memory_resource
+	{ // std::pmr interop
+		mpd::local_arena<1024> arena;
+		mpd::arena_memory_resource resource(arena);
+		std::pmr::vector<int> vec(&resource);
+		vec.assign(50, 3);
+		assert(arena.owns(vec.data()));
+		assert(arena.heap_bytes() == 0);
+	}
+#endif
+}
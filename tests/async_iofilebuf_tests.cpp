@@ -2,6 +2,8 @@
 #include <cassert>
 #include <fstream>
 #include <iostream>
+#include <iterator>
+#include <string>
 #include "inputoutput/async_ifilebuf.hpp"
 #include "inputoutput/async_ofilebuf.hpp"
 
@@ -65,4 +67,76 @@ void test_async_iofilebuf() {
 	assert_file_contents("outputFile2.txt", 0, 50, 'A');
 	assert_file_contents("outputFile2.txt", 50, 50, "  40\n  41\n  42\n  43\n  44\n  45\n  46\n  47\n  48\n  49\n");
 	assert_file_contents("outputFile2.txt", 100, 50, 'A');
+
+	{ // Can copy a file through small, odd sized blocks and shallow rings, which wrap around many times
+		const std::size_t configs[][2] = {{7, 1}, {1000, 3}, {4096, 2}, {1 << 20, 4}};
+		for (const std::size_t* config : configs) {
+			{
+				mpd::async_ifilebuf ibuf("inputfile.txt", std::ios_base::in | std::ios_base::binary, config[0], config[1]);
+				assert(ibuf.block_size() == config[0] && ibuf.ring_depth() == config[1]);
+				std::istream inputFile(&ibuf);
+				mpd::async_ofilebuf obuf("outputFile3.txt", std::ios_base::out | std::ios_base::binary | std::ios_base::trunc, config[0], config[1]);
+				std::ostream outputFile(&obuf);
+				outputFile << inputFile.rdbuf();
+			}
+			assert_file_len("outputFile3.txt", 25000);
+			assert_file_contents("outputFile3.txt", 24990, 10, "4998\n4999\n");
+		}
+	}
+
+	{ // tellg accounts for the blocks read ahead, and relative seeks are from the stream's position
+		mpd::async_ifilebuf ibuf("inputfile.txt", std::ios_base::in | std::ios_base::binary, 64, 3);
+		std::istream inputFile(&ibuf);
+		char buffer[10] = {};
+		inputFile.read(buffer, 10);
+		assert(inputFile.tellg() == 10);
+		inputFile.seekg(190, std::ios_base::cur);
+		assert(inputFile.tellg() == 200);
+		inputFile.read(buffer, 5);
+		assert(std::string(buffer, 5) == "  40\n");
+		inputFile.seekg(-5, std::ios_base::end);
+		inputFile.read(buffer, 5);
+		assert(std::string(buffer, 5) == "4999\n");
+		assert(inputFile.get() == EOF);
+	}
+
+	{ // Reads and writes of a block or more skip the ring, and mix with buffered ones in order
+		std::string contents;
+		{
+			std::ifstream whole("inputfile.txt", std::ios_base::in | std::ios_base::binary);
+			contents.assign(std::istreambuf_iterator<char>(whole), std::istreambuf_iterator<char>());
+		}
+		const std::size_t sizes[] = {3, 5000, 1, 4096, 700, 9000};
+		{
+			mpd::async_ifilebuf ibuf("inputfile.txt", std::ios_base::in | std::ios_base::binary, 1024, 3);
+			std::istream inputFile(&ibuf);
+			mpd::async_ofilebuf obuf("outputFile4.txt", std::ios_base::out | std::ios_base::binary | std::ios_base::trunc, 1024, 3);
+			std::ostream outputFile(&obuf);
+			std::string buffer(9000, '\0');
+			std::size_t position = 0;
+			for (std::size_t i = 0; position < contents.size(); i++) {
+				std::size_t size = sizes[i % 6];
+				inputFile.read(&buffer[0], static_cast<std::streamsize>(size));
+				std::size_t got = static_cast<std::size_t>(inputFile.gcount());
+				assert(got == std::min(size, contents.size() - position));
+				assert(buffer.compare(0, got, contents, position, got) == 0);
+				outputFile.write(buffer.data(), static_cast<std::streamsize>(got));
+				position += got;
+				if (position < contents.size()) {
+					assert(ibuf.in_avail() >= 0);
+					assert(inputFile.tellg() == static_cast<std::streamoff>(position));
+				}
+			}
+			assert(inputFile.eof());
+			assert(ibuf.in_avail() == -1);
+		}
+		assert_file_len("outputFile4.txt", 25000);
+		assert_file_contents("outputFile4.txt", 0, 25000, contents.c_str());
+	}
+
+	{ // A file that doesn't exist reads as empty
+		mpd::async_ifilebuf ibuf("no_such_file.txt", std::ios_base::in | std::ios_base::binary);
+		std::istream inputFile(&ibuf);
+		assert(inputFile.get() == EOF);
+	}
 }
\ No newline at end of file
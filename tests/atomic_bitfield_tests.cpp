@@ -0,0 +1,79 @@
+#include "concurrency/atomic_bitfield.hpp"
+#include <cassert>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+namespace {
+	using state_field = mpd::bitfield_member<std::uint64_t, unsigned, 4, 0>;
+	using refs_field = mpd::bitfield_member<std::uint64_t, unsigned, 28, 4>;
+	using generation_field = mpd::bitfield_member<std::uint64_t, unsigned, 32, 32>;
+	using signed_field = mpd::bitfield_member<std::uint16_t, short, 8, 0>;
+	using flag_field = mpd::bitfield_member<std::uint16_t, bool, 1, 8>;
+	using connection_state = mpd::atomic_bitfield<std::uint64_t, state_field, refs_field, generation_field>;
+}
+
+void test_atomic_bitfield() {
+	{ // single field operations leave the other fields alone
+		connection_state c;
+		c.store<state_field>(3);
+		c.store<generation_field>(0xFFFFFFFFu);
+		assert(c.fetch_add<refs_field>(5) == 0);
+		assert(c.fetch_sub<refs_field>(2) == 5);
+		assert(c.load<refs_field>() == 3);
+		assert(c.load<state_field>() == 3);
+		assert(c.load<generation_field>() == 0xFFFFFFFFu);
+		assert(c.exchange<state_field>(7) == 3);
+		assert(c.load().raw() == (0xFFFFFFFFull << 32 | 3 << 4 | 7));
+
+		unsigned expected = 1;
+		assert(!c.compare_exchange<state_field>(expected, 2));
+		assert(expected == 7);
+		assert(c.compare_exchange<state_field>(expected, 2));
+		assert(c.load<state_field>() == 2 && c.load<refs_field>() == 3);
+	}
+	{ // multi-field updates, and whole value compare-exchange
+		connection_state c;
+		auto r = c.update([](connection_state::value_type& v) {
+			v.set<state_field>(1);
+			v.set<generation_field>(v.get<generation_field>() + 1);
+			return mpd::atomic_exchange_result::store;
+		});
+		assert(r.first && r.second.get<state_field>() == 1 && r.second.get<generation_field>() == 1);
+		connection_state::value_type expected = c.load();
+		connection_state::value_type desired = expected;
+		desired.set<refs_field>(10);
+		assert(c.compare_exchange(expected, desired));
+		assert(!c.compare_exchange(expected, desired));
+		assert(expected == desired);
+	}
+	{ // signed and bool fields
+		mpd::atomic_bitfield<std::uint16_t, signed_field, flag_field> b;
+		b.store<signed_field>(-3);
+		b.store<flag_field>(true);
+		assert(b.fetch_add<signed_field>(1) == -3);
+		assert(b.load<signed_field>() == -2);
+		assert(b.load<flag_field>() == true);
+	}
+	{ // concurrent increments of one field, and generation bumps of another
+		connection_state c;
+		std::vector<std::thread> threads;
+		for (int t = 0; t < 4; t++) {
+			threads.emplace_back([&]() {
+				for (int i = 0; i < 10000; i++) {
+					c.fetch_add<refs_field>(1);
+					c.update<mpd::exponential_backoff<>>([](connection_state::value_type& v) {
+						v.set<generation_field>(v.get<generation_field>() + 1);
+						v.set<state_field>((v.get<state_field>() + 1) % 16);
+						return mpd::atomic_exchange_result::store;
+					});
+				}
+			});
+		}
+		for (std::thread& t : threads)
+			t.join();
+		assert(c.load<refs_field>() == 40000);
+		assert(c.load<generation_field>() == 40000);
+		assert(c.load<state_field>() == 40000 % 16);
+	}
+}
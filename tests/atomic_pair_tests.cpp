@@ -0,0 +1,118 @@
+#include "concurrency/atomic_pair.hpp"
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+namespace {
+	struct counter_pair {
+		std::uint64_t low;
+		std::uint64_t high;
+	};
+	struct node {
+		// a popper can read next while another thread, which popped the node first, pushes it back
+		std::atomic<node*> next;
+		int value;
+	};
+
+	// a free list of preallocated nodes, which pops and pushes the same nodes over and over: the ABA case
+	class free_list {
+		mpd::atomic_tagged_ptr<node> head;
+	public:
+		void push(node* n) {
+			mpd::tagged_ptr<node> old_head = head.load();
+			do {
+				n->next.store(old_head.ptr, std::memory_order_relaxed);
+			} while (!head.compare_exchange_weak(old_head, old_head.with(n)));
+		}
+		node* pop() {
+			mpd::tagged_ptr<node> old_head = head.load();
+			while (old_head.ptr != nullptr && !head.compare_exchange_weak(old_head, old_head.with(old_head.ptr->next.load(std::memory_order_relaxed)))) {}
+			return old_head.ptr;
+		}
+	};
+}
+
+#if defined(__x86_64__) || defined(_M_X64)
+static_assert(mpd::atomic_pair<counter_pair>::is_always_lock_free, "x86-64 has cmpxchg16b");
+#endif
+
+void test_atomic_pair() {
+	{
+		mpd::atomic_pair<counter_pair> pair({1, 2});
+		assert(pair.is_lock_free() == mpd::atomic_pair<counter_pair>::is_always_lock_free);
+		counter_pair value = pair.load();
+		assert(value.low == 1 && value.high == 2);
+		counter_pair expected = {1, 3};
+		assert(!pair.compare_exchange_strong(expected, {5, 6}));
+		assert(expected.low == 1 && expected.high == 2);
+		assert(pair.compare_exchange_strong(expected, {5, 6}));
+		value = pair.exchange({0, 0});
+		assert(value.low == 5 && value.high == 6);
+		pair.store({7, 8});
+		assert(pair.load().high == 8);
+	}
+	{
+		// both halves are always updated together
+		const int thread_count = 4;
+		const int per_thread = 5000;
+		mpd::atomic_pair<counter_pair> pair({0, 0});
+		std::vector<std::thread> threads;
+		for (int t = 0; t < thread_count; t++) {
+			threads.emplace_back([&] {
+				for (int i = 0; i < per_thread; i++) {
+					std::pair<bool, counter_pair> r = mpd::atomic_exchange_spin(pair, [](counter_pair& v) {
+						assert(v.low == v.high);
+						++v.low;
+						++v.high;
+						return mpd::atomic_exchange_result::store;
+					});
+					assert(r.first && r.second.low == r.second.high);
+				}
+			});
+		}
+		for (std::thread& t : threads)
+			t.join();
+		assert(pair.load().low == thread_count * per_thread);
+		assert(pair.load().high == thread_count * per_thread);
+
+		mpd::atomic_spin_stats stats("atomic_pair_abort");
+		std::pair<bool, counter_pair> r = mpd::atomic_exchange_spin(pair, [](counter_pair&) { return mpd::atomic_exchange_result::abort; }, stats);
+		assert(!r.first && r.second.low == thread_count * per_thread);
+		assert(stats.get().aborts == 1);
+	}
+	{
+		const int node_count = 8;
+		const int thread_count = 4;
+		node nodes[node_count];
+		free_list list;
+		for (int i = 0; i < node_count; i++) {
+			nodes[i].value = i;
+			list.push(&nodes[i]);
+		}
+		std::vector<std::thread> threads;
+		for (int t = 0; t < thread_count; t++) {
+			threads.emplace_back([&] {
+				for (int i = 0; i < 20000; i++) {
+					node* n = list.pop();
+					if (n == nullptr) {
+						std::this_thread::yield();
+						continue;
+					}
+					list.push(n);
+				}
+			});
+		}
+		for (std::thread& t : threads)
+			t.join();
+		// every node is still on the list exactly once
+		bool seen[node_count] = {};
+		for (int i = 0; i < node_count; i++) {
+			node* n = list.pop();
+			assert(n != nullptr && !seen[n->value]);
+			seen[n->value] = true;
+		}
+		assert(list.pop() == nullptr);
+	}
+}
@@ -1,6 +1,10 @@
 #include "concurrency/atomic_spin.hpp"
 
+#include <cassert>
+#include <cstring>
 #include <future>
+#include <thread>
+#include <vector>
 
 std::atomic<unsigned long long> aull(1);
 
@@ -29,6 +33,31 @@ void update_odds_to_evens() {
 	} while (r.first && r.second < 100);
 }
 
+template<class Backoff>
+void contended_increment() {
+	const int thread_count = 8;
+	const int per_thread = 5000;
+	mpd::atomic_spin_stats stats("contended_increment");
+	aull = 0;
+	std::vector<std::thread> threads;
+	for (int t = 0; t < thread_count; t++) {
+		threads.emplace_back([&]() {
+			for (int i = 0; i < per_thread; i++)
+				mpd::atomic_exchange_spin<Backoff>(aull, [](auto& value) { ++value; return mpd::atomic_exchange_result::store; }, stats);
+		});
+	}
+	for (std::thread& t : threads)
+		t.join();
+	assert(aull == thread_count * per_thread);
+	mpd::atomic_spin_site_stats s = stats.get();
+	assert(s.calls == thread_count * per_thread);
+	assert(s.retries == 0 && s.aborts == 0);
+	bool listed = false;
+	for (const mpd::atomic_spin_site_stats& site : mpd::atomic_spin_stats_report())
+		listed |= site.name == stats.name() && site.calls == s.calls;
+	assert(listed);
+}
+
 void test_atomic_spin() {
 	// store
 	aull = 0;
@@ -65,4 +94,21 @@ void test_atomic_spin() {
 	std::future<void> odds = std::async(std::launch::async, update_evens_to_odds);
 	update_odds_to_evens();
 	odds.get();
-}
\ No newline at end of file
+
+	// every backoff policy, under contention, with stats
+	contended_increment<mpd::no_backoff>();
+	contended_increment<mpd::pause_backoff>();
+	contended_increment<mpd::exponential_backoff<64>>();
+	contended_increment<mpd::spin_then_yield_backoff<4>>();
+
+	{ // stats count aborts and retries, and unregister when destroyed
+		mpd::atomic_spin_stats stats("abort_site");
+		aull = 0;
+		int tries = 0;
+		mpd::atomic_exchange_spin(aull, [&](auto&) { return ++tries < 3 ? mpd::atomic_exchange_result::retry : mpd::atomic_exchange_result::abort; }, stats);
+		mpd::atomic_spin_site_stats s = stats.get();
+		assert(s.calls == 1 && s.retries == 2 && s.aborts == 1 && s.failures == 0);
+	}
+	for (const mpd::atomic_spin_site_stats& s : mpd::atomic_spin_stats_report())
+		assert(std::strcmp(s.name, "abort_site") != 0);
+}
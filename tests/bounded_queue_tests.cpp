@@ -0,0 +1,162 @@
+#include "concurrency/bounded_queue.hpp"
+#include <cassert>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+	template<class Queue>
+	void single_threaded() {
+		Queue queue;
+		assert(queue.empty_approx());
+		std::vector<std::string> empty_batch;
+		assert(queue.try_push_n(empty_batch.begin(), 0) == 0);
+		assert(queue.try_pop_n(std::back_inserter(empty_batch), 0) == 0);
+		for (int i = 0; i < 4; i++)
+			assert(queue.try_push(std::to_string(i)));
+		assert(!queue.try_push("full"));
+		assert(queue.size_approx() == 4);
+		// empty batches return at once, whether the queue has items or space
+		assert(queue.try_pop_n(std::back_inserter(empty_batch), 0) == 0);
+		std::string out;
+		assert(queue.try_pop(out) && out == "0");
+		std::string batch[] = { "a", "b", "c" };
+		assert(queue.try_push_n(std::make_move_iterator(batch), 3) == 1);
+		assert(batch[0].empty() && batch[1] == "b");
+		std::vector<std::string> popped;
+		assert(queue.try_pop_n(std::back_inserter(popped), 10) == 4);
+		assert((popped == std::vector<std::string>{ "1", "2", "3", "a" }));
+		assert(!queue.try_pop(out));
+		assert(queue.try_push_n(empty_batch.begin(), 0) == 0);
+		assert(empty_batch.empty());
+		// wrap around many times, and leave items behind for the destructor
+		for (int i = 0; i < 100; i++) {
+			assert(queue.try_emplace(3, 'x'));
+			assert(queue.pop() == "xxx");
+		}
+		queue.push(std::string(100, 'y'));
+	}
+
+	// Copying throws while fail is set.
+	struct throwing_copy {
+		static bool fail;
+		int value;
+		explicit throwing_copy(int v) noexcept : value(v) {}
+		throwing_copy(const throwing_copy& rhs) : value(rhs.value) {
+			if (fail) throw std::runtime_error("copy");
+		}
+		throwing_copy& operator=(const throwing_copy& rhs) {
+			if (fail) throw std::runtime_error("copy");
+			value = rhs.value;
+			return *this;
+		}
+	};
+	bool throwing_copy::fail = false;
+
+	template<class Queue>
+	void copy_throws() {
+		Queue queue;
+		throwing_copy good(1);
+		throwing_copy::fail = true;
+		try {
+			queue.try_push(good);
+			assert(false);
+		} catch (const std::runtime_error&) {}
+		throwing_copy batch[] = { throwing_copy(2), throwing_copy(3) };
+		try {
+			queue.try_push_n(batch, 2);
+			assert(false);
+		} catch (const std::runtime_error&) {}
+		throwing_copy::fail = false;
+		// the queue isn't wedged by the cells whose items failed
+		assert(queue.try_push(good));
+		assert(queue.try_push_n(batch, 2) == 2);
+		throwing_copy out(0);
+		assert(queue.try_pop(out) && out.value == 1);
+		// a failed move out doesn't wedge the queue either. spsc_queue keeps the item, and mpmc_queue destroys it.
+		throwing_copy::fail = true;
+		try {
+			queue.try_pop(out);
+			assert(false);
+		} catch (const std::runtime_error&) {}
+		throwing_copy::fail = false;
+		assert(queue.try_push(good));
+		assert(queue.try_pop(out) && (out.value == 2 || out.value == 3));
+		// and the destructor only destroys items that exist
+		queue.try_push(good);
+	}
+
+	template<class Queue>
+	void producers_and_consumers(int producer_count, int consumer_count) {
+		const int per_producer = 20000;
+		Queue queue;
+		std::vector<std::thread> threads;
+		std::vector<std::vector<int>> received(consumer_count);
+		for (int p = 0; p < producer_count; p++) {
+			threads.emplace_back([&, p]() {
+				int next = 0;
+				while (next < per_producer) {
+					if (next % 3 == 0) {
+						int batch[5];
+						std::size_t n = 0;
+						for (; n < 5 && next + int(n) < per_producer; n++)
+							batch[n] = p * per_producer + next + int(n);
+						std::size_t pushed = queue.try_push_n(batch, n);
+						next += int(pushed);
+						if (pushed == 0) std::this_thread::yield();
+					} else
+						queue.push(p * per_producer + next++);
+				}
+			});
+		}
+		const int total = producer_count * per_producer;
+		const int per_consumer = total / consumer_count;
+		for (int c = 0; c < consumer_count; c++) {
+			threads.emplace_back([&, c]() {
+				std::vector<int>& mine = received[c];
+				while (int(mine.size()) < per_consumer) {
+					if (mine.size() % 2 == 0) {
+						int batch[7];
+						std::size_t n = queue.try_pop_n(batch, std::min<std::size_t>(7, per_consumer - mine.size()));
+						mine.insert(mine.end(), batch, batch + n);
+						if (n == 0) std::this_thread::yield();
+					} else
+						mine.push_back(queue.pop());
+				}
+			});
+		}
+		for (std::thread& t : threads)
+			t.join();
+		std::vector<char> seen(total, 0);
+		for (const std::vector<int>& mine : received) {
+			// each producer's items arrive in order at each consumer
+			std::vector<int> last(producer_count, -1);
+			for (int v : mine) {
+				assert(!seen[v]);
+				seen[v] = 1;
+				assert(v > last[v / per_producer]);
+				last[v / per_producer] = v;
+			}
+		}
+		assert(queue.empty_approx());
+	}
+}
+
+void test_bounded_queue() {
+	single_threaded<mpd::spsc_queue<std::string, 4>>();
+	single_threaded<mpd::mpmc_queue<std::string, 4>>();
+	copy_throws<mpd::spsc_queue<throwing_copy, 8>>();
+	copy_throws<mpd::mpmc_queue<throwing_copy, 8>>();
+	{ // move only
+		mpd::mpmc_queue<std::unique_ptr<int>, 8> queue;
+		queue.push(std::make_unique<int>(5));
+		assert(*queue.pop() == 5);
+	}
+	producers_and_consumers<mpd::spsc_queue<int, 8>>(1, 1);
+	producers_and_consumers<mpd::spsc_queue<int, 1024>>(1, 1);
+	producers_and_consumers<mpd::mpmc_queue<int, 8>>(4, 4);
+	producers_and_consumers<mpd::mpmc_queue<int, 256>>(3, 2);
+}
@@ -0,0 +1,58 @@
+#include "concurrency/cache_padded.hpp"
+#include <atomic>
+#include <cassert>
+#include <set>
+#include <thread>
+#include <vector>
+
+void test_cache_padded() {
+	static_assert(alignof(mpd::cache_padded<char>) == mpd::hardware_destructive_interference_size, "");
+	static_assert(sizeof(mpd::cache_padded<char>) == mpd::hardware_destructive_interference_size, "");
+	{ // padded values don't share lines
+		mpd::cache_padded<int> values[2];
+		assert(*values[0] == 0);
+		std::size_t distance = reinterpret_cast<char*>(&values[1].value) - reinterpret_cast<char*>(&values[0].value);
+		assert(distance >= mpd::hardware_destructive_interference_size);
+		mpd::cache_padded<std::vector<int>> vec(std::in_place, 3, 7);
+		assert(vec->size() == 3);
+	}
+	{ // each thread gets its own index, and indexes are reused after the thread exits
+		std::set<unsigned> indexes;
+		std::vector<unsigned> seen(4);
+		std::vector<std::thread> threads;
+		std::atomic<int> started(0);
+		std::atomic<bool> go(false);
+		for (unsigned i = 0; i < 4; i++) {
+			threads.emplace_back([&, i]() {
+				seen[i] = mpd::this_thread_index();
+				started.fetch_add(1);
+				while (!go.load()) std::this_thread::yield();
+			});
+		}
+		while (started.load() != 4) std::this_thread::yield();
+		go.store(true);
+		for (std::thread& t : threads) t.join();
+		indexes.insert(seen.begin(), seen.end());
+		assert(indexes.size() == 4);
+		unsigned reused = 0;
+		std::thread([&]() { reused = mpd::this_thread_index(); }).join();
+		assert(indexes.count(reused) == 1);
+	}
+	{ // per_thread counters
+		mpd::per_thread<std::atomic<long>> counters;
+		std::vector<std::thread> threads;
+		for (int t = 0; t < 8; t++) {
+			threads.emplace_back([&]() {
+				for (int i = 0; i < 10000; i++)
+					counters.local().fetch_add(1, std::memory_order_relaxed);
+			});
+		}
+		for (std::thread& t : threads) t.join();
+		long total = counters.accumulate(0L, [](long sum, const std::atomic<long>& v) { return sum + v.load(std::memory_order_relaxed); });
+		assert(total == 80000);
+		mpd::per_thread<long, 4> plain(5);
+		long sum = 0;
+		plain.for_each([&](long v) { sum += v; });
+		assert(sum == 20);
+	}
+}
@@ -0,0 +1,140 @@
+#include "concurrency/concurrent_hash_map.hpp"
+#include "strings/string_buffer.hpp"
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+	struct pair_value {
+		long long a;
+		long long b;
+	};
+
+	void test_single_thread() {
+		mpd::concurrent_hash_map<std::string, int> map;
+		assert(map.empty());
+		assert(map.insert("one", 1));
+		assert(!map.insert("one", 2));
+		assert(map.find("one") == 1);
+		assert(!map.find("two"));
+		assert(!map.insert_or_assign("one", 3));
+		assert(map.insert_or_assign("two", 2));
+		assert(map.find("one") == 3);
+		assert(map.update("two", [](int& v) { v *= 10; }));
+		assert(!map.update("three", [](int& v) { v *= 10; }));
+		int seen = 0;
+		assert(map.visit("two", [&](const int& v) { seen = v; }));
+		assert(seen == 20);
+		assert(map.size() == 2);
+		assert(map.erase("one"));
+		assert(!map.erase("one"));
+		assert(!map.contains("one"));
+		assert(map.contains("two"));
+		assert(map.size() == 1);
+
+		// grows incrementally, and keeps every key reachable while it does
+		mpd::concurrent_hash_map<std::uint64_t, std::uint64_t> numbers;
+		for (std::uint64_t i = 0; i < 5000; i++) {
+			assert(numbers.insert(i * 1024, i));
+			assert(numbers.find(i * 1024) == i);
+			assert(numbers.find(i / 2 * 1024) == i / 2);
+		}
+		assert(numbers.size() == 5000);
+		assert(numbers.capacity() >= 5000);
+		// keys later in a collision chain than a moved slot haven't necessarily been moved yet
+		mpd::concurrent_hash_map<int, int> chains(128);
+		for (int i = 0; i < 2000; i++) {
+			assert(chains.insert(i, i));
+			for (int j = 0; j <= i; j++)
+				assert(chains.contains(j));
+		}
+		// churn: erasing and inserting leaves erased slots, which are cleaned up by rehashing
+		for (std::uint64_t i = 0; i < 20000; i++) {
+			assert(numbers.erase(i * 1024));
+			assert(numbers.insert((i + 5000) * 1024, i + 5000));
+		}
+		assert(numbers.size() == 5000);
+		assert(numbers.capacity() <= 32768);
+		for (std::uint64_t i = 20000; i < 25000; i++)
+			assert(numbers.find(i * 1024) == i);
+		mpd::default_epoch_domain().drain();
+	}
+
+	// array_string keys are hashed with the std::hash specialization for string_buffers
+	void test_array_string_keys() {
+		using key = mpd::array_string<16>;
+		mpd::concurrent_hash_map<key, int> map;
+		for (int i = 0; i < 2000; i++) {
+			assert(map.insert(key(std::to_string(i)), i));
+			assert(map.find(key(std::to_string(i / 2))) == i / 2);
+		}
+		assert(map.size() == 2000);
+		assert(map.capacity() >= 2000);
+		assert(!map.insert(key("7"), 0));
+		assert(!map.find(key("2000")));
+		for (int i = 0; i < 2000; i += 2)
+			assert(map.erase(key(std::to_string(i))));
+		assert(!map.erase(key("0")));
+		for (int i = 0; i < 2000; i++)
+			assert(map.contains(key(std::to_string(i))) == (i % 2 != 0));
+		assert(map.update(key("1999"), [](int& v) { v = -1; }));
+		assert(map.find(key("1999")) == -1);
+		mpd::default_epoch_domain().drain();
+	}
+
+	void test_threads() {
+		const int writer_count = 3;
+		const int reader_count = 3;
+		const std::uint64_t per_writer = 4000;
+		mpd::concurrent_hash_map<std::uint64_t, pair_value> map;
+		map.insert(0, {0, 0});
+		std::atomic<int> writers_done{0};
+		std::vector<std::thread> threads;
+		for (int w = 0; w < writer_count; w++) {
+			threads.emplace_back([&, w] {
+				for (std::uint64_t i = 1; i <= per_writer; i++) {
+					std::uint64_t key = i * writer_count + w;
+					assert(map.insert(key, {static_cast<long long>(key), static_cast<long long>(key)}));
+					// everyone updates key 0, and both halves must always change together
+					map.update(0, [](pair_value& v) { v.a++; v.b++; });
+					if (i % 4 == 0) assert(map.erase(key));
+				}
+				mpd::default_epoch_domain().quiescent();
+				writers_done++;
+			});
+		}
+		for (int r = 0; r < reader_count; r++) {
+			threads.emplace_back([&] {
+				while (writers_done.load() < writer_count) {
+					std::optional<pair_value> zero = map.find(0);
+					assert(zero && zero->a == zero->b);
+					for (std::uint64_t key = 1; key < 200; key++) {
+						map.visit(key, [&](const pair_value& v) { assert(v.a == static_cast<long long>(key) && v.b == v.a); });
+					}
+					std::this_thread::yield();
+				}
+				mpd::default_epoch_domain().quiescent();
+			});
+		}
+		for (std::thread& t : threads)
+			t.join();
+		assert(map.find(0)->a == writer_count * static_cast<long long>(per_writer));
+		assert(map.size() == 1 + writer_count * per_writer * 3 / 4);
+		for (int w = 0; w < writer_count; w++) {
+			for (std::uint64_t i = 1; i <= per_writer; i++) {
+				std::uint64_t key = i * writer_count + w;
+				assert(map.contains(key) == (i % 4 != 0));
+			}
+		}
+		mpd::default_epoch_domain().drain();
+	}
+}
+
+void test_concurrent_hash_map() {
+	test_single_thread();
+	test_array_string_keys();
+	test_threads();
+}
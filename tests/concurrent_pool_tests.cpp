@@ -0,0 +1,112 @@
+#include "memory/concurrent_pool.hpp"
+#include <cassert>
+#include <deque>
+#include <list>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+namespace {
+	struct message {
+		int producer;
+		int sequence;
+		double payload[3];
+	};
+}
+
+void test_concurrent_pool() {
+	{ // single threaded
+		mpd::concurrent_block_pool pool(sizeof(message), 3);
+		assert(pool.capacity() == 3 && pool.block_size() >= sizeof(message));
+		void* a = pool.allocate();
+		void* b = pool.allocate();
+		void* c = pool.allocate();
+		assert(pool.try_allocate() == nullptr);
+		assert(std::set<void*>({ a, b, c }).size() == 3);
+		assert(pool.owns(a) && pool.owns(b) && pool.owns(c));
+		pool.deallocate(b);
+		assert(pool.try_allocate() == b);
+		pool.deallocate(a);
+		pool.deallocate(b);
+		pool.deallocate(c);
+		assert(pool.unsafe_free_count() == 3);
+		bool thrown = false;
+		try { pool.allocate(); pool.allocate(); pool.allocate(); pool.allocate(); }
+		catch (const std::bad_alloc&) { thrown = true; }
+		assert(thrown);
+	}
+	{ // node containers, overflowing to the heap
+		mpd::concurrent_block_pool pool(64, 100);
+		std::list<int, mpd::concurrent_pool_allocator<int>> list{ mpd::concurrent_pool_allocator<int>(pool) };
+		for (int i = 0; i < 200; i++)
+			list.push_back(i);
+		assert(pool.unsafe_free_count() == 0);
+		list.clear();
+		assert(pool.unsafe_free_count() == 100);
+	}
+	{ // producers allocate, consumers free
+		const int producer_count = 4;
+		const int per_producer = 20000;
+		mpd::concurrent_block_pool pool(sizeof(message), 256);
+		std::mutex lock;
+		std::deque<message*> queue;
+		std::vector<std::thread> threads;
+		std::vector<int> received(producer_count, 0);
+		for (int p = 0; p < producer_count; p++) {
+			threads.emplace_back([&, p]() {
+				for (int i = 0; i < per_producer; i++) {
+					void* block;
+					while ((block = pool.try_allocate()) == nullptr)
+						std::this_thread::yield();
+					message* m = ::new(block) message{ p, i, {} };
+					std::lock_guard<std::mutex> guard(lock);
+					queue.push_back(m);
+				}
+			});
+		}
+		for (int c = 0; c < 2; c++) {
+			threads.emplace_back([&]() {
+				for (;;) {
+					message* m = nullptr;
+					{
+						std::lock_guard<std::mutex> guard(lock);
+						int total = 0;
+						for (int r : received) total += r;
+						if (total == producer_count * per_producer) return;
+						if (!queue.empty()) {
+							m = queue.front();
+							queue.pop_front();
+							assert(m->sequence == received[m->producer]);
+							++received[m->producer];
+						}
+					}
+					if (m) pool.deallocate(m);
+					else std::this_thread::yield();
+				}
+			});
+		}
+		for (std::thread& t : threads)
+			t.join();
+		assert(pool.unsafe_free_count() == 256);
+	}
+	{ // hammer the free list from every thread
+		mpd::concurrent_block_pool pool(16, 64);
+		std::vector<std::thread> threads;
+		for (int t = 0; t < 8; t++) {
+			threads.emplace_back([&]() {
+				void* held[4];
+				for (int i = 0; i < 20000; i++) {
+					int n = 0;
+					for (; n < 4; n++)
+						if ((held[n] = pool.try_allocate()) == nullptr) break;
+					for (int j = 0; j < n; j++)
+						pool.deallocate(held[j]);
+				}
+			});
+		}
+		for (std::thread& t : threads)
+			t.join();
+		assert(pool.unsafe_free_count() == 64);
+	}
+}
@@ -0,0 +1,137 @@
+#define MPD_COUNT_GLOBAL_ALLOCATIONS
+#include "memory/counting_allocator.hpp"
+#include "memory/arena_allocator.hpp"
+#include "memory/stack_allocator.hpp"
+#include <cassert>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+static const char* vector_tag = "test_vector";
+
+void test_counting_allocator() {
+	{ // counting_allocator records allocations of the wrapped allocator
+		mpd::allocation_stats before = mpd::allocation_totals();
+		mpd::allocation_scope scope;
+		{
+			std::vector<int, mpd::counting_allocator<std::allocator<int>>> vec(mpd::counting_allocator<std::allocator<int>>(std::allocator<int>(), vector_tag));
+			vec.reserve(100);
+			assert(vec.get_allocator().get_tag() == vector_tag);
+		}
+		mpd::allocation_stats after = mpd::allocation_totals();
+		assert(scope.allocations() >= 1);
+		assert(scope.bytes_allocated() >= 400);
+		assert(after.allocations - before.allocations >= 1);
+		assert(after.deallocations - before.deallocations >= 1);
+		assert(after.size_histogram[mpd::impl::allocation_histogram_bucket(400)] > before.size_histogram[mpd::impl::allocation_histogram_bucket(400)]);
+		bool found_tag = false;
+		for (const mpd::allocation_tag_stats& tag : mpd::allocation_tag_totals()) {
+			if (tag.tag == vector_tag) {
+				found_tag = true;
+				assert(tag.bytes_allocated >= 400);
+			}
+		}
+		assert(found_tag);
+	}
+	{ // wrapping a non-heap allocator
+		mpd::local_arena<1024> arena;
+		mpd::counting_allocator<mpd::arena_allocator<char>> alloc(arena);
+		mpd::allocation_scope scope;
+		char* ptr = alloc.allocate(10);
+		assert(arena.owns(ptr));
+		alloc.deallocate(ptr, 10);
+		assert(scope.allocations() == 1);
+	}
+	{ // wrapping a buffer_allocator
+		mpd::allocation_buffer<64, 2> buffer;
+		using alloc_t = mpd::counting_allocator<mpd::buffer_allocator<int, 64, 2>>;
+		mpd::allocation_scope scope;
+		{
+			std::vector<int, alloc_t> vec(alloc_t(mpd::buffer_allocator<int, 64, 2>(buffer), vector_tag));
+			vec.reserve(16);
+			vec.push_back(1);
+			assert(buffer.owns(vec.data()));
+		}
+		assert(scope.allocations() == 1);
+		assert(scope.bytes_allocated() == 16 * sizeof(int));
+	}
+	{ // wrapping a local_allocator, which holds its buffer inline, and falls back to the heap
+		mpd::allocation_scope scope;
+		std::vector<int, mpd::counting_allocator<mpd::local_allocator<int, 64>>> vec;
+		vec.reserve(16);
+		const char* self = reinterpret_cast<const char*>(&vec);
+		const char* data = reinterpret_cast<const char*>(vec.data());
+		assert(data >= self && data < self + sizeof(vec));
+		assert(scope.allocations() == 1);
+		vec.reserve(100);
+		data = reinterpret_cast<const char*>(vec.data());
+		assert(data < self || data >= self + sizeof(vec));
+		// counted once by the counting_allocator, and once by the global hook
+		assert(scope.allocations() == 3);
+		assert(scope.bytes_allocated() == 16 * sizeof(int) + 2 * 100 * sizeof(int));
+	}
+	{ // the global hook counts heap allocations in a region
+		mpd::allocation_scope scope("global");
+		std::string* str = new std::string(100, 'a');
+		delete str;
+		assert(scope.allocations() == 2);
+		mpd::allocation_scope empty_scope;
+		int stack_value = 3;
+		(void)stack_value;
+		assert(empty_scope.allocations() == 0);
+	}
+	{ // totals include threads that have exited
+		mpd::allocation_stats before = mpd::allocation_totals();
+		std::thread worker([]() {
+			// operator new is called directly, since a new expression that's deleted right away may be elided
+			void* ptrs[10];
+			for (void*& ptr : ptrs)
+				ptr = ::operator new(sizeof(int));
+			for (void* ptr : ptrs)
+				::operator delete(ptr);
+		});
+		worker.join();
+		mpd::allocation_stats after = mpd::allocation_totals();
+		assert(after.allocations - before.allocations >= 10);
+		assert(after.deallocations - before.deallocations >= 10);
+	}
+	{ // a scope opened during thread exit, after the thread's counters are destroyed
+		struct scope_at_exit {
+			~scope_at_exit() {
+				mpd::allocation_scope scope("exit");
+				::operator delete(::operator new(16));
+				assert(scope.allocations() == 0);
+			}
+		};
+		std::thread worker([]() {
+			// constructed before the counters, so destroyed after them
+			static thread_local scope_at_exit at_exit;
+			(void)at_exit;
+			::operator delete(::operator new(16));
+		});
+		worker.join();
+	}
+	{ // a scope opened before the thread's counters are destroyed, and read after
+		struct scope_outliving_counters {
+			std::unique_ptr<mpd::allocation_scope> scope;
+			~scope_outliving_counters() {
+				assert(scope->allocations() == 0 && scope->bytes_allocated() == 0);
+			}
+		};
+		std::thread worker([]() {
+			// constructed before the counters, so destroyed after them
+			static thread_local scope_outliving_counters outliving;
+			outliving.scope = std::make_unique<mpd::allocation_scope>("outliving");
+			::operator delete(::operator new(16));
+		});
+		worker.join();
+	}
+	{ // bucket boundaries
+		assert(mpd::impl::allocation_histogram_bucket(1) == 0);
+		assert(mpd::impl::allocation_histogram_bucket(8) == 0);
+		assert(mpd::impl::allocation_histogram_bucket(9) == 1);
+		assert(mpd::impl::allocation_histogram_bucket(std::size_t(1) << 40) == mpd::allocation_histogram_buckets - 1);
+	}
+}
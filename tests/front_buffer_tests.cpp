@@ -257,6 +257,13 @@ void test_small_vectors() {
 	//test_is((b05_lmnop <= std0_fghijk), false);
 	//test_is((b05_lmnop > std0_fghijk), true);
 	//test_is((b05_lmnop >= std0_fghijk), true);
+	{ // relocate_append_to moves every element to the end of the other buffer
+		buffer0_7 b07_xy{ {'x'}, {'y'} };
+		buffer0_5 b05_ab{ {'a'}, {'b'} };
+		b05_ab.relocate_append_to(b07_xy);
+		assert(b05_ab.empty() && b07_xy.size() == 4);
+		assert(b07_xy[0] == L'x' && b07_xy[2] == L'a' && b07_xy[3] == L'b');
+	}
 	test_abcd_after(erase(b05_abcd, L'c'), L"abd");
 	auto pred = [](const testing<0>& b05_abcd) {return b05_abcd == L'c'; };
 	test_abcd_after(erase_if(b05_abcd, pred), L"abd");
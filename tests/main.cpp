@@ -11,6 +11,29 @@ void test_atomic_spin();
 void test_async_iofilebuf();
 void test_initializers();
 void test_noop_stream();
+void test_arena_allocator();
+void test_pool_allocator();
+void test_scratch_allocator();
+void test_counting_allocator();
+void test_memory();
+void test_slot_map();
+void test_cache_padded();
+void test_aligned_allocator();
+void test_offset_ptr();
+void test_mapped_allocator();
+void test_stack_allocator();
+void test_concurrent_pool();
+void test_atomic_bitfield();
+void test_spin_lock();
+void test_seqlock();
+void test_thread_pool();
+void test_bounded_queue();
+void test_reclamation();
+void test_atomic_pair();
+void test_concurrent_hash_map();
+void test_sharded_counter();
+void test_task();
+void test_parallel();
 
 int main() {
 	std::cout << "Starting tests..." << std::endl;
@@ -25,6 +48,29 @@ int main() {
 	test_async_iofilebuf();
 	test_initializers();
 	test_noop_stream();
+	test_arena_allocator();
+	test_pool_allocator();
+	test_scratch_allocator();
+	test_counting_allocator();
+	test_memory();
+	test_slot_map();
+	test_cache_padded();
+	test_aligned_allocator();
+	test_offset_ptr();
+	test_mapped_allocator();
+	test_stack_allocator();
+	test_concurrent_pool();
+	test_atomic_bitfield();
+	test_spin_lock();
+	test_seqlock();
+	test_thread_pool();
+	test_bounded_queue();
+	test_reclamation();
+	test_atomic_pair();
+	test_concurrent_hash_map();
+	test_sharded_counter();
+	test_task();
+	test_parallel();
 	std::cout << "Success\n";
 	return 0;
 }
\ No newline at end of file
@@ -0,0 +1,52 @@
+#include "containers/front_buffer.hpp"
+#include "memory/mapped_allocator.hpp"
+#include "memory/memory.hpp"
+#include <cassert>
+#include <cstring>
+#include <vector>
+
+void test_mapped_allocator() {
+	const std::size_t mb = 1024 * 1024;
+	{ // regions are page aligned, zeroed, and huge regions are huge page aligned
+		mpd::mapped_memory_stats before = mpd::mapped_memory_totals();
+		mpd::mapped_region small(100, mpd::map_default);
+		assert(small.size() >= 100);
+		assert(mpd::is_aligned_ptr(small.data(), 4096));
+		assert(small.data()[99] == 0);
+		mpd::mapped_region big(4 * mb, mpd::map_huge_pages | mpd::map_prefault);
+		assert(big.size() == 4 * mb);
+		assert(mpd::is_aligned_ptr(big.data(), 2 * mb));
+		mpd::mapped_memory_stats during = mpd::mapped_memory_totals();
+		assert(during.mapped_bytes == before.mapped_bytes + small.size() + big.size());
+		assert(during.map_calls == before.map_calls + 2);
+		assert(during.peak_mapped_bytes >= during.mapped_bytes);
+		// shrinking returns the tail to the OS, and the pages read as zero afterwards
+		std::memset(big.data(), 1, big.size());
+		assert(big.shrink(mb) == 3 * mb);
+		assert(big.data()[mb - 1] == 1);
+		assert(big.data()[mb] == 0);
+		assert(mpd::mapped_memory_totals().discarded_bytes == during.discarded_bytes + 3 * mb);
+		big.release();
+		small.release();
+		assert(mpd::mapped_memory_totals().mapped_bytes == before.mapped_bytes);
+	}
+	{ // containers
+		std::vector<int, mpd::mapped_allocator<int>> vec(1000000, 7);
+		assert(vec[999999] == 7);
+		using allocator = mpd::mapped_allocator<double, mpd::map_huge_pages>;
+		using state = mpd::impl::front_buffer_heap_state<double, allocator>;
+		mpd::dynamic_buffer<double, allocator> table(state(1 << 20));
+		table.resize(1000);
+		assert(allocator::discard_tail(table.data(), table.size(), table.capacity()) > 0);
+	}
+	{ // mapped arenas can return their pages after a reset
+		mpd::mapped_arena arena(8 * mb);
+		void* a = arena.raw_allocate(3 * mb);
+		assert(arena.owns(a));
+		assert(arena.heap_bytes() == 0);
+		std::memset(a, 1, 3 * mb);
+		arena.reset();
+		assert(arena.trim() >= 7 * mb);
+		assert(static_cast<char*>(arena.raw_allocate(10))[0] == 0);
+	}
+}
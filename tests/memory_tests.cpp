@@ -0,0 +1,101 @@
+#include "containers/front_buffer.hpp"
+#include "memory/memory.hpp"
+#include <cassert>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+namespace {
+	// not trivially copyable, but doesn't care about its own address
+	struct boxed_int {
+		std::unique_ptr<int> ptr;
+		explicit boxed_int(int v) : ptr(new int(v)) {}
+		boxed_int(const boxed_int& rhs) : ptr(new int(*rhs.ptr)) {}
+		boxed_int(boxed_int&&) = default;
+		boxed_int& operator=(const boxed_int& rhs) { ptr.reset(new int(*rhs.ptr)); return *this; }
+		boxed_int& operator=(boxed_int&&) = default;
+	};
+	struct throws_on_copy {
+		static int live;
+		int value;
+		explicit throws_on_copy(int v) : value(v) { ++live; }
+		throws_on_copy(const throws_on_copy& rhs) : value(rhs.value) {
+			if (value < 0) throw std::runtime_error("copy");
+			++live;
+		}
+		~throws_on_copy() { --live; }
+	};
+	int throws_on_copy::live = 0;
+}
+template<>
+struct mpd::is_trivially_relocatable<boxed_int> : std::true_type {};
+
+void test_memory() {
+	static_assert(mpd::impl::is_bitwise_copyable<const int*, int*>::value, "");
+	static_assert(mpd::impl::is_bitwise_copyable<std::move_iterator<int*>, int*>::value, "");
+	static_assert(!mpd::impl::is_bitwise_copyable<std::string*, std::string*>::value, "");
+	static_assert(!mpd::impl::is_bitwise_copyable<int*, long*>::value, "");
+	static_assert(mpd::is_trivially_relocatable_v<boxed_int>, "");
+
+	{ // trivially copyable types and other types give the same results
+		const int src[4] = {1, 2, 3, 4};
+		int dest[4] = {};
+		assert(mpd::uninitialized_copy(src, src + 4, dest) == dest + 4);
+		assert(dest[3] == 4);
+		auto its = mpd::uninitialized_copy_s(src, src + 4, dest, dest + 2);
+		assert(its.first == src + 2 && its.second == dest + 2);
+		int moved[4] = {};
+		auto move_its = mpd::uninitialized_move_n(dest, 3, moved + 1);
+		assert(move_its.first == dest + 3 && move_its.second == moved + 4);
+		assert(moved[3] == 3);
+
+		alignas(std::string) char raw[4 * sizeof(std::string)];
+		std::string* strs = reinterpret_cast<std::string*>(raw);
+		std::string str_src[2] = {"a string that does not fit in SSO", "b"};
+		auto str_its = mpd::uninitialized_move_s(str_src, str_src + 2, strs, strs + 4);
+		assert(str_its.first == str_src + 2 && str_its.second == strs + 2);
+		assert(strs[0] == "a string that does not fit in SSO");
+		// relocating to an overlapping range
+		assert(mpd::uninitialized_relocate_backward(strs, strs + 2, strs + 3) == strs + 1);
+		assert(strs[1] == "a string that does not fit in SSO" && strs[2] == "b");
+		assert(mpd::uninitialized_relocate(strs + 1, strs + 3, strs) == strs + 2);
+		assert(strs[0] == "a string that does not fit in SSO" && strs[1] == "b");
+		mpd::destroy(strs, strs + 2);
+	}
+	{ // specialized types are relocated bitwise
+		alignas(boxed_int) char raw[4 * sizeof(boxed_int)];
+		boxed_int* boxes = reinterpret_cast<boxed_int*>(raw);
+		mpd::construct_at(boxes, 1);
+		mpd::construct_at(boxes + 1, 2);
+		int* first = boxes[0].ptr.get();
+		auto its = mpd::uninitialized_relocate_n(boxes, 2, boxes + 2);
+		assert(its.first == boxes + 2 && its.second == boxes + 4);
+		assert(boxes[2].ptr.get() == first && *boxes[3].ptr == 2);
+		mpd::destroy(boxes + 2, boxes + 4);
+	}
+	{ // a throwing copy leaves nothing constructed
+		alignas(throws_on_copy) char raw[3 * sizeof(throws_on_copy)];
+		throws_on_copy* dest = reinterpret_cast<throws_on_copy*>(raw);
+		throws_on_copy src[3] = {throws_on_copy(1), throws_on_copy(2), throws_on_copy(-1)};
+		try {
+			mpd::uninitialized_copy_n(src, 3, dest);
+			assert(false);
+		} catch (const std::runtime_error&) {}
+		assert(throws_on_copy::live == 3);
+	}
+	{ // front_buffer shifts trivially relocatable elements without moving them one at a time
+		alignas(boxed_int) char raw[6 * sizeof(boxed_int)];
+		boxed_int* buffer = reinterpret_cast<boxed_int*>(raw);
+		boxed_int src[3] = {boxed_int(1), boxed_int(2), boxed_int(3)};
+		std::size_t size = mpd::front_buffer_append<mpd::overflow_behavior_t::exception>(buffer, 0, 6, src, src + 3);
+		int* last = buffer[2].ptr.get();
+		size = mpd::front_buffer_insert<mpd::overflow_behavior_t::exception>(buffer, size, 6, 1, src, src + 2);
+		assert(size == 5);
+		assert(*buffer[0].ptr == 1 && *buffer[1].ptr == 1 && *buffer[2].ptr == 2 && *buffer[3].ptr == 2 && *buffer[4].ptr == 3);
+		assert(buffer[4].ptr.get() == last);
+		size = mpd::front_buffer_erase(buffer, size, 0, 2);
+		assert(size == 3);
+		assert(*buffer[0].ptr == 2 && *buffer[1].ptr == 2 && buffer[2].ptr.get() == last);
+		mpd::front_buffer_pop_back(buffer, size, size);
+	}
+}
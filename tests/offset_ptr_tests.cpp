@@ -0,0 +1,74 @@
+#include "iterators/link_iterator.hpp"
+#include "memory/arena_allocator.hpp"
+#include "memory/offset_ptr.hpp"
+#include <cassert>
+#include <cstring>
+#include <numeric>
+#include <vector>
+
+namespace {
+	struct list_node {
+		int value;
+		mpd::offset_ptr<list_node> next;
+	};
+	struct vertex {
+		int weight;
+		mpd::arena_index<vertex> parent;
+	};
+	using list_iterator = mpd::offset_link_iterator<list_node, &list_node::next>;
+	using parent_iterator = mpd::index_link_iterator<vertex, &vertex::parent>;
+}
+
+void test_offset_ptr() {
+	static_assert(sizeof(mpd::offset_ptr<list_node>) == 4, "");
+	static_assert(sizeof(mpd::arena_index<vertex>) == 4, "");
+	{ // null and copies
+		mpd::offset_ptr<int> null;
+		assert(!null && null == nullptr);
+		int values[2] = {3, 4};
+		mpd::offset_ptr<int> a(&values[1]);
+		mpd::offset_ptr<int> copies[3] = {a, a, nullptr};
+		assert(*copies[1] == 4);
+		assert(copies[0] == a);
+		assert(!copies[2]);
+		copies[2] = values;
+		assert(copies[2][1] == 4);
+	}
+	{ // a list in an arena can be relocated with memcpy
+		mpd::local_arena<1024> arena;
+		list_node* nodes = static_cast<list_node*>(arena.raw_allocate(sizeof(list_node) * 10, alignof(list_node)));
+		for (int i = 0; i < 10; i++) {
+			nodes[i].value = i;
+			nodes[i].next = i + 1 < 10 ? &nodes[i + 1] : nullptr;
+		}
+		assert(std::accumulate(list_iterator(nodes), list_iterator(), 0, [](int s, const list_node& n) { return s + n.value; }) == 45);
+		list_node* moved = static_cast<list_node*>(arena.raw_allocate(sizeof(list_node) * 10, alignof(list_node)));
+		std::memcpy(static_cast<void*>(moved), nodes, sizeof(list_node) * 10);
+		std::memset(static_cast<void*>(nodes), 0, sizeof(list_node) * 10);
+		int count = 0;
+		for (list_iterator it(moved); it != list_iterator(); ++it) {
+			assert(it->value == count);
+			assert(&*it == moved + count);
+			++count;
+		}
+		assert(count == 10);
+	}
+	{ // indexes survive the array growing
+		std::vector<vertex> vertices;
+		vertices.push_back(vertex{1, nullptr});
+		for (int i = 1; i < 100; i++)
+			vertices.push_back(vertex{i + 1, mpd::arena_index<vertex>(static_cast<std::uint32_t>(i - 1))});
+		assert(vertices[50].parent.in(vertices).weight == 50);
+		assert(mpd::arena_index<vertex>::of(vertices.data(), &vertices[7]).index() == 7);
+		int depth = 0;
+		for (parent_iterator it(vertices.data(), mpd::arena_index<vertex>(99)); it != parent_iterator(); ++it)
+			++depth;
+		assert(depth == 100);
+		std::vector<mpd::arena_index<vertex>> edges{mpd::arena_index<vertex>(3), mpd::arena_index<vertex>(10)};
+		auto first = mpd::index_deref_iter(vertices.data(), edges.begin());
+		auto last = mpd::index_deref_iter(vertices.data(), edges.end());
+		assert(last - first == 2);
+		assert(first->weight == 4);
+		assert(first[1].weight == 11);
+	}
+}
@@ -0,0 +1,69 @@
+#include "algorithms/parallel.hpp"
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <vector>
+
+void test_parallel() {
+	mpd::thread_pool pool(3);
+	{
+		std::vector<int> values(10000, 1);
+		mpd::parallel_for(pool, values, 0, [](int& v) { v *= 2; });
+		for (int v : values)
+			assert(v == 2);
+		// an explicit grain, that doesn't divide the range, and a single chunk
+		mpd::parallel_for(pool, values, 333, [](int& v) { v += 1; });
+		mpd::parallel_for(pool, values, 100000, [](int& v) { v += 1; });
+		for (int v : values)
+			assert(v == 4);
+		std::vector<int> empty;
+		mpd::parallel_for(pool, empty, 0, [](int&) { assert(false); });
+	}
+	{
+		std::vector<float> features(5000);
+		for (std::size_t i = 0; i < features.size(); i++)
+			features[i] = static_cast<float>(i % 7);
+		std::vector<float> scores(features.size());
+		auto end = mpd::parallel_transform(pool, features, scores.begin(), [](float f) { return f * 0.5f; });
+		assert(end == scores.end());
+		for (std::size_t i = 0; i < scores.size(); i++)
+			assert(scores[i] == static_cast<float>(i % 7) * 0.5f);
+		std::vector<std::uint64_t> numbers(100000);
+		for (std::size_t i = 0; i < numbers.size(); i++)
+			numbers[i] = i;
+		assert(mpd::parallel_reduce(pool, numbers, std::uint64_t(5), std::plus<>()) == 5 + 99999ull * 100000 / 2);
+		assert(mpd::parallel_reduce(pool, numbers, std::uint64_t(0), [](std::uint64_t a, std::uint64_t b) { return a > b ? a : b; }, 7) == 99999);
+		assert(mpd::parallel_transform_reduce(pool, numbers, std::uint64_t(0), std::plus<>(), [](std::uint64_t n) { return n % 2; }) == 50000);
+		std::vector<std::uint64_t> none;
+		assert(mpd::parallel_reduce(pool, none, std::uint64_t(3), std::plus<>()) == 3);
+	}
+	{
+		// nested loops from inside workers run other tasks while they wait, instead of deadlocking the pool
+		std::vector<std::vector<int>> rows(20, std::vector<int>(500, 1));
+		std::atomic<int> total{0};
+		mpd::parallel_for(pool, rows, 1, [&](std::vector<int>& row) {
+			total += mpd::parallel_reduce(pool, row, 0, std::plus<>(), 16);
+		});
+		assert(total == 20 * 500);
+	}
+	{
+		std::vector<int> values(1000);
+		bool threw = false;
+		try {
+			mpd::parallel_for(pool, values, 10, [](int& v) {
+				v = 1;
+				throw std::runtime_error("failed");
+			});
+		} catch (const std::runtime_error&) {
+			threw = true;
+		}
+		assert(threw);
+	}
+	{
+		std::vector<int> values(100, 1);
+		mpd::parallel_for(values, 0, [](int& v) { v = 3; });
+		assert(mpd::parallel_reduce(values, 0, std::plus<>()) == 300);
+	}
+}
@@ -0,0 +1,70 @@
+#include "memory/memory.hpp"
+#include "memory/pool_allocator.hpp"
+#include <cassert>
+#include <list>
+#include <map>
+#include <thread>
+#include <vector>
+
+void test_pool_allocator() {
+	// size classes round up, and cover every size up to the maximum
+	for (std::size_t bytes = 1; bytes <= mpd::impl::pool_max_block_size; bytes++) {
+		unsigned size_class = mpd::impl::pool_size_class(bytes);
+		assert(size_class < mpd::impl::pool_class_count);
+		assert(mpd::impl::pool_class_size(size_class) >= bytes);
+		assert(size_class == 0 || mpd::impl::pool_class_size(size_class - 1) < bytes);
+	}
+
+	{ // blocks are distinct and reused
+		void* a = mpd::pool_allocate(24);
+		void* b = mpd::pool_allocate(24);
+		assert(a != b);
+		assert(mpd::is_aligned_ptr(static_cast<char*>(a), 16));
+		mpd::pool_deallocate(b, 24);
+		void* c = mpd::pool_allocate(24);
+		assert(c == b);
+		mpd::pool_deallocate(a, 24);
+		mpd::pool_deallocate(c, 24);
+	}
+	{ // oversized and overaligned requests fall back to the heap
+		void* big = mpd::pool_allocate(5000);
+		mpd::pool_deallocate(big, 5000);
+		void* aligned = mpd::pool_allocate(64, 64);
+		assert(mpd::is_aligned_ptr(static_cast<char*>(aligned), 64));
+		mpd::pool_deallocate(aligned, 64, 64);
+	}
+	{ // node based containers
+		std::map<int, int, std::less<int>, mpd::pool_allocator<std::pair<const int, int>>> map;
+		for (int i = 0; i < 10000; i++)
+			map[i] = i * 2;
+		assert(map.size() == 10000);
+		assert(map[5000] == 10000);
+		std::list<int, mpd::pool_allocator<int>> list(1000, 3);
+		list.clear();
+	}
+	{ // allocate on one thread, free on another
+		std::vector<void*> blocks(10000);
+		std::thread producer([&]() {
+			for (void*& block : blocks)
+				block = mpd::pool_allocate(48);
+		});
+		producer.join();
+		std::thread consumer([&]() {
+			for (void* block : blocks)
+				mpd::pool_deallocate(block, 48);
+		});
+		consumer.join();
+		std::vector<std::thread> threads;
+		for (int t = 0; t < 4; t++) {
+			threads.emplace_back([]() {
+				std::list<int, mpd::pool_allocator<int>> local;
+				for (int i = 0; i < 20000; i++) {
+					local.push_back(i);
+					if (i % 3 == 0) local.pop_front();
+				}
+			});
+		}
+		for (std::thread& t : threads)
+			t.join();
+	}
+}
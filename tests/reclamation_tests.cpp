@@ -0,0 +1,146 @@
+#include "concurrency/reclamation.hpp"
+#include <atomic>
+#include <cassert>
+#include <thread>
+#include <vector>
+
+namespace {
+	std::atomic<int> live_nodes{0};
+	struct node {
+		int value;
+		explicit node(int v) : value(v) { live_nodes++; }
+		~node() { value = -1; live_nodes--; }
+	};
+	int custom_deletes = 0;
+	void custom_delete(node* n) {
+		custom_deletes++;
+		delete n;
+	}
+
+	void test_epoch_single_thread() {
+		{
+			mpd::epoch_domain domain;
+			domain.retire(new node(1));
+			domain.retire(new node(2), &custom_delete);
+			assert(live_nodes == 2);
+			{
+				mpd::epoch_guard guard(domain);
+				mpd::epoch_guard nested(domain);
+				std::uint64_t epoch = domain.epoch();
+				domain.try_advance();
+				// this thread is inside a guard, and has now fallen behind
+				assert(domain.try_advance() == epoch + 1);
+				assert(live_nodes == 2);
+			}
+			domain.drain();
+			assert(live_nodes == 0);
+			assert(custom_deletes == 1);
+			for (int i = 0; i < 1000; i++)
+				domain.retire(new node(i));
+			assert(live_nodes < 1000); // retire reclaims as it goes
+			domain.retire(new node(0));
+		}
+		assert(live_nodes == 0); // the domain frees the rest
+	}
+
+	void test_epoch_threads() {
+		{
+			mpd::epoch_domain domain;
+			std::atomic<node*> shared{new node(0)};
+			std::atomic<bool> done{false};
+			std::vector<std::thread> readers;
+			for (int t = 0; t < 3; t++) {
+				readers.emplace_back([&] {
+					int last = 0;
+					while (!done.load(std::memory_order_relaxed)) {
+						mpd::epoch_guard guard(domain);
+						node* n = shared.load(std::memory_order_acquire);
+						assert(n->value >= last);
+						last = n->value;
+						std::this_thread::yield();
+					}
+					domain.quiescent();
+				});
+			}
+			for (int i = 1; i <= 2000; i++) {
+				node* old;
+				{
+					mpd::epoch_guard guard(domain);
+					old = shared.exchange(new node(i), std::memory_order_acq_rel);
+				}
+				domain.retire(old);
+				if (i % 100 == 0) domain.quiescent();
+			}
+			done = true;
+			for (std::thread& t : readers)
+				t.join();
+			domain.drain();
+			assert(live_nodes == 1);
+			delete shared.load();
+		}
+		assert(live_nodes == 0);
+	}
+
+	void test_hazard_single_thread() {
+		{
+			mpd::hazard_domain<> domain;
+			std::atomic<node*> shared{new node(1)};
+			{
+				mpd::hazard_pointer hp(domain);
+				node* n = hp.protect(shared);
+				assert(n->value == 1);
+				node* old = shared.exchange(new node(2));
+				domain.retire(old);
+				domain.quiescent();
+				assert(domain.retired_count() == 1); // still protected
+				assert(n->value == 1);
+				hp.reset();
+				domain.quiescent();
+				assert(domain.retired_count() == 0);
+				assert(live_nodes == 1);
+			}
+			domain.retire(shared.load(), &custom_delete);
+			domain.quiescent();
+			assert(custom_deletes == 2);
+		}
+		assert(live_nodes == 0);
+	}
+
+	void test_hazard_threads() {
+		{
+			mpd::hazard_domain<2> domain;
+			std::atomic<node*> shared{new node(0)};
+			std::atomic<bool> done{false};
+			std::vector<std::thread> readers;
+			for (int t = 0; t < 3; t++) {
+				readers.emplace_back([&] {
+					mpd::hazard_pointer_of<2> hp(domain);
+					int last = 0;
+					while (!done.load(std::memory_order_relaxed)) {
+						node* n = hp.protect(shared);
+						assert(n->value >= last);
+						last = n->value;
+						std::this_thread::yield();
+					}
+				});
+			}
+			for (int i = 1; i <= 2000; i++)
+				domain.retire(shared.exchange(new node(i), std::memory_order_acq_rel));
+			done = true;
+			for (std::thread& t : readers)
+				t.join();
+			domain.quiescent();
+			assert(domain.retired_count() == 0);
+			assert(live_nodes == 1);
+			delete shared.load();
+		}
+		assert(live_nodes == 0);
+	}
+}
+
+void test_reclamation() {
+	test_epoch_single_thread();
+	test_epoch_threads();
+	test_hazard_single_thread();
+	test_hazard_threads();
+}
@@ -0,0 +1,61 @@
+#include "containers/front_buffer.hpp"
+#include "memory/scratch_allocator.hpp"
+#include <cassert>
+#include <string>
+#include <vector>
+
+void test_scratch_allocator() {
+	{ // frames release their allocations in LIFO order
+		int* outer_ptr;
+		{
+			mpd::scratch_frame outer;
+			outer_ptr = outer.alloc<int>(10);
+			int* inner_ptr;
+			{
+				mpd::scratch_frame inner;
+				inner_ptr = inner.alloc<int>(10);
+				assert(inner_ptr != outer_ptr);
+			}
+			mpd::scratch_frame inner;
+			assert(inner.alloc<int>(10) == inner_ptr);
+		}
+		mpd::scratch_frame frame;
+		assert(frame.alloc<int>(10) == outer_ptr);
+	}
+	{ // frames can exceed the first scratch chunk
+		mpd::scratch_frame frame;
+		char* big = frame.alloc<char>(1024 * 1024);
+		big[1024 * 1024 - 1] = 'a';
+		double* aligned = frame.alloc<double>(3);
+		assert(mpd::is_aligned_ptr(aligned, alignof(double)));
+	}
+	{ // standard containers
+		mpd::scratch_frame frame;
+		std::vector<std::string, mpd::scratch_allocator<std::string>> vec(frame.get_allocator<std::string>());
+		for (int i = 0; i < 100; i++)
+			vec.push_back(std::to_string(i));
+		assert(vec[42] == "42");
+		assert(frame.is_top());
+		{
+			mpd::scratch_frame inner;
+			assert(inner.is_top() && !frame.is_top());
+			// the outer vector may be read, but not grown, while inner is alive
+			assert(vec[99] == "99");
+		}
+		assert(frame.is_top());
+		vec.push_back("100");
+		assert(vec.back() == "100");
+	}
+	{ // dynamic_buffer
+		mpd::scratch_frame frame;
+		mpd::scratch_buffer<int> buffer = mpd::make_scratch_buffer<int>(frame, 20);
+		assert(buffer.capacity() == 20);
+		for (int i = 0; i < 20; i++)
+			buffer.push_back(i);
+		assert(buffer.size() == 20);
+		assert(buffer[19] == 19);
+		buffer.erase(buffer.begin(), buffer.begin() + 10);
+		assert(buffer.size() == 10);
+		assert(buffer[0] == 10);
+	}
+}
@@ -0,0 +1,74 @@
+#include "concurrency/seqlock.hpp"
+#include <atomic>
+#include <cassert>
+#include <thread>
+#include <vector>
+
+namespace {
+	// every field always holds the same number, so a torn read would be visible
+	struct snapshot {
+		long long values[9];
+		char tag;
+	};
+	snapshot make_snapshot(long long v) {
+		snapshot s;
+		for (long long& value : s.values)
+			value = v;
+		s.tag = static_cast<char>(v);
+		return s;
+	}
+	bool consistent(const snapshot& s) {
+		for (long long value : s.values)
+			if (value != s.values[0]) return false;
+		return s.tag == static_cast<char>(s.values[0]);
+	}
+}
+
+void test_seqlock() {
+	{
+		mpd::seqlock<int> lock(3);
+		assert(lock.load() == 3);
+		std::uint32_t version = lock.version();
+		lock.store(4);
+		assert(lock.load() == 4);
+		assert(lock.version() != version && lock.version() % 2 == 0);
+		lock.update([](int& v) { v *= 10; });
+		int out = 0;
+		assert(lock.try_load(out) && out == 40);
+		bool thrown = false;
+		try { lock.update([](int& v) { v = 0; throw 1; }); }
+		catch (int) { thrown = true; }
+		assert(thrown && lock.load() == 40);
+		lock.store(5); // writers aren't locked out after an exception
+		assert(lock.load() == 5);
+	}
+	{ // readers never see a torn value while writers are busy
+		mpd::seqlock<snapshot> lock(make_snapshot(0));
+		std::atomic<bool> done{false};
+		std::vector<std::thread> threads;
+		for (int w = 0; w < 2; w++) {
+			threads.emplace_back([&, w]() {
+				for (long long i = 1; i <= 20000; i++) {
+					if (w == 0) lock.store(make_snapshot(i));
+					else lock.update([](snapshot& s) { s = make_snapshot(s.values[0] + 1); });
+				}
+			});
+		}
+		for (int r = 0; r < 4; r++) {
+			threads.emplace_back([&]() {
+				long long reads = 0;
+				while (!done.load(std::memory_order_relaxed) || reads == 0) {
+					snapshot s = lock.load();
+					assert(consistent(s));
+					++reads;
+				}
+			});
+		}
+		threads[0].join();
+		threads[1].join();
+		done = true;
+		for (std::size_t t = 2; t < threads.size(); t++)
+			threads[t].join();
+		assert(consistent(lock.load()));
+	}
+}
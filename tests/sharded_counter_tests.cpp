@@ -0,0 +1,64 @@
+#include "concurrency/sharded_counter.hpp"
+#include <cassert>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+void test_sharded_counter() {
+	{
+		mpd::sharded_counter<> counter;
+		assert(counter.load() == 0);
+		counter.add();
+		++counter;
+		counter += 5;
+		counter.sub(2);
+		--counter;
+		assert(counter.load() == 4);
+		assert(counter.reset() == 4);
+		assert(counter == 0);
+		counter -= 3; // works as a gauge
+		assert(counter.load() == -3);
+	}
+	{
+		const int thread_count = 4;
+		const int per_thread = 20000;
+		mpd::sharded_counter<8> counter;
+		mpd::sharded_histogram<4> histogram;
+		std::vector<std::thread> threads;
+		for (int t = 0; t < thread_count; t++) {
+			threads.emplace_back([&] {
+				for (int i = 0; i < per_thread; i++) {
+					counter.add();
+					histogram.record(static_cast<std::uint64_t>(i % 100));
+				}
+			});
+		}
+		for (std::thread& t : threads)
+			t.join();
+		assert(counter.load() == thread_count * per_thread);
+		mpd::histogram_snapshot snapshot = histogram.snapshot();
+		assert(snapshot.count == thread_count * per_thread);
+		assert(snapshot.sum == thread_count * (per_thread / 100) * 4950ull);
+		assert(snapshot.buckets[0] == thread_count * per_thread / 100);
+		assert(snapshot.mean() > 49 && snapshot.mean() < 50);
+	}
+	{
+		mpd::sharded_histogram<> histogram;
+		assert(histogram.snapshot().percentile(0.5) == 0);
+		for (std::uint64_t i = 1; i <= 100; i++)
+			histogram.record(i);
+		histogram.record(UINT64_MAX);
+		mpd::histogram_snapshot snapshot = histogram.snapshot();
+		assert(snapshot.count == 101);
+		assert(snapshot.buckets[1] == 1); // 1
+		assert(snapshot.buckets[2] == 2); // 2, 3
+		assert(snapshot.buckets[7] == 37); // 64 to 100
+		assert(snapshot.buckets[64] == 1);
+		assert(snapshot.percentile(0) == 1);
+		assert(snapshot.percentile(0.5) == 63);
+		assert(snapshot.percentile(0.99) == 127);
+		assert(snapshot.percentile(1) == UINT64_MAX);
+		assert(histogram.reset().count == 101);
+		assert(histogram.snapshot().count == 0);
+	}
+}
@@ -0,0 +1,92 @@
+#include "containers/slot_map.hpp"
+#include <cassert>
+#include <string>
+#include <vector>
+
+void test_slot_map() {
+	{ // handles find their elements, and stale handles are rejected
+		mpd::slot_map<std::string> map;
+		mpd::slot_map_handle a = map.insert("a");
+		mpd::slot_map_handle b = map.emplace(3, 'b');
+		mpd::slot_map_handle c = map.insert(std::string("c"));
+		assert(map.size() == 3);
+		assert(map[b] == "bbb");
+		assert(*map.find(c) == "c");
+		assert(!map.contains(mpd::slot_map_handle{}));
+		assert(map.erase(a));
+		assert(!map.erase(a));
+		assert(map.find(a) == nullptr);
+		assert(map.size() == 2);
+		assert(map[c] == "c");
+		// the freed slot is reused with a new generation
+		mpd::slot_map_handle d = map.insert("d");
+		assert(d.index == a.index);
+		assert(d != a);
+		assert(!map.contains(a));
+		assert(map.at(d) == "d");
+		try {
+			map.at(a);
+			assert(false);
+		} catch (const std::out_of_range&) {}
+	}
+	{ // growth keeps handles valid, and iteration is dense
+		mpd::slot_map<int> map;
+		std::vector<mpd::slot_map_handle> handles;
+		for (int i = 0; i < 1000; i++)
+			handles.push_back(map.insert(i));
+		for (int i = 0; i < 1000; i += 2)
+			assert(map.erase(handles[i]));
+		assert(map.size() == 500);
+		long long sum = 0;
+		for (int v : map)
+			sum += v;
+		assert(sum == 250000);
+		for (int i = 1; i < 1000; i += 2)
+			assert(map[handles[i]] == i);
+		for (auto it = map.begin(); it != map.end(); ++it)
+			assert(map[map.handle_of(it)] == *it);
+		std::size_t slot_capacity = map.capacity();
+		for (int i = 0; i < 500; i++)
+			map.insert(i);
+		assert(map.capacity() == slot_capacity);
+		map.clear();
+		assert(map.empty());
+		assert(!map.contains(handles[1]));
+	}
+	{ // inserting a copy of an element, exactly when the insert grows the map
+		mpd::slot_map<std::string> map;
+		mpd::slot_map_handle first = map.insert(std::string(100, 'x'));
+		while (map.size() < map.capacity())
+			map.insert("filler");
+		mpd::slot_map_handle copy = map.insert(map[first]);
+		assert(map[copy] == std::string(100, 'x') && map[first] == map[copy]);
+		mpd::slot_map_handle moved = map.emplace(std::move(map[first]));
+		assert(map[moved] == std::string(100, 'x'));
+	}
+	{ // elements whose moves may throw are moved rather than relocated when the map grows
+		struct may_throw {
+			std::string text;
+			explicit may_throw(std::string text_) : text(std::move(text_)) {}
+			may_throw(const may_throw&) = default;
+			may_throw& operator=(const may_throw&) = default;
+			may_throw(may_throw&& rhs) noexcept(false) : text(std::move(rhs.text)) {}
+			may_throw& operator=(may_throw&& rhs) noexcept(false) { text = std::move(rhs.text); return *this; }
+		};
+		mpd::slot_map<may_throw> map;
+		std::vector<mpd::slot_map_handle> handles;
+		for (int i = 0; i < 100; i++)
+			handles.push_back(map.emplace(std::to_string(i)));
+		for (int i = 0; i < 100; i++)
+			assert(map[handles[i]].text == std::to_string(i));
+	}
+	{ // moves take the free list along
+		mpd::slot_map<int> map;
+		mpd::slot_map_handle a = map.insert(1);
+		map.erase(a);
+		mpd::slot_map<int> other(std::move(map));
+		mpd::slot_map_handle b = other.insert(2);
+		assert(b.index == a.index);
+		map.insert(3);
+		assert(map.size() == 1);
+	}
+}
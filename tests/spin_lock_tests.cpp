@@ -0,0 +1,73 @@
+#include "concurrency/spin_lock.hpp"
+#include <algorithm>
+#include <cassert>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+	// more threads than cores, to check that the locks still make progress when waiters are descheduled
+	template<class Lock>
+	void contended_counter() {
+		const unsigned thread_count = std::max(4u, std::thread::hardware_concurrency() * 2);
+		const int per_thread = 2000;
+		Lock lock;
+		long long counter = 0;
+		std::vector<std::thread> threads;
+		for (unsigned t = 0; t < thread_count; t++) {
+			threads.emplace_back([&]() {
+				for (int i = 0; i < per_thread; i++) {
+					std::lock_guard<Lock> guard(lock);
+					++counter;
+				}
+			});
+		}
+		for (std::thread& t : threads)
+			t.join();
+		assert(counter == static_cast<long long>(thread_count) * per_thread);
+	}
+	template<class Lock>
+	void try_lock_basics() {
+		Lock lock;
+		assert(lock.try_lock());
+		assert(!lock.try_lock());
+		bool other_thread_got_it = true;
+		std::thread([&]() { other_thread_got_it = lock.try_lock(); }).join();
+		assert(!other_thread_got_it);
+		lock.unlock();
+		std::unique_lock<Lock> guard(lock, std::try_to_lock);
+		assert(guard.owns_lock());
+	}
+}
+
+void test_spin_lock() {
+	try_lock_basics<mpd::ttas_spinlock<>>();
+	try_lock_basics<mpd::ticket_lock>();
+	try_lock_basics<mpd::adaptive_mutex<>>();
+	{
+		mpd::mcs_lock lock;
+		assert(lock.try_lock());
+		bool other_thread_got_it = true;
+		std::thread([&]() { other_thread_got_it = lock.try_lock(); }).join();
+		assert(!other_thread_got_it);
+		lock.unlock();
+		mpd::mcs_node node;
+		lock.lock(node);
+		lock.unlock(node);
+	}
+	{ // two mcs_locks held at once, released out of order
+		mpd::mcs_lock a, b;
+		a.lock();
+		b.lock();
+		a.unlock();
+		b.unlock();
+		std::scoped_lock<mpd::mcs_lock, mpd::mcs_lock> both(a, b);
+	}
+
+	contended_counter<mpd::ttas_spinlock<>>();
+	contended_counter<mpd::ttas_spinlock<mpd::spin_then_yield_backoff<>>>();
+	contended_counter<mpd::ticket_lock>();
+	contended_counter<mpd::mcs_lock>();
+	contended_counter<mpd::adaptive_mutex<>>();
+	contended_counter<mpd::adaptive_mutex<0>>();
+}
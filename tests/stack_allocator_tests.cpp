@@ -0,0 +1,76 @@
+#include "memory/stack_allocator.hpp"
+#include <cassert>
+#include <string>
+#include <utility>
+#include <vector>
+
+void test_stack_allocator() {
+	{ // large buffers are inline, not just 255 bytes
+		mpd::small_std_vector<int, 1000> vec;
+		for (int i = 0; i < 1000; i++)
+			vec.push_back(i);
+		const char* self = reinterpret_cast<const char*>(&vec);
+		const char* data = reinterpret_cast<const char*>(vec.data());
+		assert(data >= self && data < self + sizeof(vec));
+		assert(vec[999] == 999);
+	}
+	{ // growing past the inline buffer falls back to the heap
+		mpd::small_std_vector<int, 16> vec{ 1, 2, 3 };
+		for (int i = 0; i < 100; i++)
+			vec.push_back(i);
+		const char* self = reinterpret_cast<const char*>(&vec);
+		const char* data = reinterpret_cast<const char*>(vec.data());
+		assert(data < self || data >= self + sizeof(vec));
+		assert(vec.size() == 103 && vec[2] == 3 && vec[102] == 99);
+		vec.resize(4);
+		vec.shrink_to_fit();
+		assert(vec.size() == 4 && vec[3] == 0);
+	}
+	{ // copies and moves don't share the inline buffer
+		mpd::small_std_vector<std::string, 8> a{ "one", "two" };
+		mpd::small_std_vector<std::string, 8> b(a);
+		mpd::small_std_vector<std::string, 8> c(std::move(a));
+		assert(b.size() == 2 && c.size() == 2 && c[1] == "two");
+		assert(b.data() != c.data());
+		a = c;
+		c = std::move(b);
+		assert(a[0] == "one" && c[0] == "one");
+		a.push_back("three");
+		swap(a, c);
+		assert(a.size() == 2 && c.size() == 3 && c[2] == "three");
+		std::vector<std::string> heap{ "x" };
+		mpd::small_std_vector<std::string, 8> d(heap);
+		assert(d.size() == 1 && d[0] == "x");
+	}
+	{ // strings
+		mpd::small_std_string<2000> str(2000, 'a');
+		const char* self = reinterpret_cast<const char*>(&str);
+		assert(str.data() >= self && str.data() < self + sizeof(str));
+		assert(str.size() == 2000 && str[1999] == 'a');
+		str += "overflow";
+		assert(str.size() == 2008 && str.back() == 'w');
+		mpd::small_std_string<2000> moved(std::move(str));
+		assert(moved.size() == 2008);
+		mpd::small_std_string<32> sub(std::string("hello world"), 6);
+		assert(sub == "world");
+		bool thrown = false;
+		try { mpd::small_std_string<32> bad(std::string("hi"), 3); }
+		catch (const std::out_of_range&) { thrown = true; }
+		assert(thrown);
+	}
+	{ // more than 64 blocks
+		mpd::allocation_buffer<24, 100> buffer;
+		std::vector<char*> blocks;
+		for (int i = 0; i < 100; i++) {
+			char* block = buffer.try_raw_allocate(24);
+			assert(block != nullptr && buffer.owns(block));
+			blocks.push_back(block);
+		}
+		assert(buffer.try_raw_allocate(1) == nullptr);
+		assert(buffer.try_raw_allocate(25) == nullptr);
+		buffer.raw_deallocate(blocks[70]);
+		assert(buffer.try_raw_allocate(8) == blocks[70]);
+		for (char* block : blocks)
+			buffer.raw_deallocate(block);
+	}
+}
@@ -0,0 +1,135 @@
+#include "concurrency/task.hpp"
+#include "inputoutput/async_ifilebuf.hpp"
+#include <atomic>
+#include <cassert>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if __cpp_impl_coroutine && __cpp_lib_coroutine
+namespace {
+	mpd::task<int> answer() {
+		co_return 42;
+	}
+	mpd::task<int> add_answers(int count) {
+		int sum = 0;
+		for (int i = 0; i < count; i++)
+			sum += co_await answer();
+		co_return sum;
+	}
+	mpd::task<int> countdown(int n) {
+		if (n == 0) co_return 0;
+		co_return 1 + co_await countdown(n - 1);
+	}
+	mpd::task<void> fail() {
+		throw std::runtime_error("failed");
+		co_return;
+	}
+	mpd::task<std::string> catch_failure() {
+		try {
+			co_await fail();
+		} catch (const std::runtime_error& e) {
+			co_return std::string(e.what());
+		}
+		co_return std::string();
+	}
+	mpd::task<bool> hop_to(mpd::thread_pool& pool) {
+		bool before = pool.is_worker_thread();
+		co_await mpd::resume_on(pool);
+		co_return !before && pool.is_worker_thread();
+	}
+	mpd::task<int> await_pool_future(mpd::thread_pool& pool) {
+		int first = co_await pool.submit([]() { return 20; });
+		int second = co_await pool.submit([]() {
+			std::this_thread::sleep_for(std::chrono::milliseconds(5));
+			return 22;
+		});
+		co_return first + second;
+	}
+	mpd::task<int> fan_out(mpd::thread_pool& pool) {
+		co_await mpd::resume_on(pool);
+		// a worker that calls sync_wait runs other tasks instead of blocking
+		co_return mpd::sync_wait(await_pool_future(pool));
+	}
+	mpd::task<std::string> read_file(mpd::async_ifilebuf& file) {
+		std::string contents;
+		char buffer[1000];
+		for (;;) {
+			std::streamsize n = co_await file.read_some(buffer, sizeof(buffer));
+			if (n == 0) break;
+			contents.append(buffer, static_cast<std::size_t>(n));
+		}
+		co_return contents;
+	}
+}
+#endif
+
+void test_task() {
+#if __cpp_impl_coroutine && __cpp_lib_coroutine
+	assert(mpd::sync_wait(answer()) == 42);
+	assert(mpd::sync_wait(add_answers(10)) == 420);
+	assert(mpd::sync_wait(countdown(1000)) == 1000);
+	assert(mpd::sync_wait(catch_failure()) == "failed");
+	bool threw = false;
+	try {
+		mpd::sync_wait(fail());
+	} catch (const std::runtime_error&) {
+		threw = true;
+	}
+	assert(threw);
+	{
+		mpd::task<int> never_started = answer();
+		assert(never_started.valid() && !never_started.is_ready());
+	}
+	{
+		mpd::thread_pool pool(2);
+		assert(mpd::sync_wait(hop_to(pool)));
+		assert(mpd::sync_wait(await_pool_future(pool)) == 42);
+		assert(mpd::sync_wait(fan_out(pool)) == 42);
+	}
+	{
+		std::string expected;
+		for (int i = 0; i < 3000; i++)
+			expected += "line " + std::to_string(i) + "\n";
+		{
+			std::FILE* f = std::fopen("task_input.txt", "wb");
+			std::fwrite(expected.data(), 1, expected.size(), f);
+			std::fclose(f);
+		}
+		mpd::async_ifilebuf file("task_input.txt", std::ios_base::in | std::ios_base::binary);
+		assert(mpd::sync_wait(read_file(file)) == expected);
+	}
+#if defined(__unix__) || defined(__APPLE__)
+	{ // read_some resumes as soon as one block is read, without waiting for the ring to fill
+		const char* fifo = "task_input.fifo";
+		::unlink(fifo);
+		assert(::mkfifo(fifo, 0600) == 0);
+		const std::size_t block_size = 512;
+		std::atomic<bool> got_first{false};
+		std::thread writer([&]() {
+			std::FILE* f = std::fopen(fifo, "wb");
+			std::string block(block_size, 'a');
+			std::fwrite(block.data(), 1, block.size(), f);
+			std::fflush(f);
+			// the rest of the ring can't fill until the reader has the first block
+			while (!got_first.load())
+				std::this_thread::yield();
+			std::fwrite(block.data(), 1, block.size(), f);
+			std::fclose(f);
+		});
+		mpd::async_ifilebuf file(fifo, std::ios_base::in | std::ios_base::binary, block_size, 4);
+		char buffer[block_size];
+		assert(mpd::sync_wait(file.read_some(buffer, block_size)) == std::streamsize(block_size));
+		got_first.store(true);
+		writer.join();
+		assert(mpd::sync_wait(read_file(file)).size() == block_size);
+		::unlink(fifo);
+	}
+#endif
+#endif
+}
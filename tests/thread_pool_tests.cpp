@@ -0,0 +1,78 @@
+#include "concurrency/thread_pool.hpp"
+#include <atomic>
+#include <cassert>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+	// recursive fork/join, so workers wait on futures of tasks in their own deques
+	long long fib(mpd::thread_pool& pool, int n) {
+		if (n < 12) return n < 2 ? n : fib(pool, n - 1) + fib(pool, n - 2);
+		mpd::task_future<long long> left = pool.submit([&pool, n]() { return fib(pool, n - 1); });
+		long long right = fib(pool, n - 2);
+		return left.get() + right;
+	}
+}
+
+void test_thread_pool() {
+	{ // results, exceptions, and move-only results
+		mpd::thread_pool pool(2);
+		assert(pool.size() == 2);
+		assert(!pool.is_worker_thread());
+		mpd::task_future<int> answer = pool.submit([]() { return 42; });
+		mpd::task_future<std::string> text = pool.submit([]() { return std::string(100, 'x'); });
+		mpd::task_future<void> nothing = pool.submit([]() {});
+		mpd::task_future<std::unique_ptr<int>> owned = pool.submit([]() { return std::make_unique<int>(7); });
+		mpd::task_future<int> failure = pool.submit([]() -> int { throw std::runtime_error("failed"); });
+		mpd::task_future<bool> inside = pool.submit([&pool]() { return pool.is_worker_thread(); });
+		assert(answer.get() == 42);
+		assert(!answer.valid());
+		assert(text.get().size() == 100);
+		nothing.get();
+		assert(*owned.get() == 7);
+		bool thrown = false;
+		try { failure.get(); }
+		catch (const std::runtime_error&) { thrown = true; }
+		assert(thrown);
+		assert(inside.get());
+		// futures that are never waited on don't leak or block
+		pool.submit([]() { return 1; });
+	}
+	{ // lots of small tasks from outside, and posts
+		mpd::thread_pool pool(4);
+		std::atomic<int> count{0};
+		std::vector<mpd::task_future<int>> futures;
+		for (int i = 0; i < 10000; i++)
+			futures.push_back(pool.submit([i, &count]() { count.fetch_add(1, std::memory_order_relaxed); return i; }));
+		long long sum = 0;
+		for (mpd::task_future<int>& f : futures)
+			sum += f.get();
+		assert(sum == 10000LL * 9999 / 2);
+		for (int i = 0; i < 1000; i++)
+			pool.post([&count]() { count.fetch_add(1, std::memory_order_relaxed); });
+		pool.submit([]() {}).get();
+		while (count.load() != 11000) std::this_thread::yield();
+	}
+	{ // work stealing, with a single worker, and with several
+		mpd::thread_pool one(1);
+		assert(one.submit([&one]() { return fib(one, 20); }).get() == 6765);
+		mpd::thread_pool pool(4);
+		assert(pool.submit([&pool]() { return fib(pool, 24); }).get() == 46368);
+	}
+	{ // the destructor finishes tasks that tasks submitted
+		std::atomic<int> count{0};
+		{
+			mpd::thread_pool pool(2);
+			for (int i = 0; i < 100; i++) {
+				pool.post([&pool, &count]() {
+					for (int j = 0; j < 10; j++)
+						pool.post([&count]() { count.fetch_add(1); });
+				});
+			}
+		}
+		assert(count.load() == 1000);
+	}
+	assert(mpd::default_thread_pool().submit([]() { return 5; }).get() == 5);
+}